@@ -0,0 +1,219 @@
+#pragma once
+
+// Writes a linear RGBA float image (4 floats per pixel, row 0 at the top, rows tightly
+//   packed) as RGB without clamping, in binary PFM or in OpenEXR with 32-bit float channels.
+// The image is read one scanline at a time and only that scanline is copied, so `rgba`
+//   may point straight into mapped device memory.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace hdr {
+
+enum class ExrCompression : std::uint8_t {
+    none = 0u,
+    rle = 1u
+};
+
+
+namespace detail {
+
+template <typename T>
+void write_value(std::ofstream& file, T value) {
+    // PFM with a negative scale and OpenEXR are little endian, as every target of this repository
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void write_string(std::ofstream& file, std::string_view text) {
+    file.write(text.data(), static_cast<std::streamsize>(text.size()));
+    file.put('\0');
+}
+
+inline void write_attribute_header(std::ofstream& file, std::string_view name, std::string_view type, std::int32_t size) {
+    write_string(file, name);
+    write_string(file, type);
+    write_value(file, size);
+}
+
+// Split into even and odd bytes, then the difference to the previous byte, as OpenEXR
+//   does before its run-length encoding
+inline void exr_rle_predict(const std::vector<char>& data, std::vector<char>& predicted) {
+    predicted.resize(data.size());
+    const std::size_t half = (data.size() + 1uz) / 2uz;
+    for (std::size_t i { 0uz }; i < data.size(); ++i) {
+        predicted[(i & 1uz) == 0uz ? i / 2uz : half + i / 2uz] = data[i];
+    }
+
+    unsigned char previous = static_cast<unsigned char>(predicted[0uz]);
+    for (std::size_t i { 1uz }; i < predicted.size(); ++i) {
+        const unsigned char current = static_cast<unsigned char>(predicted[i]);
+        predicted[i] = static_cast<char>(static_cast<unsigned char>(current - previous + 128u));
+        previous = current;
+    }
+}
+
+// Runs of 3 - 128 equal bytes become (length - 1, byte), other bytes are copied
+//   behind a negative count, see rleCompress() of OpenEXR
+inline void exr_rle_compress(const std::vector<char>& data, std::vector<char>& compressed) {
+    constexpr std::ptrdiff_t min_run_length { 3 };
+    constexpr std::ptrdiff_t max_run_length { 127 };
+
+    compressed.clear();
+    const char* end = data.data() + data.size();
+    const char* run_start = data.data();
+    const char* run_end = run_start + 1;
+    while (run_start < end) {
+        while (run_end < end && *run_start == *run_end && run_end - run_start - 1 < max_run_length) { ++run_end; }
+        if (run_end - run_start >= min_run_length) {
+            compressed.push_back(static_cast<char>(run_end - run_start - 1));
+            compressed.push_back(*run_start);
+            run_start = run_end;
+        } else {
+            while (
+                run_end < end
+                && (
+                    (run_end + 1 >= end || *run_end != *(run_end + 1))
+                    || (run_end + 2 >= end || *(run_end + 1) != *(run_end + 2))
+                )
+                && run_end - run_start < max_run_length
+            ) {
+                ++run_end;
+            }
+            compressed.push_back(static_cast<char>(run_start - run_end));
+            compressed.insert(compressed.end(), run_start, run_end);
+            run_start = run_end;
+        }
+        ++run_end;
+    }
+}
+
+} // namespace detail end
+
+
+// Portable float map: "PF" header, then the rows bottom to top
+inline bool write_pfm(const std::string& fileName, const float* rgba, std::uint32_t width, std::uint32_t height) {
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open()) { return false; }
+
+    file << "PF\n" << width << ' ' << height << "\n-1.0\n"; // negative scale: little endian
+    std::vector<float> row(width * 3uz);
+    for (std::uint32_t y { height }; y-- > 0u;) {
+        const float* source = rgba + std::size_t { y } * width * 4uz;
+        for (std::size_t x { 0uz }; x < width; ++x) {
+            row[3uz * x + 0uz] = source[4uz * x + 0uz];
+            row[3uz * x + 1uz] = source[4uz * x + 1uz];
+            row[3uz * x + 2uz] = source[4uz * x + 2uz];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+
+    return file.good();
+}
+
+
+// Single-part scanline OpenEXR, one scanline per block. A block RLE does not
+//   shrink is stored as it is, which readers tell apart by its size.
+inline bool write_exr(
+    const std::string& fileName,
+    const float* rgba,
+    std::uint32_t width,
+    std::uint32_t height,
+    ExrCompression compression = ExrCompression::rle
+) {
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open() || width == 0u || height == 0u) { return false; }
+
+    constexpr std::int32_t pixel_type_float { 2 };
+    constexpr std::string_view channel_names[] = { "B", "G", "R" }; // sorted by name
+    constexpr std::size_t channel_offsets[] = { 2uz, 1uz, 0uz }; // in the RGBA source
+
+    const std::int32_t max_x = static_cast<std::int32_t>(width) - 1;
+    const std::int32_t max_y = static_cast<std::int32_t>(height) - 1;
+
+    detail::write_value(file, std::uint32_t { 20000630u }); // magic number
+    detail::write_value(file, std::uint32_t { 2u }); // version 2, single-part scanline
+
+    detail::write_attribute_header(file, "channels", "chlist", 3 * (2 + 16) + 1);
+    for (std::string_view name : channel_names) {
+        detail::write_string(file, name);
+        detail::write_value(file, pixel_type_float);
+        detail::write_value(file, std::uint32_t { 0u }); // pLinear and reserved
+        detail::write_value(file, std::int32_t { 1 }); // x sampling
+        detail::write_value(file, std::int32_t { 1 }); // y sampling
+    }
+    file.put('\0');
+    detail::write_attribute_header(file, "compression", "compression", 1);
+    detail::write_value(file, static_cast<std::uint8_t>(compression));
+    for (std::string_view window : { "dataWindow", "displayWindow" }) {
+        detail::write_attribute_header(file, window, "box2i", 16);
+        detail::write_value(file, std::int32_t { 0 });
+        detail::write_value(file, std::int32_t { 0 });
+        detail::write_value(file, max_x);
+        detail::write_value(file, max_y);
+    }
+    detail::write_attribute_header(file, "lineOrder", "lineOrder", 1);
+    detail::write_value(file, std::uint8_t { 0u }); // increasing y
+    detail::write_attribute_header(file, "pixelAspectRatio", "float", 4);
+    detail::write_value(file, 1.0f);
+    detail::write_attribute_header(file, "screenWindowCenter", "v2f", 8);
+    detail::write_value(file, 0.0f);
+    detail::write_value(file, 0.0f);
+    detail::write_attribute_header(file, "screenWindowWidth", "float", 4);
+    detail::write_value(file, 1.0f);
+    file.put('\0'); // end of the header
+
+    // The offsets of RLE blocks are only known once they are written, the table is filled in at the end
+    const std::streampos offset_table = file.tellp();
+    std::vector<std::uint64_t> offsets(height, 0u);
+    file.write(reinterpret_cast<const char*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(std::uint64_t)));
+
+    std::vector<char> scanline(width * 3uz * sizeof(float));
+    std::vector<char> predicted;
+    std::vector<char> compressed;
+    for (std::uint32_t y { 0u }; y < height; ++y) {
+        const float* source = rgba + std::size_t { y } * width * 4uz;
+        for (std::size_t c { 0uz }; c < 3uz; ++c) {
+            char* destination = scanline.data() + c * width * sizeof(float);
+            for (std::size_t x { 0uz }; x < width; ++x) {
+                std::memcpy(destination + x * sizeof(float), source + 4uz * x + channel_offsets[c], sizeof(float));
+            }
+        }
+
+        const std::vector<char>* block = &scanline;
+        if (compression == ExrCompression::rle) {
+            detail::exr_rle_predict(scanline, predicted);
+            detail::exr_rle_compress(predicted, compressed);
+            if (compressed.size() < scanline.size()) { block = &compressed; }
+        }
+
+        offsets[y] = static_cast<std::uint64_t>(file.tellp());
+        detail::write_value(file, static_cast<std::int32_t>(y));
+        detail::write_value(file, static_cast<std::int32_t>(block->size()));
+        file.write(block->data(), static_cast<std::streamsize>(block->size()));
+    }
+
+    file.seekp(offset_table);
+    file.write(reinterpret_cast<const char*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(std::uint64_t)));
+
+    return file.good();
+}
+
+
+inline bool is_hdr_file(const std::string& fileName) {
+    return fileName.ends_with(".pfm") || fileName.ends_with(".exr");
+}
+
+// PFM or OpenEXR (RLE) by the extension of fileName
+inline bool write_hdr(const std::string& fileName, const float* rgba, std::uint32_t width, std::uint32_t height) {
+    if (fileName.ends_with(".pfm")) { return write_pfm(fileName, rgba, width, height); }
+
+    return write_exr(fileName, rgba, width, height, ExrCompression::rle);
+}
+
+} // namespace hdr end
@@ -120,6 +120,7 @@ void Application::run() {
         }
     }
     vkDeviceWaitIdle(device.device());
+    renderer.reportGpuProfile();
 }
 
 void Application::loadGameObjects() {
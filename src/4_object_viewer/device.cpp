@@ -379,8 +379,12 @@ void Device::createLogicalDevice() {
     }
     createInfo.enabledExtensionCount = static_cast<uint32_t>(physicalDeviceExtensions.size());
     createInfo.ppEnabledExtensionNames = physicalDeviceExtensions.data();
+    VkPhysicalDeviceFeatures supportedFeatures {};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // the pipeline statistics of the renderer's gpu profiler
+    deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
     createInfo.pEnabledFeatures = &deviceFeatures;
 
     if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &logicalDevice_) != VK_SUCCESS) {
@@ -42,6 +42,7 @@ struct Device {
     ~Device();
 
     VkDevice device() { return logicalDevice_; }
+    VkPhysicalDevice getPhysicalDevice() { return physicalDevice; }
     VkQueue graphicsQueue() { return graphicsQueue_; }
     VkQueue presentQueue() { return presentQueue_; }
     VkSurfaceKHR surface() { return surface_; }
@@ -13,9 +13,23 @@ Renderer::Renderer(MainWindow& mainWindow_, Device& device_)
 {
     recreateSwapChain();
     createCommandBuffers();
+    gpuProfiler = std::make_unique<profiler::GpuProfiler>(
+        vk::PhysicalDevice { device.getPhysicalDevice() },
+        vk::Device { device.device() },
+        device.findPhysicalQueueFamilies().graphicsFamily.value(),
+        profiler::ProfilerOptions {
+            .frames_in_flight = SwapChain::MAX_FRAMES_IN_FLIGHT,
+            .pipeline_statistics = vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+                | vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+                | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations
+        }
+    );
 }
 
-Renderer::~Renderer() { freeCommandBuffers(); }
+Renderer::~Renderer() {
+    gpuProfiler.reset();
+    freeCommandBuffers();
+}
 
 void Renderer::recreateSwapChain() {
     VkExtent2D extent = mainWindow.getExtent();
@@ -87,12 +101,16 @@ VkCommandBuffer Renderer::beginFrame() {
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin recording command buffer!");
     }
+    // the in-flight fence of this frame was waited for by acquireNextImage
+    gpuProfiler->begin_frame(vk::CommandBuffer { commandBuffer }, static_cast<uint32_t>(currentFrameIndex));
+    frameZone = gpuProfiler->begin_zone(vk::CommandBuffer { commandBuffer }, "frame");
     return commandBuffer;
 }
 
 void Renderer::endFrame() {
     assert(isFrameStarted && "Can't call endFrame while frame is not in progress");
     auto commandBuffer = getCurrentCommandBuffer();
+    gpuProfiler->end_zone(vk::CommandBuffer { commandBuffer }, frameZone);
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to record command buffer!");
     }
@@ -110,6 +128,8 @@ void Renderer::endFrame() {
     currentFrameIndex = (currentFrameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
 }
 
+void Renderer::reportGpuProfile() { gpuProfiler->report(profiler::output_from_environment()); }
+
 void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
     assert(isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress");
     assert(
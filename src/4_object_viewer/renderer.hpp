@@ -8,6 +8,7 @@
 #include <device.hpp>
 #include <swapChain.hpp>
 #include <mainWindow.hpp>
+#include <gpu_profiler.hpp>
 
 
 namespace RealTimeBox {
@@ -36,6 +37,9 @@ struct Renderer {
     void endFrame();
     void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
     void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
+    // GPU time of the frames so far through minilog, and into GPU_PROFILE_FILE when it is set.
+    //   After vkDeviceWaitIdle.
+    void reportGpuProfile();
 
 private:
     void createCommandBuffers();
@@ -46,6 +50,8 @@ private:
     Device& device;
     std::unique_ptr<SwapChain> swapChain_ptr;
     std::vector<VkCommandBuffer> commandBuffers;
+    std::unique_ptr<profiler::GpuProfiler> gpuProfiler;
+    uint32_t frameZone { profiler::NO_ZONE }; // from beginFrame to endFrame
 
     uint32_t currentImageIndex;
     int currentFrameIndex { 0 };
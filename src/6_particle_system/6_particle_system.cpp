@@ -13,6 +13,7 @@
 #include <tiny_obj_loader.h>
 
 #include <minilog.hpp>
+#include <gpu_profiler.hpp>
 
 #include <cstdint>
 #include <stdexcept>
@@ -143,6 +144,7 @@ private:
     vk::CommandPool command_pool;
     std::vector<vk::CommandBuffer> render_command_buffers;
     std::vector<vk::CommandBuffer> compute_command_buffers;
+    std::optional<profiler::GpuProfiler> gpu_profiler; // of the particle dispatch
 
     vk::SurfaceKHR surface;
     vk::SwapchainKHR swapchain;
@@ -239,6 +241,7 @@ public:
             logical_device.destroy(storage_buffers[i]);
             logical_device.freeMemory(storage_device_memorys[i]);
         }
+        gpu_profiler.reset();
         logical_device.destroy(command_pool);
 
         logical_device.waitIdle();
@@ -298,6 +301,7 @@ private:
         create_command_pool();
         allocate_render_command_buffers();
         allocate_compute_command_buffers();
+        create_gpu_profiler();
 
         create_swapchain();
         create_swapchain_imageviews();
@@ -330,6 +334,7 @@ private:
             last_time = current_time;
         }
         logical_device.waitIdle();
+        gpu_profiler->report(profiler::output_from_environment());
     }
 
     void check_validation_layer_support() {
@@ -458,7 +463,8 @@ private:
         }
 
         vk::PhysicalDeviceFeatures physical_device_features {
-            .samplerAnisotropy = vk::True
+            .samplerAnisotropy = vk::True,
+            .pipelineStatisticsQuery = physical_device.getFeatures().pipelineStatisticsQuery // for gpu_profiler
         };
         vk::DeviceCreateInfo device_ci {
             .pNext = nullptr,
@@ -535,6 +541,18 @@ private:
         }
     }
 
+    // The compute fence of a frame is waited for before its command buffer is recorded again,
+    //   so the queries of that frame are available by then
+    void create_gpu_profiler() {
+        gpu_profiler.emplace(
+            physical_device, logical_device, find_queue_families(physical_device).graphic_and_compute.value(),
+            profiler::ProfilerOptions {
+                .frames_in_flight = MAX_FRAMES_IN_FLIGHT,
+                .pipeline_statistics = vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations
+            }
+        );
+    }
+
     void create_swapchain() {
         SwapChainSupportDetail swapchain_support_detail = query_swapchain_support_detail(physical_device);
         vk::SurfaceFormatKHR surface_format = choose_swapchain_surface_format(swapchain_support_detail.surface_formats);
@@ -1719,6 +1737,7 @@ private:
         ) {
             minilog::log_fatal("Failed to begin recording command buffer!");
         }
+        gpu_profiler->begin_frame(commandBuffer, current_frame);
 
         commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute_pipeline);
         commandBuffer.bindDescriptorSets(
@@ -1730,7 +1749,10 @@ private:
             0u,
             nullptr
         );
-        commandBuffer.dispatch(PARTICLE_COUNT / 256u, 1u, 1u);
+        {
+            profiler::GpuZone zone { *gpu_profiler, commandBuffer, "particles" };
+            commandBuffer.dispatch(PARTICLE_COUNT / 256u, 1u, 1u);
+        }
         commandBuffer.end(); // command buffer end
     }
 };
@@ -10,15 +10,26 @@
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtx/hash.hpp>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
 #include <minilog.hpp>
+#include <hdr_image_writer.hpp>
+
+#include <bvh_builder.hpp>
+#include <thread_pool.hpp>
+#include <gpu_profiler.hpp>
+
+#include "atrous_denoiser.hpp"
+#define TINYOBJLOADER_IMPLEMENTATION // tiny_obj_loader.h is included by scene.hpp
+#include "scene.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #include <cstdint>
 #include <stdexcept>
@@ -33,6 +44,15 @@
 #include <set>
 #include <cstddef> // offsetof
 #include <random>
+#include <chrono>
+#include <array>
+#include <map>
+#include <compare>
+#include <charconv>
+#include <string_view>
+#include <future>
+#include <filesystem>
+#include <cmath>
 
 #ifdef NDEBUG
     constexpr bool ENABLE_VALIDATION_LAYER { false };
@@ -50,6 +70,135 @@ const std::vector<const char*> DEVICE_EXTENSIONS = { vk::KHRSwapchainExtensionNa
 constexpr std::uint32_t MAX_FRAMES_IN_FLIGHT { 2u };
 constexpr std::uint32_t PARTICLE_COUNT { 1 };
 
+// The storage buffers of the compute descriptor set, storage_buffers[slot] is bound to
+//   binding slot + 1 of shaders/path_tracing.glsl and the shaders that include it, binding 0
+//   is the UniformBufferObject
+enum StorageBuffer : std::size_t {
+    PACKED_TRIANGLE_BUFFER,
+    INDEX_BUFFER,
+    PIXEL_COLOR_BUFFER,
+    BVH_NODE_BUFFER,
+    BVH_PRIMITIVE_BUFFER,
+    PATH_STATE_BUFFER, // the 5 buffers of the wavefront passes, see create_wavefront_buffers()
+    PATH_HIT_BUFFER,
+    WAVEFRONT_QUEUE_BUFFER,
+    RAY_QUEUE_BUFFER,
+    SHADOW_RAY_BUFFER,
+    RAY_COUNTER_BUFFER,
+    PIXEL_STATS_BUFFER,
+    TILE_QUEUE_BUFFER,
+    ACTIVE_TILE_BUFFER,
+    PIXEL_AOV_BUFFER,
+    DENOISE_BUFFER_0, // even a-trous iterations
+    DENOISE_BUFFER_1, // odd a-trous iterations
+    HISTORY_COLOR_BUFFER, // the copies reproject.comp reads, see create_history_buffers()
+    HISTORY_STATS_BUFFER,
+    HISTORY_AOV_BUFFER,
+    MATERIAL_BUFFER,
+    LIGHT_BUFFER,
+    RESERVOIR_BUFFER,
+    RESTIR_SURFACE_BUFFER,
+    SHADING_VERTEX_BUFFER,
+    INSTANCE_BUFFER,
+    TLAS_NODE_BUFFER,
+    TLAS_INSTANCE_BUFFER,
+    RADIANCE_CACHE_BUFFER,
+    GUIDING_BUFFER,
+    VISIBILITY_BUFFER,
+    UPSCALED_COLOR_BUFFER,
+    SHARPENED_COLOR_BUFFER,
+    STORAGE_BUFFER_COUNT
+};
+constexpr std::uint32_t storage_buffer_binding(std::size_t slot) { return static_cast<std::uint32_t>(slot) + 1u; }
+
+// Wavefront passes, see shaders/wavefront.glsl
+enum WavefrontPass : std::size_t {
+    WAVEFRONT_GENERATE,
+    WAVEFRONT_EXTEND,
+    WAVEFRONT_SHADE,
+    WAVEFRONT_CONNECT,
+    WAVEFRONT_ACCUMULATE,
+    WAVEFRONT_PASS_COUNT
+};
+const std::array<std::string, WAVEFRONT_PASS_COUNT> WAVEFRONT_SHADER_FILES = {
+    "./src/7_path_tracing/shaders/wavefront_generate_comp.spv",
+    "./src/7_path_tracing/shaders/wavefront_extend_comp.spv",
+    "./src/7_path_tracing/shaders/wavefront_shade_comp.spv",
+    "./src/7_path_tracing/shaders/wavefront_connect_comp.spv",
+    "./src/7_path_tracing/shaders/wavefront_accumulate_comp.spv"
+};
+// Sizes of the std430 structs of wavefront.glsl
+constexpr vk::DeviceSize WAVEFRONT_PATH_STATE_SIZE { 64u };
+constexpr vk::DeviceSize WAVEFRONT_PATH_HIT_SIZE { 24u };
+constexpr vk::DeviceSize WAVEFRONT_SHADOW_RAY_SIZE { 48u };
+constexpr vk::DeviceSize WAVEFRONT_QUEUE_SIZE { 16u }; // starts with a vk::DispatchIndirectCommand
+constexpr std::uint32_t WAVEFRONT_QUEUE_COUNT { 3u }; // extension rays of even/odd bounces, shadow rays
+constexpr std::uint32_t WAVEFRONT_SHADOW_QUEUE { 2u };
+// ReSTIR direct lighting passes, see shaders/restir.glsl
+enum RestirPass : std::size_t {
+    RESTIR_INITIAL,
+    RESTIR_TEMPORAL,
+    RESTIR_SPATIAL,
+    RESTIR_PASS_COUNT
+};
+const std::array<std::string, RESTIR_PASS_COUNT> RESTIR_SHADER_FILES = {
+    "./src/7_path_tracing/shaders/restir_initial_comp.spv",
+    "./src/7_path_tracing/shaders/restir_temporal_comp.spv",
+    "./src/7_path_tracing/shaders/restir_spatial_comp.spv"
+};
+// Sizes of the std430 structs of restir.glsl
+constexpr vk::DeviceSize RESTIR_RESERVOIR_SIZE { 32u };
+constexpr vk::DeviceSize RESTIR_SURFACE_SIZE { 32u };
+// World-space radiance cache of the megakernel, see shaders/radiance_cache.glsl
+const std::string RADIANCE_CACHE_SHADER_FILE { "./src/7_path_tracing/shaders/radiance_cache_resolve_comp.spv" };
+constexpr std::uint32_t RADIANCE_CACHE_CELL_COUNT { 1u << 18u };
+constexpr vk::DeviceSize RADIANCE_CACHE_CELL_SIZE { 48u }; // std430 RadianceCacheCell
+// Path guiding, see shaders/guiding.glsl
+const std::string GUIDING_SHADER_FILE { "./src/7_path_tracing/shaders/guiding_resolve_comp.spv" };
+constexpr std::uint32_t GUIDING_GRID_SIZE { 16u }; // cells per axis of the scene bounds
+constexpr std::uint32_t GUIDING_CELL_COUNT { GUIDING_GRID_SIZE * GUIDING_GRID_SIZE * GUIDING_GRID_SIZE };
+constexpr vk::DeviceSize GUIDING_CELL_SIZE { 3u * 256u * 4u }; // std430 GuidingCell: sums, density and CDF of 256 bins
+// Rasterized primary hits, see shaders/visibility.vert
+const std::string VISIBILITY_VERT_SHADER_FILE { "./src/7_path_tracing/shaders/visibility_vert.spv" };
+const std::string VISIBILITY_FRAG_SHADER_FILE { "./src/7_path_tracing/shaders/visibility_frag.spv" };
+constexpr vk::Format VISIBILITY_FORMAT { vk::Format::eR32G32B32A32Uint }; // instance, triangle, barycentrics
+constexpr vk::Format VISIBILITY_DEPTH_FORMAT { vk::Format::eD32Sfloat }; // reversed: 1 at the near plane
+constexpr vk::DeviceSize VISIBILITY_PIXEL_SIZE { 16u };
+// Interleaved rendering, see shaders/interleave_reconstruct.comp
+const std::string INTERLEAVE_SHADER_FILE { "./src/7_path_tracing/shaders/interleave_reconstruct_comp.spv" };
+// Spatial upscaler of a render scale, see shaders/upscale_edge.comp
+enum UpscalePass : std::size_t {
+    UPSCALE_EDGE,
+    UPSCALE_SHARPEN,
+    UPSCALE_PASS_COUNT
+};
+const std::array<std::string, UPSCALE_PASS_COUNT> UPSCALE_SHADER_FILES = {
+    "./src/7_path_tracing/shaders/upscale_edge_comp.spv",
+    "./src/7_path_tracing/shaders/upscale_sharpen_comp.spv"
+};
+constexpr std::array<std::uint32_t, 4uz> RENDER_SCALE_PRESETS = { 100u, 77u, 67u, 50u }; // percent of the window
+// Loaded when the compute pipelines are created, saved when the programme exits
+const std::string PIPELINE_CACHE_FILE { "./7_path_tracing.pipeline_cache" };
+constexpr std::uint32_t HEADLESS_DEFAULT_SAMPLES { 64u };
+// Screenshots copied to the host at the same time, a further request is skipped
+constexpr std::size_t SCREENSHOT_RING_SIZE { 3uz };
+// Copies of the displayed pixels the dispatches take turns to write, so the next
+//   dispatch runs while the copy of the previous one is presented, see draw_frame()
+constexpr std::size_t DISPLAY_COPY_COUNT { 2uz };
+// Adaptive sampling, see shaders/adaptive_tiles.comp
+const std::string ADAPTIVE_TILES_SHADER_FILE { "./src/7_path_tracing/shaders/adaptive_tiles_comp.spv" };
+constexpr std::uint32_t ADAPTIVE_TILE_SIZE { 8u }; // the workgroup of the per-pixel passes
+constexpr std::uint32_t ADAPTIVE_TILE_DISPATCH_WIDTH { 4096u };
+constexpr vk::DeviceSize PIXEL_STATS_SIZE { 16u }; // vec4 per pixel
+// Edge-avoiding a-trous denoiser, see shaders/denoise_atrous.comp
+const std::string DENOISE_SHADER_FILE { "./src/7_path_tracing/shaders/denoise_atrous_comp.spv" };
+// Carries the accumulation over to the new view when the camera moves, see shaders/reproject.comp
+const std::string REPROJECT_SHADER_FILE { "./src/7_path_tracing/shaders/reproject_comp.spv" };
+constexpr float CAMERA_MOVE_SPEED { 1.0f }; // scene units per second, the Cornell box is 2 units wide
+constexpr float CAMERA_LOOK_SPEED { 1.0f }; // radians per second
+// Headless adaptive rendering reads the active tile count back every that many dispatches
+constexpr std::uint32_t ADAPTIVE_CONVERGENCE_CHECK_INTERVAL { 8u };
+
 
 VKAPI_ATTR vk::Bool32 VKAPI_CALL
 debug_callback(
@@ -82,6 +231,31 @@ debug_callback(
 }
 
 
+// Clamps to [0, 1] and rounds to [0, 255], 16 channels at a time with SSE2
+void convert_to_rgba8(const float* source, unsigned char* destination, std::size_t count) {
+    std::size_t i { 0uz };
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    for (; i + 16uz <= count; i += 16uz) {
+        __m128i quads[4];
+        for (std::size_t j { 0uz }; j < 4uz; ++j) {
+            const __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i + 4uz * j), zero), one); // NaN -> 0
+            quads[j] = _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+        }
+        const __m128i low = _mm_packs_epi32(quads[0], quads[1]);
+        const __m128i high = _mm_packs_epi32(quads[2], quads[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; i < count; ++i) {
+        const float value = std::fmin(1.0f, std::fmax(0.0f, source[i])); // clamp [0.0, 1.0], NaN -> 0
+        destination[i] = static_cast<unsigned char>(std::nearbyint(value * 255.0f)); // [0, 255], ties to even as above
+    }
+}
+
+
 std::vector<char> read_shader_file(const std::string& fileName) {
     std::ifstream file(fileName, std::ios::ate | std::ios::binary);
     if (!file.is_open()) { minilog::log_fatal("Failed to open file: {}", fileName); }
@@ -97,51 +271,122 @@ std::vector<char> read_shader_file(const std::string& fileName) {
 
 
 struct UniformBufferObject {
+    scene::CameraUniform camera;
+    scene::CameraUniform previous_camera; // of the previous dispatch, reprojected from after a move
     std::uint32_t sample_index { 0u };
 };
 
 
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 color;
-    glm::vec2 uv;
+struct QueueFamilyIndex {
+    std::optional<std::uint32_t> graphic_and_compute;
+    std::optional<std::uint32_t> present;
+    std::optional<std::uint32_t> async_compute; // compute without graphics, runs next to the graphics queue
+
+    std::uint32_t compute() const { return async_compute.value_or(graphic_and_compute.value()); }
 
-    bool operator==(const Vertex& other) const {
-        return position == other.position
-            && color == other.color
-            && uv == other.uv;
+    bool has_value(bool presentRequired = true) {
+        return graphic_and_compute.has_value()
+            && (present.has_value() || !presentRequired);
     }
 };
-namespace std {
-template<> struct hash<Vertex> {
-    std::size_t operator()(const Vertex& vertex) const {
-        auto x = hash<glm::vec3>()(vertex.position);
-        auto y = hash<glm::vec3>()(vertex.color) << 1;
-        auto z = hash<glm::vec2>()(vertex.uv) << 1;
-        return ((x ^ y) >> 1) ^ z;
-    }
+
+
+// Specialization constants 0 - 13 of the shaders, in constant_id order
+struct RenderConfig {
+    std::uint32_t width { 1920u };
+    std::uint32_t height { 1080u };
+    std::uint32_t spp { 1u }; // samples per pixel and dispatch
+    std::uint32_t depth { 10u }; // bounces per path
+    std::uint32_t count_rays { 0u }; // 1: the shaders add the rays they trace to the ray counter
+    std::uint32_t adaptive { 0u }; // 1: only the tiles that did not converge are traced
+    float adaptive_threshold { 0.02f }; // relative standard error of the mean luminance
+    std::uint32_t restir { 0u }; // 1: reservoir resampled direct lighting at the primary hit, megakernel only
+    std::uint32_t radiance_cache { 0u }; // 1: paths stop at the radiance cache, 2: and it is shown, megakernel only
+    std::uint32_t guiding { 0u }; // 1: bounces sampled from the learned guide too, megakernel only
+    std::uint32_t raster_primary { 0u }; // 1: primary hits rasterized once per camera change, megakernel only
+    std::uint32_t interleave { 1u }; // pixels per traced pixel: 1, 2 (checkerboard) or 4 (2x2 cells), megakernel only
+    std::uint32_t output_width { 1920u }; // of the window, width and height scaled up to it with a render scale
+    std::uint32_t output_height { 1080u };
+
+    auto operator<=>(const RenderConfig&) const = default;
 };
-} // namespace std end
 
 
-struct Triangle {
-    std::uint32_t t0;
-    std::uint32_t t1;
-    std::uint32_t t2;
+// Compute pipelines built for one RenderConfig
+struct ComputePipelines {
+    vk::Pipeline megakernel;
+    std::array<vk::Pipeline, WAVEFRONT_PASS_COUNT> wavefront {};
+    vk::Pipeline adaptive_tiles; // RenderConfig::adaptive only
+    vk::Pipeline denoise; // Options::denoise_iterations > 0 only
+    vk::Pipeline reproject; // windowed only
+    std::array<vk::Pipeline, RESTIR_PASS_COUNT> restir {}; // RenderConfig::restir only
+    vk::Pipeline radiance_cache; // RenderConfig::radiance_cache only
+    vk::Pipeline guiding; // RenderConfig::guiding only
+    vk::Pipeline interleave; // RenderConfig::interleave > 1 only
+    std::array<vk::Pipeline, UPSCALE_PASS_COUNT> upscale {}; // Options::render_scale < 100 only
 };
 
 
-struct QueueFamilyIndex {
-    std::optional<std::uint32_t> graphic_and_compute;
-    std::optional<std::uint32_t> present;
+struct WavefrontConstants {
+    std::uint32_t bounce { 0u };
+    std::uint32_t path_sample { 0u };
+};
 
-    bool has_value() {
-        return graphic_and_compute.has_value()
-            && present.has_value();
-    }
+
+struct DenoiseConstants {
+    std::uint32_t iteration { 0u };
+    std::uint32_t iteration_count { 0u };
+};
+
+
+struct UpscaleConstants {
+    std::uint32_t source { 0u }; // 0: pixel_colors, 1 / 2: the even / odd a-trous buffer
+};
+
+
+// A persistently mapped copy of pixel_colors, see PathTracing::request_screenshot()
+struct ScreenshotSlot {
+    vk::Buffer buffer;
+    vk::DeviceMemory device_memory;
+    const float* mapped { nullptr };
+    vk::CommandBuffer command_buffer;
+    vk::Fence fence; // signaled once the copy is done
+    bool copying { false };
+    std::string file_name;
+    std::future<void> encoding; // conversion and PNG encoding on the screenshot worker
+};
+
+
+struct Options {
+    RenderConfig render_config {};
+    bool wavefront { false }; // split-kernel passes instead of the megakernel
+    std::uint32_t benchmark_samples { 0u }; // > 0: time both kernels over that many samples, then exit
+    // Headless: no window, surface, swapchain nor graphics pipeline. Renders until `samples`
+    //   are accumulated, `time_budget` seconds have passed or, with adaptive sampling,
+    //   every tile converged, then writes `output` and exits.
+    bool headless { false };
+    std::uint32_t samples { 0u };
+    double time_budget { 0.0 };
+    std::string output { "output_image.png" }; // *.png, or *.pfm / *.exr for the unclamped radiance
+    std::uint32_t capture_interval { 0u }; // > 0: a numbered screenshot every that many dispatches
+    // > 0: that many a-trous iterations after every dispatch (headless: once, at the end,
+    //   checked against the CPU reference)
+    std::uint32_t denoise_iterations { 0u };
+    // GPU zones of the dispatches, *.csv or *.json, written at exit. Defaults to GPU_PROFILE_FILE.
+    std::string profile_output { profiler::output_from_environment().string() };
+    std::uint32_t bvh_width { bvh::WIDE_NODE_CHILDREN }; // children per node of the bottom-level BVHs, 2 to 8
+    // Percent of the window the paths are traced at, one of RENDER_SCALE_PRESETS. Below 100
+    //   a compute pass upscales the image to the window, windowed only.
+    std::uint32_t render_scale { 100u };
 };
 
 
+// A side of the window scaled by Options::render_scale, at least a pixel
+std::uint32_t scaled_extent(std::uint32_t extent, std::uint32_t percent) {
+    return std::max((extent * percent + 50u) / 100u, 1u);
+}
+
+
 struct SwapChainSupportDetail {
     vk::SurfaceCapabilitiesKHR surface_capabilities;
     std::vector<vk::SurfaceFormatKHR> surface_formats;
@@ -151,9 +396,12 @@ struct SwapChainSupportDetail {
 
 class PathTracing {
 private:
-    std::uint32_t width;
+    std::uint32_t width; // the paths are traced at width x height
     std::uint32_t height;
+    std::uint32_t display_width; // the window, larger than width x height with a render scale
+    std::uint32_t display_height;
     std::string window_name;
+    Options options;
     GLFWwindow* glfw_window { nullptr };
 
     vk::Instance instance;
@@ -163,12 +411,16 @@ private:
     vk::PhysicalDevice physical_device;
     vk::Device logical_device;
     vk::Queue graphic_queue;
-    vk::Queue compute_queue;
+    vk::Queue compute_queue; // of the async compute family when there is one
     vk::Queue present_queue;
+    // Both families when they differ, the buffers are then shared concurrently by the queues
+    std::vector<std::uint32_t> buffer_queue_families;
 
     vk::CommandPool command_pool;
+    vk::CommandPool compute_command_pool;
     std::vector<vk::CommandBuffer> render_command_buffers;
     std::vector<vk::CommandBuffer> compute_command_buffers;
+    std::optional<profiler::GpuProfiler> gpu_profiler; // of the compute queue
 
     vk::SurfaceKHR surface;
     vk::SwapchainKHR swapchain;
@@ -179,32 +431,55 @@ private:
     std::vector<vk::Framebuffer> frame_buffers;
 
     UniformBufferObject ubo;
+    scene::FlyCamera camera;
+    bool camera_moved { false }; // since the last dispatch
+    bool reproject_history { false }; // in the dispatch being recorded
     std::vector<vk::Buffer> uniform_buffers;
     std::vector<vk::DeviceMemory> uniform_device_memorys;
     std::vector<void*> uniform_buffers_mapped;
-    std::vector<Vertex> vertices;
-    std::vector<Triangle> indices;
+    scene::Scene model; // the .obj, its BVHs and instances
     std::vector<vk::Buffer> storage_buffers;
     std::vector<vk::DeviceMemory> storage_device_memorys;
+    std::array<vk::Buffer, DISPLAY_COPY_COUNT> display_copies;
+    std::array<vk::DeviceMemory, DISPLAY_COPY_COUNT> display_copy_memorys;
+    std::array<ScreenshotSlot, SCREENSHOT_RING_SIZE> screenshot_ring;
+    std::size_t next_screenshot_slot { 0uz };
+    bvh::ThreadPool screenshot_worker { 1u };
 
     vk::DescriptorSetLayout compute_descriptor_set_layout;
     vk::PipelineLayout compute_pipeline_layout;
-    vk::Pipeline compute_pipeline;
+    vk::PipelineCache pipeline_cache;
+    RenderConfig render_config; // spp and depth can change while rendering, see key_callback()
+    std::map<RenderConfig, ComputePipelines> compute_pipelines; // every configuration used so far
 
     vk::RenderPass render_pass;
     vk::DescriptorSetLayout render_descriptor_set_layout;
     vk::PipelineLayout render_pipeline_layout;
     vk::Pipeline render_pipeline;
 
+    // RenderConfig::raster_primary only: the visibility buffer is copied from the image
+    vk::Image visibility_image;
+    vk::DeviceMemory visibility_image_memory;
+    vk::ImageView visibility_imageview;
+    vk::Image visibility_depth_image;
+    vk::DeviceMemory visibility_depth_image_memory;
+    vk::ImageView visibility_depth_imageview;
+    vk::RenderPass visibility_render_pass;
+    vk::Framebuffer visibility_framebuffer;
+    vk::Pipeline visibility_pipeline; // of the compute pipeline layout, it reads its descriptor set
+    bool rasterize_visibility { true }; // in the dispatch being recorded: the camera moved since the last raster
+
     vk::DescriptorPool descriptor_pool;
     std::vector<vk::DescriptorSet> compute_descriptor_sets;
     std::vector<vk::DescriptorSet> render_descriptor_sets;
 
     std::vector<vk::Semaphore> image_available_semaphores;
     std::vector<vk::Semaphore> render_finished_semaphores;
-    std::vector<vk::Semaphore> compute_finished_semaphores;
-    std::vector<vk::Fence> render_in_flight_fences;
-    std::vector<vk::Fence> compute_in_flight_fences;
+    vk::Semaphore compute_timeline; // dispatch n signals n
+    vk::Semaphore render_timeline; // frame n signals n
+    std::uint64_t compute_timeline_value { 0u }; // dispatches submitted
+    std::uint64_t render_timeline_value { 0u }; // frames submitted
+    std::array<std::uint64_t, DISPLAY_COPY_COUNT> display_copy_reads {}; // the last frame that read each copy
     std::uint32_t current_frame { 0u };
 
     bool framebuffer_resized { false };
@@ -215,6 +490,8 @@ public:
     PathTracing()
         : width { 1920u }
         , height { 1080u }
+        , display_width { 1920u }
+        , display_height { 1080u }
         , window_name { "7_path_tracing"s }
     {
         ubo.sample_index = 0u;
@@ -227,25 +504,67 @@ public:
     )
         : width { _width }
         , height { _height }
+        , display_width { _width }
+        , display_height { _height }
         , window_name { _window_name }
+        , render_config { .width = _width, .height = _height, .output_width = _width, .output_height = _height }
     {
         ubo.sample_index = 0u;
     }
 
+    explicit PathTracing(const Options& _options)
+        : width { scaled_extent(_options.render_config.width, _options.render_scale) }
+        , height { scaled_extent(_options.render_config.height, _options.render_scale) }
+        , display_width { _options.render_config.width }
+        , display_height { _options.render_config.height }
+        , window_name { "7_path_tracing"s }
+        , options { _options }
+        , render_config { _options.render_config }
+    {
+        render_config.width = width;
+        render_config.height = height;
+        render_config.output_width = display_width;
+        render_config.output_height = display_height;
+        render_config.count_rays = options.headless ? 1u : 0u;
+        ubo.sample_index = 0u;
+    }
+
     ~PathTracing() {
+        flush_screenshots();
         cleanup_swapchain();
-        for (std::size_t i { 0uz }; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        for (std::size_t i { 0uz }; i < image_available_semaphores.size(); ++i) {
             logical_device.destroy(render_finished_semaphores[i]);
             logical_device.destroy(image_available_semaphores[i]);
-            logical_device.destroy(compute_finished_semaphores[i]);
-            logical_device.destroy(render_in_flight_fences[i]);
-            logical_device.destroy(compute_in_flight_fences[i]);
         }
+        logical_device.destroy(compute_timeline);
+        logical_device.destroy(render_timeline);
         logical_device.destroy(descriptor_pool);
         logical_device.destroy(render_pipeline);;
         logical_device.destroy(render_pipeline_layout);
         logical_device.destroy(render_pass);
-        logical_device.destroy(compute_pipeline);
+        logical_device.destroy(visibility_pipeline);
+        logical_device.destroy(visibility_framebuffer);
+        logical_device.destroy(visibility_render_pass);
+        logical_device.destroy(visibility_imageview);
+        logical_device.destroy(visibility_image);
+        logical_device.freeMemory(visibility_image_memory);
+        logical_device.destroy(visibility_depth_imageview);
+        logical_device.destroy(visibility_depth_image);
+        logical_device.freeMemory(visibility_depth_image_memory);
+        for (auto& [config, pipelines] : compute_pipelines) {
+            logical_device.destroy(pipelines.megakernel);
+            logical_device.destroy(pipelines.adaptive_tiles);
+            logical_device.destroy(pipelines.denoise);
+            logical_device.destroy(pipelines.reproject);
+            logical_device.destroy(pipelines.radiance_cache);
+            logical_device.destroy(pipelines.guiding);
+            logical_device.destroy(pipelines.interleave);
+            for (auto& pipeline : pipelines.wavefront) { logical_device.destroy(pipeline); }
+            for (auto& pipeline : pipelines.restir) { logical_device.destroy(pipeline); }
+            for (auto& pipeline : pipelines.upscale) { logical_device.destroy(pipeline); }
+        }
+        save_pipeline_cache();
+        logical_device.destroy(pipeline_cache);
         logical_device.destroy(compute_pipeline_layout);
         logical_device.destroy(compute_descriptor_set_layout);
         logical_device.destroy(render_descriptor_set_layout);
@@ -258,6 +577,17 @@ public:
             logical_device.destroy(storage_buffers[i]);
             logical_device.freeMemory(storage_device_memorys[i]);
         }
+        for (std::size_t i { 0uz }; i < DISPLAY_COPY_COUNT; ++i) {
+            logical_device.destroy(display_copies[i]);
+            logical_device.freeMemory(display_copy_memorys[i]);
+        }
+        for (ScreenshotSlot& slot : screenshot_ring) {
+            logical_device.destroy(slot.fence);
+            logical_device.destroy(slot.buffer);
+            logical_device.freeMemory(slot.device_memory); // implicitly unmapped
+        }
+        gpu_profiler.reset();
+        logical_device.destroy(compute_command_pool);
         logical_device.destroy(command_pool);
 
         // logical_device.waitIdle();
@@ -273,14 +603,23 @@ public:
         instance.destroy(surface);
         instance.destroy();
 
-        glfwDestroyWindow(glfw_window);
-        glfwTerminate();
+        if (glfw_window) {
+            glfwDestroyWindow(glfw_window);
+            glfwTerminate();
+        }
     }
 
     void run() {
-        init_window();
+        if (!options.headless) { init_window(); }
         init_vulkan();
-        render_loop();
+        if (options.benchmark_samples > 0u) {
+            benchmark();
+        } else if (options.headless) {
+            render_headless();
+        } else {
+            render_loop();
+        }
+        gpu_profiler->report(options.profile_output);
     }
 
 private:
@@ -289,7 +628,7 @@ private:
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
-        glfw_window = glfwCreateWindow(width, height, window_name.c_str(), nullptr, nullptr);
+        glfw_window = glfwCreateWindow(display_width, display_height, window_name.c_str(), nullptr, nullptr);
         if (!glfw_window) { minilog::log_fatal("Failed to create GLFWwindow!"); }
 
         glfwSetWindowUserPointer(glfw_window, this);
@@ -301,6 +640,13 @@ private:
                 minilog::log_info("the window's size is ({0}, {1})", width, height);
             }
         );
+        glfwSetKeyCallback(
+            glfw_window,
+            [](GLFWwindow* window, int key, int scancode, int action, int mods) {
+                auto app = reinterpret_cast<PathTracing*>(glfwGetWindowUserPointer(window));
+                app->key_callback(key, action);
+            }
+        );
 
         last_time = glfwGetTime();
     }
@@ -310,33 +656,45 @@ private:
         create_instance();
         setup_debug_messenger();
 
-        create_surface();
+        if (!options.headless) { create_surface(); }
         pick_physical_device();
         create_logical_device();
 
         create_command_pool();
-        allocate_render_command_buffers();
         allocate_compute_command_buffers();
-
-        create_swapchain();
-        create_swapchain_imageviews();
+        create_gpu_profiler();
+        if (!options.headless) {
+            allocate_render_command_buffers();
+            create_swapchain();
+            create_swapchain_imageviews();
+        }
 
         create_uniform_buffers();
-        load_obj_model();
+        model = scene::load_scene({}, bvh::CollapseOptions { .width = options.bvh_width });
         create_storage_buffers();
+        if (!options.headless) { create_display_copies(); }
+        create_screenshot_ring();
 
         create_compute_descriptor_set_layout();
+        create_pipeline_cache();
         create_compute_pipeline();
+        if (render_config.raster_primary != 0u) {
+            create_visibility_targets();
+            create_visibility_render_pass();
+            create_visibility_pipeline();
+        }
 
-        create_render_pass();
-        create_render_descriptor_set_layout();
-        create_graphic_pipeline();
+        if (!options.headless) {
+            create_render_pass();
+            create_render_descriptor_set_layout();
+            create_graphic_pipeline();
 
-        create_frame_buffers();
+            create_frame_buffers();
+        }
 
         create_descriptor_pool();
         create_compute_descriptor_sets();
-        create_render_descriptor_sets();
+        if (!options.headless) { create_render_descriptor_sets(); }
 
         create_sync_objects();
     }
@@ -344,63 +702,436 @@ private:
     void render_loop() {
         while (!glfwWindowShouldClose(glfw_window)) {
             glfwPollEvents();
+            update_camera(last_frame_time / 1000.0f);
             draw_frame();
+            capture_interval_screenshot();
+            poll_screenshots();
 
-            // F11: reset sample_index
+            // F11: reset sample_index, which throws the accumulation away instead of reprojecting it
             if (glfwGetKey(glfw_window, GLFW_KEY_F11) != GLFW_RELEASE) {
                 ubo.sample_index = 0u;
                 minilog::log_debug("the ubo.sample_index is reset to 0u");
             }
 
-            // F12: screenshot
-            if (glfwGetKey(glfw_window, GLFW_KEY_F12) != GLFW_RELEASE) {
-                std::vector<float> output_data(width * height * 4uz, 0.0f);
-
-                vk::DeviceSize device_size = width * height * 4u * 4u;
-                vk::Buffer staging_buffer;
-                vk::DeviceMemory staging_device_memory;
-                create_buffer(
-                    device_size,
-                    vk::BufferUsageFlagBits::eTransferDst,
-                    vk::MemoryPropertyFlagBits::eHostVisible
-                    | vk::MemoryPropertyFlagBits::eHostCoherent,
-                    staging_buffer,
-                    staging_device_memory
-                );
+            // We want to animate the particle system using the last frames time to get smooth,
+            //   frame-rate independent animation
+            double current_time = glfwGetTime();
+            last_frame_time = (current_time - last_time) * 1000.0;
+            last_time = current_time;
+        }
+        logical_device.waitIdle();
+    }
 
-                copy_buffer(storage_buffers[2uz], staging_buffer, device_size);
+    // Compute only: every dispatch adds render_config.spp samples, in flight like draw_frame()
+    void render_headless() {
+        std::uint32_t target_samples = options.samples;
+        if (target_samples == 0u && options.time_budget <= 0.0) {
+            target_samples = HEADLESS_DEFAULT_SAMPLES;
+            minilog::log_info("headless: neither --samples nor --time given, rendering {} samples", target_samples);
+        }
+        reset_ray_counter();
 
-                void* data = logical_device.mapMemory(staging_device_memory, 0u, device_size, {});
-                memcpy(output_data.data(), data, static_cast<std::size_t>(device_size));
-                logical_device.unmapMemory(staging_device_memory);
+        std::uint32_t samples { 0u };
+        std::uint32_t dispatches { 0u };
+        const auto start = std::chrono::steady_clock::now();
+        auto elapsed_seconds = [&start] () {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+        while (
+            (target_samples == 0u || samples < target_samples)
+            && (options.time_budget <= 0.0 || elapsed_seconds() < options.time_budget)
+        ) {
+            submit_compute();
+            current_frame = (current_frame + 1u) % MAX_FRAMES_IN_FLIGHT;
+            samples += render_config.spp;
+            capture_interval_screenshot();
+            poll_screenshots();
+            // Stopping criterion: the tile pass of the last dispatch found every tile converged
+            if (render_config.adaptive != 0u && ++dispatches % ADAPTIVE_CONVERGENCE_CHECK_INTERVAL == 0u) {
+                logical_device.waitIdle();
+                if (read_active_tile_count() == 0u) {
+                    minilog::log_info("headless: every tile converged after {} samples per pixel", samples);
+                    break;
+                }
+            }
+        }
+        logical_device.waitIdle();
+        const double seconds = elapsed_seconds();
 
-                logical_device.destroy(staging_buffer);
-                logical_device.freeMemory(staging_device_memory);
+        const double rays = static_cast<double>(read_ray_counter());
+        minilog::log_info(
+            "headless: {} samples per pixel at {}x{} in {:.3f} s, {:.2f} samples/s, {:.2f} M rays/s",
+            samples, width, height, seconds, samples / seconds, rays / seconds / 1e6
+        );
+        flush_screenshots(); // every slot is free for the final image
+        if (options.denoise_iterations > 0u) {
+            vk::CommandBuffer command_buffer = begin_single_time_commands();
+            command_buffer.bindDescriptorSets(
+                vk::PipelineBindPoint::eCompute,
+                compute_pipeline_layout,
+                0u,
+                1u, &compute_descriptor_sets[current_frame],
+                0u, nullptr
+            );
+            record_denoise_passes(command_buffer, get_compute_pipelines(render_config));
+            end_single_time_commands(command_buffer);
+            request_screenshot(options.output, denoised_buffer());
+            check_denoiser_reference();
+        } else {
+            request_screenshot(options.output);
+        }
+        flush_screenshots();
+    }
 
-                std::vector<unsigned char> image_data_uchar(width * height * 4u);
-                for (size_t i = 0; i < output_data.size(); ++i) {
-                    float value = output_data[i];
-                    value = std::fmax(0.0f, std::fmin(1.0f, value)); // clamp [0.0, 1.0]
-                    image_data_uchar[i] = static_cast<unsigned char>(std::round(value * 255.0f)); // [0, 255]
-                }
+    // Runs denoiser::denoise_reference() on the inputs of the GPU passes and reports how
+    //   far the two results are apart
+    void check_denoiser_reference() {
+        const std::size_t pixel_count = std::size_t { width } * height;
+        const std::vector<glm::vec4> colors = read_device_buffer<glm::vec4>(storage_buffers[PIXEL_COLOR_BUFFER], pixel_count);
+        const std::vector<denoiser::PixelAov> aovs = read_device_buffer<denoiser::PixelAov>(storage_buffers[PIXEL_AOV_BUFFER], pixel_count);
+        const std::vector<glm::vec4> denoised = read_device_buffer<glm::vec4>(denoised_buffer(), pixel_count);
+
+        const auto start = std::chrono::steady_clock::now();
+        const std::vector<glm::vec4> reference = denoiser::denoise_reference(
+            colors, aovs, width, height, options.denoise_iterations
+        );
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double squared_error { 0.0 };
+        float max_relative_error { 0.0f };
+        for (std::size_t i { 0uz }; i < pixel_count; ++i) {
+            const glm::vec3 error = glm::abs(glm::vec3(denoised[i]) - glm::vec3(reference[i]));
+            squared_error += glm::dot(error, error);
+            const glm::vec3 relative_error = error / glm::max(glm::abs(glm::vec3(reference[i])), glm::vec3(1.0f));
+            max_relative_error = std::max({ max_relative_error, relative_error.x, relative_error.y, relative_error.z });
+        }
+        const double rmse = std::sqrt(squared_error / (3.0 * static_cast<double>(pixel_count)));
+        minilog::log_info(
+            "denoise: GPU vs CPU reference ({:.3f} s): RMSE {:.6f}, max relative error {:.6f}",
+            seconds, rmse, max_relative_error
+        );
+        if (max_relative_error > 1e-3f) { minilog::log_warn("denoise: the GPU passes and the CPU reference disagree!"); }
+    }
 
-                const char* file_name = "output_image.png";
-                int stride_in_bytes = width * 4; // bytes/row
-                if (
-                    int result = stbi_write_png(file_name, width, height, 4, image_data_uchar.data(), stride_in_bytes);
-                    result == 1
-                ) {
-                    minilog::log_debug("write {} successful!", file_name);
+    // Blocking copy to the host, for checks at the end of a headless render only
+    template <typename T>
+    std::vector<T> read_device_buffer(vk::Buffer buffer, std::size_t count) {
+        const vk::DeviceSize device_size = count * sizeof(T);
+        vk::Buffer staging_buffer;
+        vk::DeviceMemory staging_device_memory;
+        create_buffer(
+            device_size,
+            vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eHostVisible
+            | vk::MemoryPropertyFlagBits::eHostCoherent,
+            staging_buffer,
+            staging_device_memory
+        );
+        copy_buffer(buffer, staging_buffer, device_size);
+
+        std::vector<T> data(count);
+        void* mapped = logical_device.mapMemory(staging_device_memory, 0u, device_size, {});
+        memcpy(data.data(), mapped, static_cast<std::size_t>(device_size));
+        logical_device.unmapMemory(staging_device_memory);
+
+        logical_device.destroy(staging_buffer);
+        logical_device.freeMemory(staging_device_memory);
+
+        return data;
+    }
+
+    void create_screenshot_ring() {
+        const vk::DeviceSize device_size = vk::DeviceSize { width } * height * 4u * 4u;
+        // Cached memory when there is one, the worker reads every byte of it
+        vk::MemoryPropertyFlags properties = vk::MemoryPropertyFlagBits::eHostVisible
+            | vk::MemoryPropertyFlagBits::eHostCoherent;
+        const vk::PhysicalDeviceMemoryProperties memory_properties = physical_device.getMemoryProperties();
+        for (std::uint32_t i { 0u }; i < memory_properties.memoryTypeCount; ++i) {
+            const vk::MemoryPropertyFlags cached = properties | vk::MemoryPropertyFlagBits::eHostCached;
+            if ((memory_properties.memoryTypes[i].propertyFlags & cached) == cached) {
+                properties = cached;
+                break;
+            }
+        }
+
+        std::array<vk::CommandBuffer, SCREENSHOT_RING_SIZE> command_buffers {};
+        vk::CommandBufferAllocateInfo command_buffer_ai {
+            .pNext = nullptr,
+            .commandPool = compute_command_pool,
+            .level = vk::CommandBufferLevel::ePrimary,
+            .commandBufferCount = static_cast<std::uint32_t>(command_buffers.size())
+        };
+        if (
+            vk::Result result = logical_device.allocateCommandBuffers(&command_buffer_ai, command_buffers.data());
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to allocate screenshot command buffers!");
+        }
+
+        vk::FenceCreateInfo fence_ci {
+            .pNext = nullptr,
+            .flags = {}
+        };
+        for (std::size_t i { 0uz }; i < screenshot_ring.size(); ++i) {
+            ScreenshotSlot& slot = screenshot_ring[i];
+            create_buffer(
+                device_size,
+                vk::BufferUsageFlagBits::eTransferDst,
+                properties,
+                slot.buffer,
+                slot.device_memory
+            );
+            slot.mapped = static_cast<const float*>(logical_device.mapMemory(slot.device_memory, 0u, device_size, {}));
+            slot.command_buffer = command_buffers[i];
+            if (
+                vk::Result result = logical_device.createFence(&fence_ci, nullptr, &slot.fence);
+                result != vk::Result::eSuccess
+            ) {
+                minilog::log_fatal("Failed to create screenshot vk::Fence!");
+            }
+        }
+    }
+
+    // Copies pixel_colors into the next ring slot behind the compute work submitted so far,
+    //   poll_screenshots() hands it to the worker once the copy is done
+    void request_screenshot(const std::string& fileName) { request_screenshot(fileName, display_buffer()); }
+
+    void request_screenshot(const std::string& fileName, vk::Buffer source) {
+        poll_screenshots();
+        ScreenshotSlot& slot = screenshot_ring[next_screenshot_slot];
+        if (
+            slot.copying
+            || (slot.encoding.valid() && slot.encoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        ) {
+            minilog::log_warn("every screenshot slot is busy, {} is skipped", fileName);
+            return;
+        }
+        next_screenshot_slot = (next_screenshot_slot + 1uz) % screenshot_ring.size();
+
+        vk::CommandBufferBeginInfo command_buffer_bi {
+            .pNext = nullptr,
+            .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+            .pInheritanceInfo = {}
+        };
+        slot.command_buffer.reset({});
+        if (
+            vk::Result result = slot.command_buffer.begin(&command_buffer_bi);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to begin recording command buffer!");
+        }
+        vk::MemoryBarrier memory_barrier { // the dispatches submitted before write pixel_colors
+            .pNext = nullptr,
+            .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+            .dstAccessMask = vk::AccessFlagBits::eTransferRead
+        };
+        slot.command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            1u, &memory_barrier,
+            0u, nullptr,
+            0u, nullptr
+        );
+        vk::BufferCopy buffer_copy {
+            .srcOffset = 0u,
+            .dstOffset = 0u,
+            .size = vk::DeviceSize { width } * height * 4u * 4u
+        };
+        slot.command_buffer.copyBuffer(source, slot.buffer, 1u, &buffer_copy);
+        vk::MemoryBarrier host_barrier {
+            .pNext = nullptr,
+            .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = vk::AccessFlagBits::eHostRead
+        };
+        slot.command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eHost,
+            {},
+            1u, &host_barrier,
+            0u, nullptr,
+            0u, nullptr
+        );
+        slot.command_buffer.end();
+
+        vk::SubmitInfo submit_info {
+            .pNext = nullptr,
+            .waitSemaphoreCount = 0u,
+            .pWaitSemaphores = nullptr,
+            .pWaitDstStageMask = nullptr,
+            .commandBufferCount = 1u,
+            .pCommandBuffers = &slot.command_buffer,
+            .signalSemaphoreCount = 0u,
+            .pSignalSemaphores = nullptr
+        };
+        if (
+            vk::Result result = compute_queue.submit(1u, &submit_info, slot.fence);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("screenshot: failed to submit copy command buffer!");
+        }
+        slot.copying = true;
+        slot.file_name = fileName;
+    }
+
+    // Hands the slots whose copy is done to the worker, never waits
+    void poll_screenshots() {
+        for (ScreenshotSlot& slot : screenshot_ring) {
+            if (!slot.copying || logical_device.getFenceStatus(slot.fence) != vk::Result::eSuccess) { continue; }
+            slot.copying = false;
+            if (vk::Result result = logical_device.resetFences(1u, &slot.fence); result != vk::Result::eSuccess) {
+                minilog::log_debug("screenshot: reset vk::Fence failed!");
+            }
+
+            slot.encoding = screenshot_worker.submit(
+                [pixels = slot.mapped, fileName = slot.file_name, image_width = width, image_height = height] () {
+                    // *.pfm / *.exr: the accumulated radiance as it is, streamed from the mapped slot
+                    if (hdr::is_hdr_file(fileName)) {
+                        if (hdr::write_hdr(fileName, pixels, image_width, image_height)) {
+                            minilog::log_debug("write {} successful!", fileName);
+                        } else {
+                            minilog::log_error("failed to write {}!", fileName);
+                        }
+                        return;
+                    }
+
+                    std::vector<unsigned char> image_data_uchar(image_width * image_height * 4uz);
+                    convert_to_rgba8(pixels, image_data_uchar.data(), image_data_uchar.size());
+
+                    int stride_in_bytes = image_width * 4; // bytes/row
+                    if (
+                        int result = stbi_write_png(
+                            fileName.c_str(), image_width, image_height, 4, image_data_uchar.data(), stride_in_bytes
+                        );
+                        result == 1
+                    ) {
+                        minilog::log_debug("write {} successful!", fileName);
+                    } else {
+                        minilog::log_error("failed to write {}!", fileName);
+                    }
                 }
+            );
+        }
+    }
+
+    // Waits for every requested screenshot to be written
+    void flush_screenshots() {
+        for (ScreenshotSlot& slot : screenshot_ring) {
+            if (!slot.copying) { continue; }
+            if (
+                vk::Result result = logical_device.waitForFences(
+                    1u, &slot.fence, vk::True, std::numeric_limits<std::uint64_t>::max()
+                );
+                result != vk::Result::eSuccess
+            ) {
+                minilog::log_debug("screenshot: wait for vk::Fence failed!");
             }
+        }
+        poll_screenshots();
+        for (ScreenshotSlot& slot : screenshot_ring) {
+            if (slot.encoding.valid()) { slot.encoding.get(); }
+        }
+    }
 
-            // We want to animate the particle system using the last frames time to get smooth,
-            //   frame-rate independent animation
-            double current_time = glfwGetTime();
-            last_frame_time = (current_time - last_time) * 1000.0;
-            last_time = current_time;
+    // --capture-every: output_image_<sample index>.png every capture_interval dispatches
+    void capture_interval_screenshot() {
+        if (options.capture_interval == 0u || ubo.sample_index % options.capture_interval != 0u) { return; }
+
+        const std::filesystem::path output { options.output };
+        std::filesystem::path file_name = output;
+        file_name.replace_filename(
+            output.stem().string() + "_" + std::to_string(ubo.sample_index) + output.extension().string()
+        );
+        request_screenshot(file_name.string());
+    }
+
+    // Polled once a frame, any movement makes the next dispatch reproject the accumulation
+    void update_camera(float deltaSeconds) {
+        auto pressed = [this] (int key) { return glfwGetKey(glfw_window, key) == GLFW_PRESS; };
+
+        glm::vec2 look { 0.0f };
+        if (pressed(GLFW_KEY_RIGHT)) { look.x += 1.0f; }
+        if (pressed(GLFW_KEY_LEFT)) { look.x -= 1.0f; }
+        if (pressed(GLFW_KEY_UP)) { look.y += 1.0f; }
+        if (pressed(GLFW_KEY_DOWN)) { look.y -= 1.0f; }
+
+        const glm::vec3 front = camera.front();
+        const glm::vec3 forward = glm::normalize(glm::vec3(front.x, 0.0f, front.z)); // in the XZ plane
+        const glm::vec3 right { -forward.z, 0.0f, forward.x };
+        const glm::vec3 up { 0.0f, 1.0f, 0.0f };
+        glm::vec3 move { 0.0f };
+        if (pressed(GLFW_KEY_W)) { move += forward; }
+        if (pressed(GLFW_KEY_S)) { move -= forward; }
+        if (pressed(GLFW_KEY_D)) { move += right; }
+        if (pressed(GLFW_KEY_A)) { move -= right; }
+        if (pressed(GLFW_KEY_E)) { move += up; }
+        if (pressed(GLFW_KEY_Q)) { move -= up; }
+
+        if (glm::dot(look, look) > std::numeric_limits<float>::epsilon()) {
+            look = CAMERA_LOOK_SPEED * deltaSeconds * glm::normalize(look);
+            camera.yaw = std::fmod(camera.yaw + look.x, glm::two_pi<float>());
+            camera.pitch = std::clamp(camera.pitch + look.y, -1.5f, 1.5f); // about +/- 85 degrees
+            camera_moved = true;
         }
-        logical_device.waitIdle();
+        if (glm::dot(move, move) > std::numeric_limits<float>::epsilon()) {
+            camera.position += CAMERA_MOVE_SPEED * deltaSeconds * glm::normalize(move);
+            camera_moved = true;
+        }
+    }
+
+    // Page Up / Page Down: double / halve the samples per dispatch, the pipelines of
+    //   every configuration stay cached so switching back and forth is free.
+    //   C: radiance cache off -> on -> shown alone, the accumulation starts over.
+    //   G: path guiding on / off, both are unbiased so the accumulation goes on.
+    //   I: every pixel -> checkerboard -> one pixel of every 2x2 cell traced per dispatch,
+    //   the pixels keep their own sample counts so the accumulation goes on.
+    void key_callback(int key, int action) {
+        if (action != GLFW_PRESS) { return; }
+
+        if (key == GLFW_KEY_F12) { // screenshot, copied and written without stalling the render loop
+            request_screenshot(options.output);
+            return;
+        }
+
+        if (key == GLFW_KEY_C) {
+            if (!radiance_cache_available()) {
+                minilog::log_warn("the radiance cache is not implemented by the wavefront passes");
+                return;
+            }
+            render_config.radiance_cache = (render_config.radiance_cache + 1u) % 3u;
+            ubo.sample_index = 0u;
+            minilog::log_info("radiance cache: {}", std::array { "off", "on", "shown" }[render_config.radiance_cache]);
+            return;
+        }
+
+        if (key == GLFW_KEY_G) {
+            if (!guiding_available()) {
+                minilog::log_warn("path guiding is not implemented by the wavefront passes");
+                return;
+            }
+            render_config.guiding = render_config.guiding != 0u ? 0u : 1u;
+            minilog::log_info("path guiding: {}", render_config.guiding != 0u ? "on" : "off");
+            return;
+        }
+
+        if (key == GLFW_KEY_I) {
+            if (wavefront_enabled() || render_config.adaptive != 0u) {
+                minilog::log_warn("interleaved rendering is not implemented by the wavefront passes nor with adaptive sampling");
+                return;
+            }
+            render_config.interleave = render_config.interleave >= 4u ? 1u : render_config.interleave * 2u;
+            minilog::log_info("pixels per traced pixel: {}", render_config.interleave);
+            return;
+        }
+
+        if (key == GLFW_KEY_PAGE_UP) {
+            render_config.spp = std::min(render_config.spp * 2u, 1024u);
+        } else if (key == GLFW_KEY_PAGE_DOWN) {
+            render_config.spp = std::max(render_config.spp / 2u, 1u);
+        } else {
+            return;
+        }
+        minilog::log_info("samples per dispatch: {}", render_config.spp);
     }
 
     void check_validation_layer_support() {
@@ -514,9 +1245,13 @@ private:
     void create_logical_device() {
         QueueFamilyIndex queue_family_index = find_queue_families(physical_device);
         std::set<std::uint32_t> unique_queue_families = {
-            queue_family_index.graphic_and_compute.value(),
-            queue_family_index.present.value()
+            queue_family_index.graphic_and_compute.value(), queue_family_index.compute()
         };
+        if (!options.headless) { unique_queue_families.insert(queue_family_index.present.value()); }
+        if (queue_family_index.async_compute.has_value()) {
+            buffer_queue_families = { queue_family_index.graphic_and_compute.value(), queue_family_index.compute() };
+            minilog::log_info("compute runs on the async compute queue family {}", queue_family_index.compute());
+        }
 
         float queue_priority { 1.0f }; // default
         std::vector<vk::DeviceQueueCreateInfo> device_queue_cis;
@@ -529,18 +1264,26 @@ private:
             device_queue_cis.push_back(device_queue_ci);
         }
 
+        // Software implementations such as lavapipe may lack anisotropic filtering, which only the window needs
         vk::PhysicalDeviceFeatures physical_device_features {
-            .samplerAnisotropy = vk::True
+            .samplerAnisotropy = options.headless ? vk::False : vk::True,
+            .pipelineStatisticsQuery = physical_device.getFeatures().pipelineStatisticsQuery // for gpu_profiler
         };
-        vk::DeviceCreateInfo device_ci {
+        const std::vector<const char*> device_extensions =
+            options.headless ? std::vector<const char*> {} : DEVICE_EXTENSIONS;
+        vk::PhysicalDeviceVulkan12Features vulkan12_features { // checked by is_physical_device_suitable()
             .pNext = nullptr,
+            .timelineSemaphore = vk::True
+        };
+        vk::DeviceCreateInfo device_ci {
+            .pNext = &vulkan12_features,
             .flags = {}, // flags is reserved for future use
             .queueCreateInfoCount = static_cast<std::uint32_t>(device_queue_cis.size()),
             .pQueueCreateInfos = device_queue_cis.data(),
             .enabledLayerCount = 0u, // deprecated
             .ppEnabledLayerNames = nullptr, // deprecated
-            .enabledExtensionCount = static_cast<std::uint32_t>(DEVICE_EXTENSIONS.size()),
-            .ppEnabledExtensionNames = DEVICE_EXTENSIONS.data(),
+            .enabledExtensionCount = static_cast<std::uint32_t>(device_extensions.size()),
+            .ppEnabledExtensionNames = device_extensions.data(),
             .pEnabledFeatures = &physical_device_features
         };
         if (ENABLE_VALIDATION_LAYER) {
@@ -556,8 +1299,8 @@ private:
         }
 
         logical_device.getQueue(queue_family_index.graphic_and_compute.value(), 0u, &graphic_queue);
-        logical_device.getQueue(queue_family_index.graphic_and_compute.value(), 0u, &compute_queue);
-        logical_device.getQueue(queue_family_index.present.value(), 0u, &present_queue);
+        logical_device.getQueue(queue_family_index.compute(), 0u, &compute_queue);
+        if (!options.headless) { logical_device.getQueue(queue_family_index.present.value(), 0u, &present_queue); }
     }
 
     void create_command_pool() {
@@ -573,6 +1316,15 @@ private:
         ) {
             minilog::log_fatal("Failed to create vk::CommandPool!");
         }
+
+        // The dispatches and the screenshot copies, submitted to compute_queue
+        command_pool_ci.queueFamilyIndex = queue_family_index.compute();
+        if (
+            vk::Result result = logical_device.createCommandPool(&command_pool_ci, nullptr, &compute_command_pool);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to create the compute vk::CommandPool!");
+        }
     }
 
     void allocate_render_command_buffers() {
@@ -595,7 +1347,7 @@ private:
         compute_command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
         vk::CommandBufferAllocateInfo allocInfo {
             .pNext = nullptr,
-            .commandPool = command_pool,
+            .commandPool = compute_command_pool,
             .level = vk::CommandBufferLevel::ePrimary,
             .commandBufferCount = static_cast<std::uint32_t>(compute_command_buffers.size())
         };
@@ -607,6 +1359,18 @@ private:
         }
     }
 
+    // A query range per compute command buffer, the compute shader invocations are counted
+    //   per dispatch when the device can
+    void create_gpu_profiler() {
+        gpu_profiler.emplace(
+            physical_device, logical_device, find_queue_families(physical_device).compute(),
+            profiler::ProfilerOptions {
+                .frames_in_flight = MAX_FRAMES_IN_FLIGHT,
+                .pipeline_statistics = vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations
+            }
+        );
+    }
+
     void create_swapchain() {
         SwapChainSupportDetail swapchain_support_detail = query_swapchain_support_detail(physical_device);
         vk::SurfaceFormatKHR surface_format = choose_swapchain_surface_format(swapchain_support_detail.surface_formats);
@@ -691,97 +1455,51 @@ private:
         }
     }
 
-    void load_obj_model() {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn { ""s };
-        std::string err { ""s };
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, "./resource/cornell_box.obj", "./resource/cornell_box.mtl")) {
-            minilog::log_fatal("{}", warn + err);
-        }
-
-        std::vector<std::uint32_t> flat_indices;
-        std::unordered_map<Vertex, std::uint32_t> unique_vertices {};
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                Vertex vertex {
-                    .position = {
-                        attrib.vertices[static_cast<std::size_t>(3 * index.vertex_index + 0)],
-                        attrib.vertices[static_cast<std::size_t>(3 * index.vertex_index + 1)],
-                        attrib.vertices[static_cast<std::size_t>(3 * index.vertex_index + 2)]
-                    },
-                    .color = { 1.0f, 1.0f, 1.0f },
-                    .uv = {
-                        // attrib.texcoords[static_cast<std::size_t>(2 * index.texcoord_index)],
-                        // 1.0f - attrib.texcoords[static_cast<std::size_t>(2 * index.texcoord_index + 1)]
-                        0.0f, 0.0f // TODO: use texture
-                    }
-                };
-                if (unique_vertices.count(vertex) == 0) {
-                    unique_vertices[vertex] = static_cast<std::uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-                }
-                flat_indices.push_back(unique_vertices[vertex]);
-            }
-        }
+    void create_storage_buffers() {
+        // storage_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+        // storage_device_memorys.resize(MAX_FRAMES_IN_FLIGHT);
+        storage_buffers.resize(STORAGE_BUFFER_COUNT);
+        storage_device_memorys.resize(STORAGE_BUFFER_COUNT);
 
-        indices.resize(flat_indices.size() / 3uz);
-        for (std::size_t i { 0uz }; i < indices.size(); ++i) {
-            indices[i] = Triangle {
-                flat_indices[3uz * i + 0uz],
-                flat_indices[3uz * i + 1uz],
-                flat_indices[3uz * i + 2uz]
-            };
-        }
-    }
-
-    void create_storage_buffers() {
-        // storage_buffers.resize(MAX_FRAMES_IN_FLIGHT);
-        // storage_device_memorys.resize(MAX_FRAMES_IN_FLIGHT);
-        storage_buffers.resize(4uz);
-        storage_device_memorys.resize(4uz);
-
-        create_vertex_buffer();
+        create_triangle_buffers();
         create_index_buffer();
         create_output_buffer();
-        create_seed_buffer();
+        create_bvh_buffers();
+        create_instance_buffers();
+        create_wavefront_buffers();
+        create_ray_counter_buffer();
+        create_adaptive_buffers();
+        create_denoise_buffers();
+        create_history_buffers();
+        create_material_buffers();
+        create_restir_buffers();
+        create_radiance_cache_buffer();
+        create_guiding_buffer();
+        create_visibility_buffer();
+        create_upscale_buffers();
     }
 
-    void create_vertex_buffer() {
-        vk::Buffer staging_buffer;
-        vk::DeviceMemory staging_device_memory;
-        vk::DeviceSize vertex_device_size = sizeof(vertices[0uz]) * vertices.size();
-        create_buffer(
-            vertex_device_size,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            vk::MemoryPropertyFlagBits::eHostVisible
-            | vk::MemoryPropertyFlagBits::eHostCoherent,
-            staging_buffer,
-            staging_device_memory
+    // The packed triangles the intersection tests read, and the shading attributes
+    //   of the vertices the Triangle indices point into
+    void create_triangle_buffers() {
+        create_device_local_storage_buffer(
+            model.packed_triangles.data(),
+            sizeof(model.packed_triangles[0uz]) * model.packed_triangles.size(),
+            storage_buffers[PACKED_TRIANGLE_BUFFER],
+            storage_device_memorys[PACKED_TRIANGLE_BUFFER]
         );
-        void* data = logical_device.mapMemory(staging_device_memory, 0u, vertex_device_size, {});
-        memcpy(data, vertices.data(), static_cast<std::size_t>(vertex_device_size));
-        logical_device.unmapMemory(staging_device_memory);
-
-        create_buffer(
-            vertex_device_size,
-            vk::BufferUsageFlagBits::eTransferDst
-            | vk::BufferUsageFlagBits::eStorageBuffer,
-            vk::MemoryPropertyFlagBits::eDeviceLocal,
-            storage_buffers[0uz],
-            storage_device_memorys[0uz]
+        create_device_local_storage_buffer(
+            model.shading_vertices.data(),
+            sizeof(model.shading_vertices[0uz]) * model.shading_vertices.size(),
+            storage_buffers[SHADING_VERTEX_BUFFER],
+            storage_device_memorys[SHADING_VERTEX_BUFFER]
         );
-        copy_buffer(staging_buffer, storage_buffers[0uz], vertex_device_size);
-
-        logical_device.destroy(staging_buffer);
-        logical_device.freeMemory(staging_device_memory);
     }
 
     void create_index_buffer() {
         vk::Buffer staging_buffer;
         vk::DeviceMemory staging_device_memory;
-        vk::DeviceSize index_device_size = sizeof(indices[0uz]) * indices.size();
+        vk::DeviceSize index_device_size = sizeof(model.indices[0uz]) * model.indices.size();
         create_buffer(
             index_device_size,
             vk::BufferUsageFlagBits::eTransferSrc,
@@ -791,7 +1509,7 @@ private:
             staging_device_memory
         );
         void* data = logical_device.mapMemory(staging_device_memory, 0u, index_device_size, {});
-        memcpy(data, indices.data(), static_cast<std::size_t>(index_device_size));
+        memcpy(data, model.indices.data(), static_cast<std::size_t>(index_device_size));
         logical_device.unmapMemory(staging_device_memory);
 
         create_buffer(
@@ -799,10 +1517,10 @@ private:
             vk::BufferUsageFlagBits::eTransferDst
             | vk::BufferUsageFlagBits::eStorageBuffer,
             vk::MemoryPropertyFlagBits::eDeviceLocal,
-            storage_buffers[1uz],
-            storage_device_memorys[1uz]
+            storage_buffers[INDEX_BUFFER],
+            storage_device_memorys[INDEX_BUFFER]
         );
-        copy_buffer(staging_buffer, storage_buffers[1uz], index_device_size);
+        copy_buffer(staging_buffer, storage_buffers[INDEX_BUFFER], index_device_size);
 
         logical_device.destroy(staging_buffer);
         logical_device.freeMemory(staging_device_memory);
@@ -832,44 +1550,360 @@ private:
             | vk::BufferUsageFlagBits::eTransferDst
             | vk::BufferUsageFlagBits::eStorageBuffer,
             vk::MemoryPropertyFlagBits::eDeviceLocal,
-            storage_buffers[2uz],
-            storage_device_memorys[2uz]
+            storage_buffers[PIXEL_COLOR_BUFFER],
+            storage_device_memorys[PIXEL_COLOR_BUFFER]
         );
-        copy_buffer(staging_buffer, storage_buffers[2uz], device_size);
+        copy_buffer(staging_buffer, storage_buffers[PIXEL_COLOR_BUFFER], device_size);
 
         logical_device.destroy(staging_buffer);
         logical_device.freeMemory(staging_device_memory);
     }
 
-    void create_seed_buffer() {
-        vk::DeviceSize device_size = width * height * 4u;
+
+    // What the render pass reads, see DISPLAY_COPY_COUNT. At the resolution of the window.
+    void create_display_copies() {
+        for (std::size_t i { 0uz }; i < DISPLAY_COPY_COUNT; ++i) {
+            create_buffer(
+                vk::DeviceSize { display_width } * display_height * 4u * 4u,
+                vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                display_copies[i],
+                display_copy_memorys[i]
+            );
+        }
+    }
+
+    void create_bvh_buffers() {
+        create_device_local_storage_buffer(
+            model.bvh_nodes.data(),
+            sizeof(model.bvh_nodes[0uz]) * model.bvh_nodes.size(),
+            storage_buffers[BVH_NODE_BUFFER],
+            storage_device_memorys[BVH_NODE_BUFFER]
+        );
+        create_device_local_storage_buffer(
+            model.bvh_primitives.data(),
+            sizeof(model.bvh_primitives[0uz]) * model.bvh_primitives.size(),
+            storage_buffers[BVH_PRIMITIVE_BUFFER],
+            storage_device_memorys[BVH_PRIMITIVE_BUFFER]
+        );
+    }
+
+    // The instances and the top-level BVH over them
+    void create_instance_buffers() {
+        create_device_local_storage_buffer(
+            model.instances.data(),
+            sizeof(model.instances[0uz]) * model.instances.size(),
+            storage_buffers[INSTANCE_BUFFER],
+            storage_device_memorys[INSTANCE_BUFFER]
+        );
+        create_device_local_storage_buffer(
+            model.tlas_nodes.data(),
+            sizeof(model.tlas_nodes[0uz]) * model.tlas_nodes.size(),
+            storage_buffers[TLAS_NODE_BUFFER],
+            storage_device_memorys[TLAS_NODE_BUFFER]
+        );
+        create_device_local_storage_buffer(
+            model.tlas_instances.data(),
+            sizeof(model.tlas_instances[0uz]) * model.tlas_instances.size(),
+            storage_buffers[TLAS_INSTANCE_BUFFER],
+            storage_device_memorys[TLAS_INSTANCE_BUFFER]
+        );
+    }
+
+    // The materials, and an alias table over the emissive triangles weighted by
+    //   area * luminance(Ke) for next event estimation, see sample_light() of path_tracing.glsl
+    void create_material_buffers() {
+        create_device_local_storage_buffer(
+            model.materials.data(),
+            sizeof(model.materials[0uz]) * model.materials.size(),
+            storage_buffers[MATERIAL_BUFFER],
+            storage_device_memorys[MATERIAL_BUFFER]
+        );
+
+        const scene::LightTable light_table = scene::build_light_table(model);
+        const std::size_t alias_size = sizeof(light_table.aliases[0uz]) * light_table.aliases.size();
+        std::vector<char> data(sizeof(light_table.header) + alias_size);
+        memcpy(data.data(), &light_table.header, sizeof(light_table.header));
+        memcpy(data.data() + sizeof(light_table.header), light_table.aliases.data(), alias_size);
+        create_device_local_storage_buffer(
+            data.data(),
+            data.size(),
+            storage_buffers[LIGHT_BUFFER],
+            storage_device_memorys[LIGHT_BUFFER]
+        );
+    }
+
+    // Reservoirs and primary hits of the ReSTIR passes, kept from one dispatch to the next
+    //   for the temporal reuse. A pixel large without them.
+    void create_restir_buffers() {
+        const vk::DeviceSize pixel_count = render_config.restir != 0u ? vk::DeviceSize { width } * height : 1u;
+        create_buffer(
+            3u * pixel_count * RESTIR_RESERVOIR_SIZE, // this dispatch, final of even / odd dispatches
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[RESERVOIR_BUFFER],
+            storage_device_memorys[RESERVOIR_BUFFER]
+        );
+        create_buffer(
+            2u * pixel_count * RESTIR_SURFACE_SIZE, // even / odd dispatches
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[RESTIR_SURFACE_BUFFER],
+            storage_device_memorys[RESTIR_SURFACE_BUFFER]
+        );
+    }
+
+    bool radiance_cache_available() const {
+        return !options.wavefront && (render_config.radiance_cache != 0u || !options.headless);
+    }
+
+    // The cells of the radiance cache, all free to begin with. They are placed in world space,
+    //   so they stay valid when the camera moves or the accumulation starts over. A cell large
+    //   where the cache cannot be turned on.
+    void create_radiance_cache_buffer() {
+        const vk::DeviceSize cell_count = radiance_cache_available() ? RADIANCE_CACHE_CELL_COUNT : 1u;
+        create_buffer(
+            cell_count * RADIANCE_CACHE_CELL_SIZE,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[RADIANCE_CACHE_BUFFER],
+            storage_device_memorys[RADIANCE_CACHE_BUFFER]
+        );
+        vk::CommandBuffer command_buffer = begin_single_time_commands();
+        command_buffer.fillBuffer(storage_buffers[RADIANCE_CACHE_BUFFER], 0u, vk::WholeSize, 0u);
+        end_single_time_commands(command_buffer);
+    }
+
+    bool guiding_available() const {
+        return !options.wavefront && (render_config.guiding != 0u || !options.headless);
+    }
+
+    // The guide of every cell, empty to begin with: the megakernel samples the cosine lobe
+    //   until a cell has learned something. A cell large where guiding cannot be turned on.
+    void create_guiding_buffer() {
+        const vk::DeviceSize cell_count = guiding_available() ? GUIDING_CELL_COUNT : 1u;
+        create_buffer(
+            cell_count * GUIDING_CELL_SIZE,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[GUIDING_BUFFER],
+            storage_device_memorys[GUIDING_BUFFER]
+        );
+        vk::CommandBuffer command_buffer = begin_single_time_commands();
+        command_buffer.fillBuffer(storage_buffers[GUIDING_BUFFER], 0u, vk::WholeSize, 0u);
+        end_single_time_commands(command_buffer);
+    }
+
+    // What the megakernel reads the primary hits from, copied from the visibility image.
+    //   A pixel large without RenderConfig::raster_primary.
+    void create_visibility_buffer() {
+        const vk::DeviceSize pixel_count = render_config.raster_primary != 0u ? vk::DeviceSize { width } * height : 1u;
+        create_buffer(
+            pixel_count * VISIBILITY_PIXEL_SIZE,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[VISIBILITY_BUFFER],
+            storage_device_memorys[VISIBILITY_BUFFER]
+        );
+    }
+
+    bool upscaling() const { return width != display_width || height != display_height; }
+
+    // The edge-adaptive upscale and the sharpened image at the resolution of the window.
+    //   A pixel large without a render scale.
+    void create_upscale_buffers() {
+        const vk::DeviceSize pixel_count = upscaling() ? vk::DeviceSize { display_width } * display_height : 1u;
+        for (std::size_t i { UPSCALED_COLOR_BUFFER }; i <= SHARPENED_COLOR_BUFFER; ++i) {
+            create_buffer(
+                pixel_count * 4u * sizeof(float),
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                storage_buffers[i],
+                storage_device_memorys[i]
+            );
+        }
+    }
+
+    bool wavefront_enabled() const { return options.wavefront || options.benchmark_samples > 0u; }
+
+    // Written by the wavefront passes only, nothing is uploaded. Without them the buffers
+    //   only exist to keep their bindings of the shared descriptor set valid.
+    void create_wavefront_buffers() {
+        const vk::DeviceSize path_count = wavefront_enabled() ? vk::DeviceSize { width } * height : 1u;
+        const std::array<vk::DeviceSize, 5uz> sizes = {
+            path_count * WAVEFRONT_PATH_STATE_SIZE,                 // path states
+            path_count * WAVEFRONT_PATH_HIT_SIZE,                   // path hits
+            WAVEFRONT_QUEUE_COUNT * WAVEFRONT_QUEUE_SIZE,           // queues
+            2u * path_count * sizeof(std::uint32_t),                // ray queues
+            path_count * WAVEFRONT_SHADOW_RAY_SIZE                  // shadow rays
+        };
+        for (std::size_t i { 0uz }; i < sizes.size(); ++i) {
+            vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer;
+            if (PATH_STATE_BUFFER + i == WAVEFRONT_QUEUE_BUFFER) { usage |= vk::BufferUsageFlagBits::eIndirectBuffer; }
+            create_buffer(
+                sizes[i],
+                usage,
+                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                storage_buffers[PATH_STATE_BUFFER + i],
+                storage_device_memorys[PATH_STATE_BUFFER + i]
+            );
+        }
+    }
+
+    // 64-bit count of the rays traced since the last reset_ray_counter(), only
+    //   written by pipelines specialized with count_rays
+    void create_ray_counter_buffer() {
+        create_buffer(
+            2u * sizeof(std::uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible
+            | vk::MemoryPropertyFlagBits::eHostCoherent,
+            storage_buffers[RAY_COUNTER_BUFFER],
+            storage_device_memorys[RAY_COUNTER_BUFFER]
+        );
+        reset_ray_counter();
+    }
+
+    void reset_ray_counter() {
+        void* data = logical_device.mapMemory(storage_device_memorys[RAY_COUNTER_BUFFER], 0u, 2u * sizeof(std::uint32_t), {});
+        memset(data, 0, 2uz * sizeof(std::uint32_t));
+        logical_device.unmapMemory(storage_device_memorys[RAY_COUNTER_BUFFER]);
+    }
+
+    std::uint64_t read_ray_counter() {
+        std::array<std::uint32_t, 2uz> counter { 0u, 0u }; // low, high
+        void* data = logical_device.mapMemory(storage_device_memorys[RAY_COUNTER_BUFFER], 0u, sizeof(counter), {});
+        memcpy(counter.data(), data, sizeof(counter));
+        logical_device.unmapMemory(storage_device_memorys[RAY_COUNTER_BUFFER]);
+
+        return (static_cast<std::uint64_t>(counter[1uz]) << 32u) | counter[0uz];
+    }
+
+    std::uint32_t tile_count() const {
+        return ((width + ADAPTIVE_TILE_SIZE - 1u) / ADAPTIVE_TILE_SIZE) * ((height + ADAPTIVE_TILE_SIZE - 1u) / ADAPTIVE_TILE_SIZE);
+    }
+
+    // Per-pixel sample count and luminance variance, the active tile queue (host-visible
+    //   for the headless stopping criterion) and the indices of the active tiles
+    void create_adaptive_buffers() {
+        create_buffer(
+            vk::DeviceSize { width } * height * PIXEL_STATS_SIZE,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[PIXEL_STATS_BUFFER],
+            storage_device_memorys[PIXEL_STATS_BUFFER]
+        );
+        create_buffer(
+            WAVEFRONT_QUEUE_SIZE,
+            vk::BufferUsageFlagBits::eStorageBuffer
+            | vk::BufferUsageFlagBits::eIndirectBuffer
+            | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eHostVisible
+            | vk::MemoryPropertyFlagBits::eHostCoherent,
+            storage_buffers[TILE_QUEUE_BUFFER],
+            storage_device_memorys[TILE_QUEUE_BUFFER]
+        );
+        create_buffer(
+            vk::DeviceSize { tile_count() } * sizeof(std::uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[ACTIVE_TILE_BUFFER],
+            storage_device_memorys[ACTIVE_TILE_BUFFER]
+        );
+    }
+
+    bool denoise_each_dispatch() const {
+        return options.denoise_iterations > 0u && !options.headless && options.benchmark_samples == 0u;
+    }
+
+    // Output of the last a-trous iteration
+    vk::Buffer denoised_buffer() const { return storage_buffers[DENOISE_BUFFER_0 + (options.denoise_iterations + 1u) % 2u]; }
+
+    // What the screenshots copy, and the fragment shader presents without a render scale
+    vk::Buffer display_buffer() const { return denoise_each_dispatch() ? denoised_buffer() : storage_buffers[PIXEL_COLOR_BUFFER]; }
+
+    // What the fragment shader presents, at the resolution of the window
+    vk::Buffer presented_buffer() const { return upscaling() ? storage_buffers[SHARPENED_COLOR_BUFFER] : display_buffer(); }
+
+    // First-hit AOVs, written by every kernel, and the ping-pong buffers of the a-trous
+    //   iterations, only as large as a pixel without the denoiser
+    void create_denoise_buffers() {
+        const vk::DeviceSize pixel_count = vk::DeviceSize { width } * height;
+        create_buffer(
+            pixel_count * sizeof(denoiser::PixelAov),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            storage_buffers[PIXEL_AOV_BUFFER],
+            storage_device_memorys[PIXEL_AOV_BUFFER]
+        );
+        for (std::size_t i { DENOISE_BUFFER_0 }; i <= DENOISE_BUFFER_1; ++i) {
+            create_buffer(
+                (options.denoise_iterations > 0u ? pixel_count : 1u) * 4u * sizeof(float),
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                storage_buffers[i],
+                storage_device_memorys[i]
+            );
+        }
+    }
+
+    // What reproject.comp reads the previous view from: pixel_colors, pixel_stats and
+    //   pixel_aovs, copied before it runs. A pixel large headless, where the camera stays.
+    void create_history_buffers() {
+        const vk::DeviceSize pixel_count = options.headless ? 1u : vk::DeviceSize { width } * height;
+        const std::array<vk::DeviceSize, 3uz> pixel_sizes = {
+            4u * sizeof(float), PIXEL_STATS_SIZE, sizeof(denoiser::PixelAov)
+        };
+        for (std::size_t i { 0uz }; i < pixel_sizes.size(); ++i) {
+            create_buffer(
+                pixel_count * pixel_sizes[i],
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                storage_buffers[HISTORY_COLOR_BUFFER + i],
+                storage_device_memorys[HISTORY_COLOR_BUFFER + i]
+            );
+        }
+    }
+
+    // Tiles the last finished tile pass found active
+    std::uint32_t read_active_tile_count() {
+        std::array<std::uint32_t, 4uz> queue {}; // dispatch x, y, z, count
+        void* data = logical_device.mapMemory(storage_device_memorys[TILE_QUEUE_BUFFER], 0u, sizeof(queue), {});
+        memcpy(queue.data(), data, sizeof(queue));
+        logical_device.unmapMemory(storage_device_memorys[TILE_QUEUE_BUFFER]);
+
+        return queue[3uz];
+    }
+
+    void create_device_local_storage_buffer(
+        const void* hostData,
+        vk::DeviceSize size,
+        vk::Buffer& buffer,
+        vk::DeviceMemory& bufferMemory
+    ) {
         vk::Buffer staging_buffer;
         vk::DeviceMemory staging_device_memory;
         create_buffer(
-            device_size,
+            size,
             vk::BufferUsageFlagBits::eTransferSrc,
             vk::MemoryPropertyFlagBits::eHostVisible
             | vk::MemoryPropertyFlagBits::eHostCoherent,
             staging_buffer,
             staging_device_memory
         );
-
-        std::vector<std::uint32_t> test(width * height, 0u);
-        void* data = logical_device.mapMemory(staging_device_memory, 0u, device_size);
-        memcpy(data, test.data(), static_cast<std::size_t>(device_size));
+        void* data = logical_device.mapMemory(staging_device_memory, 0u, size, {});
+        memcpy(data, hostData, static_cast<std::size_t>(size));
         logical_device.unmapMemory(staging_device_memory);
 
         create_buffer(
-            device_size,
+            size,
             vk::BufferUsageFlagBits::eTransferDst
             | vk::BufferUsageFlagBits::eStorageBuffer,
-            vk::MemoryPropertyFlagBits::eDeviceLocal
-            | vk::MemoryPropertyFlagBits::eHostVisible
-            | vk::MemoryPropertyFlagBits::eHostCoherent,
-            storage_buffers[3uz],
-            storage_device_memorys[3uz]
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            buffer,
+            bufferMemory
         );
-        copy_buffer(staging_buffer, storage_buffers[3uz], device_size);
+        copy_buffer(staging_buffer, buffer, size);
 
         logical_device.destroy(staging_buffer);
         logical_device.freeMemory(staging_device_memory);
@@ -881,39 +1915,59 @@ private:
                 .binding = 0u,
                 .descriptorType = vk::DescriptorType::eUniformBuffer,
                 .descriptorCount = 1u,
-                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute
+                    | vk::ShaderStageFlagBits::eVertex,
                 .pImmutableSamplers = nullptr
             },
-            vk::DescriptorSetLayoutBinding { // vertex buffer
-                .binding = 1u,
+            vk::DescriptorSetLayoutBinding { // packed triangles
+                .binding = storage_buffer_binding(PACKED_TRIANGLE_BUFFER),
                 .descriptorType = vk::DescriptorType::eStorageBuffer,
                 .descriptorCount = 1u,
-                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute
+                    | vk::ShaderStageFlagBits::eVertex,
                 .pImmutableSamplers = nullptr
             },
             vk::DescriptorSetLayoutBinding { // index buffer
-                .binding = 2u,
+                .binding = storage_buffer_binding(INDEX_BUFFER),
                 .descriptorType = vk::DescriptorType::eStorageBuffer,
                 .descriptorCount = 1u,
                 .stageFlags = vk::ShaderStageFlagBits::eCompute,
                 .pImmutableSamplers = nullptr
             },
             vk::DescriptorSetLayoutBinding { // pixel colors
-                .binding = 3u,
+                .binding = storage_buffer_binding(PIXEL_COLOR_BUFFER),
                 .descriptorType = vk::DescriptorType::eStorageBuffer,
                 .descriptorCount = 1u,
                 .stageFlags = vk::ShaderStageFlagBits::eCompute
                     | vk::ShaderStageFlagBits::eFragment,
                 .pImmutableSamplers = nullptr
             },
-            vk::DescriptorSetLayoutBinding { // seed buffer
-                .binding = 4u,
+            vk::DescriptorSetLayoutBinding { // bvh nodes
+                .binding = storage_buffer_binding(BVH_NODE_BUFFER),
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 1u,
+                .stageFlags = vk::ShaderStageFlagBits::eCompute,
+                .pImmutableSamplers = nullptr
+            },
+            vk::DescriptorSetLayoutBinding { // bvh primitives
+                .binding = storage_buffer_binding(BVH_PRIMITIVE_BUFFER),
                 .descriptorType = vk::DescriptorType::eStorageBuffer,
                 .descriptorCount = 1u,
                 .stageFlags = vk::ShaderStageFlagBits::eCompute,
                 .pImmutableSamplers = nullptr
             }
         };
+        for (std::size_t slot { PATH_STATE_BUFFER }; slot < STORAGE_BUFFER_COUNT; ++slot) { // wavefront, ray counter, adaptive sampling, denoiser, history, lights, ReSTIR, shading vertices, instances, radiance cache, guiding, visibility, upscaler
+            descriptor_set_layout_bindings.push_back(vk::DescriptorSetLayoutBinding {
+                .binding = storage_buffer_binding(slot),
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .descriptorCount = 1u,
+                .stageFlags = slot == INSTANCE_BUFFER // visibility.vert places the meshes with them
+                    ? vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex
+                    : vk::ShaderStageFlagBits::eCompute,
+                .pImmutableSamplers = nullptr
+            });
+        }
         vk::DescriptorSetLayoutCreateInfo descriptor_set_layout_ci {
             .pNext = nullptr,
             .flags = {},
@@ -931,26 +1985,22 @@ private:
     }
 
     void create_compute_pipeline() {
-        std::vector<char> comp_code = read_shader_file("./src/7_path_tracing/shaders/7_path_tracing_comp.spv");
-        vk::ShaderModule comp_shader_module = create_shader_module(comp_code);
-        vk::PipelineShaderStageCreateInfo comp_pipeline_shader_stage_ci {
-            .pNext = nullptr,
-            .flags = {},
-            .stage = vk::ShaderStageFlagBits::eCompute,
-            .module = comp_shader_module,
-            .pName = "main",
-            .pSpecializationInfo = nullptr
-        };
-
         std::vector<vk::DescriptorSetLayout>
         descriptor_set_layouts = { compute_descriptor_set_layout };
+        vk::PushConstantRange push_constant_range { // WavefrontConstants, DenoiseConstants or UpscaleConstants
+            .stageFlags = vk::ShaderStageFlagBits::eCompute,
+            .offset = 0u,
+            .size = static_cast<std::uint32_t>(
+                std::max({ sizeof(WavefrontConstants), sizeof(DenoiseConstants), sizeof(UpscaleConstants) })
+            )
+        };
         vk::PipelineLayoutCreateInfo pipeline_layout_ci {
             .pNext = nullptr,
             .flags = {},
             .setLayoutCount = static_cast<std::uint32_t>(descriptor_set_layouts.size()),
             .pSetLayouts = descriptor_set_layouts.data(),
-            .pushConstantRangeCount = 0u,
-            .pPushConstantRanges = nullptr
+            .pushConstantRangeCount = 1u,
+            .pPushConstantRanges = &push_constant_range
         };
         if (
             vk::Result result = logical_device.createPipelineLayout(
@@ -961,6 +2011,129 @@ private:
             minilog::log_fatal("Failed to create vk::PipelineLayout!");
         }
 
+        get_compute_pipelines(render_config);
+    }
+
+    // Builds the pipelines of a configuration the first time it is used. The wavefront
+    //   passes share the descriptor set and the pipeline layout of the megakernel.
+    const ComputePipelines& get_compute_pipelines(const RenderConfig& config) {
+        if (auto it = compute_pipelines.find(config); it != compute_pipelines.end()) { return it->second; }
+
+        ComputePipelines pipelines {};
+        pipelines.megakernel = create_compute_shader_pipeline(
+            "./src/7_path_tracing/shaders/7_path_tracing_comp.spv", config
+        );
+        if (wavefront_enabled()) {
+            for (std::size_t i { 0uz }; i < WAVEFRONT_PASS_COUNT; ++i) {
+                pipelines.wavefront[i] = create_compute_shader_pipeline(WAVEFRONT_SHADER_FILES[i], config);
+            }
+        }
+        if (config.adaptive != 0u) {
+            pipelines.adaptive_tiles = create_compute_shader_pipeline(ADAPTIVE_TILES_SHADER_FILE, config);
+        }
+        if (options.denoise_iterations > 0u) {
+            pipelines.denoise = create_compute_shader_pipeline(DENOISE_SHADER_FILE, config);
+        }
+        if (!options.headless) {
+            pipelines.reproject = create_compute_shader_pipeline(REPROJECT_SHADER_FILE, config);
+        }
+        if (config.restir != 0u) {
+            for (std::size_t i { 0uz }; i < RESTIR_PASS_COUNT; ++i) {
+                pipelines.restir[i] = create_compute_shader_pipeline(RESTIR_SHADER_FILES[i], config);
+            }
+        }
+        if (config.radiance_cache != 0u) {
+            pipelines.radiance_cache = create_compute_shader_pipeline(RADIANCE_CACHE_SHADER_FILE, config);
+        }
+        if (config.guiding != 0u) {
+            pipelines.guiding = create_compute_shader_pipeline(GUIDING_SHADER_FILE, config);
+        }
+        if (config.interleave > 1u) {
+            pipelines.interleave = create_compute_shader_pipeline(INTERLEAVE_SHADER_FILE, config);
+        }
+        if (upscaling()) {
+            for (std::size_t i { 0uz }; i < UPSCALE_PASS_COUNT; ++i) {
+                pipelines.upscale[i] = create_compute_shader_pipeline(UPSCALE_SHADER_FILES[i], config);
+            }
+        }
+        minilog::log_debug(
+            "created the compute pipelines for {}x{}, {} spp, depth {}",
+            config.width, config.height, config.spp, config.depth
+        );
+
+        return compute_pipelines.emplace(config, pipelines).first->second;
+    }
+
+    void create_pipeline_cache() {
+        std::vector<char> cache_data;
+        if (std::ifstream file(PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary); file.is_open()) {
+            cache_data.resize(static_cast<std::size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(cache_data.data(), static_cast<std::streamsize>(cache_data.size()));
+        }
+
+        // The driver ignores data written by another device or driver version
+        vk::PipelineCacheCreateInfo pipeline_cache_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .initialDataSize = cache_data.size(),
+            .pInitialData = cache_data.empty() ? nullptr : cache_data.data()
+        };
+        if (
+            vk::Result result = logical_device.createPipelineCache(&pipeline_cache_ci, nullptr, &pipeline_cache);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to create vk::PipelineCache!");
+        }
+    }
+
+    void save_pipeline_cache() {
+        std::size_t data_size { 0uz };
+        if (logical_device.getPipelineCacheData(pipeline_cache, &data_size, nullptr) != vk::Result::eSuccess) { return; }
+        std::vector<char> cache_data(data_size);
+        if (logical_device.getPipelineCacheData(pipeline_cache, &data_size, cache_data.data()) != vk::Result::eSuccess) {
+            return;
+        }
+
+        std::ofstream file(PIPELINE_CACHE_FILE, std::ios::binary);
+        file.write(cache_data.data(), static_cast<std::streamsize>(data_size));
+    }
+
+    vk::Pipeline create_compute_shader_pipeline(const std::string& fileName, const RenderConfig& config) {
+        std::array<vk::SpecializationMapEntry, 14uz> specialization_map_entries = {
+            vk::SpecializationMapEntry { .constantID = 0u, .offset = offsetof(RenderConfig, width), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 1u, .offset = offsetof(RenderConfig, height), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 2u, .offset = offsetof(RenderConfig, spp), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 3u, .offset = offsetof(RenderConfig, depth), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 4u, .offset = offsetof(RenderConfig, count_rays), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 5u, .offset = offsetof(RenderConfig, adaptive), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 6u, .offset = offsetof(RenderConfig, adaptive_threshold), .size = sizeof(float) },
+            vk::SpecializationMapEntry { .constantID = 7u, .offset = offsetof(RenderConfig, restir), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 8u, .offset = offsetof(RenderConfig, radiance_cache), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 9u, .offset = offsetof(RenderConfig, guiding), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 10u, .offset = offsetof(RenderConfig, raster_primary), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 11u, .offset = offsetof(RenderConfig, interleave), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 12u, .offset = offsetof(RenderConfig, output_width), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 13u, .offset = offsetof(RenderConfig, output_height), .size = sizeof(std::uint32_t) }
+        };
+        vk::SpecializationInfo specialization_info {
+            .mapEntryCount = static_cast<std::uint32_t>(specialization_map_entries.size()),
+            .pMapEntries = specialization_map_entries.data(),
+            .dataSize = sizeof(RenderConfig),
+            .pData = &config
+        };
+
+        std::vector<char> comp_code = read_shader_file(fileName);
+        vk::ShaderModule comp_shader_module = create_shader_module(comp_code);
+        vk::PipelineShaderStageCreateInfo comp_pipeline_shader_stage_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .stage = vk::ShaderStageFlagBits::eCompute,
+            .module = comp_shader_module,
+            .pName = "main",
+            .pSpecializationInfo = &specialization_info
+        };
+
         vk::ComputePipelineCreateInfo compute_pipeline_ci {
             .pNext = nullptr,
             .flags = {},
@@ -969,16 +2142,19 @@ private:
             .basePipelineHandle = nullptr,
             .basePipelineIndex = 0
         };
+        vk::Pipeline pipeline;
         if (
             vk::Result result = logical_device.createComputePipelines(
-                nullptr, 1u, &compute_pipeline_ci, nullptr, &compute_pipeline
+                pipeline_cache, 1u, &compute_pipeline_ci, nullptr, &pipeline
             );
             result != vk::Result::eSuccess
         ) {
-            minilog::log_fatal("Failed to create compute pipeline!");
+            minilog::log_fatal("Failed to create compute pipeline from {}!", fileName);
         }
 
         logical_device.destroyShaderModule(comp_shader_module, nullptr);
+
+        return pipeline;
     }
 
     void create_render_pass() {
@@ -1080,13 +2256,23 @@ private:
             .pName = "main",
             .pSpecializationInfo = nullptr
         };
+        std::array<vk::SpecializationMapEntry, 2uz> specialization_map_entries = {
+            vk::SpecializationMapEntry { .constantID = 12u, .offset = offsetof(RenderConfig, output_width), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 13u, .offset = offsetof(RenderConfig, output_height), .size = sizeof(std::uint32_t) }
+        };
+        vk::SpecializationInfo specialization_info { // resolution of the display copies
+            .mapEntryCount = static_cast<std::uint32_t>(specialization_map_entries.size()),
+            .pMapEntries = specialization_map_entries.data(),
+            .dataSize = sizeof(RenderConfig),
+            .pData = &render_config
+        };
         vk::PipelineShaderStageCreateInfo frag_pipeline_shader_stage_ci {
             .pNext = nullptr,
             .flags = {},
             .stage = vk::ShaderStageFlagBits::eFragment,
             .module = frag_shader_module,
             .pName = "main",
-            .pSpecializationInfo = nullptr
+            .pSpecializationInfo = &specialization_info
         };
         std::array<vk::PipelineShaderStageCreateInfo, 2uz> pipeline_shader_stage_cis = {
             vert_pipeline_shader_stage_ci,
@@ -1195,25 +2381,353 @@ private:
             .dynamicStateCount = static_cast<std::uint32_t>(dynamic_states.size()),
             .pDynamicStates = dynamic_states.data()
         };
-
-        std::vector<vk::DescriptorSetLayout>
-        descriptor_set_layouts = { render_descriptor_set_layout };
-        vk::PipelineLayoutCreateInfo pipeline_layout_ci {
+
+        std::vector<vk::DescriptorSetLayout>
+        descriptor_set_layouts = { render_descriptor_set_layout };
+        vk::PipelineLayoutCreateInfo pipeline_layout_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .setLayoutCount = static_cast<std::uint32_t>(descriptor_set_layouts.size()),
+            .pSetLayouts = descriptor_set_layouts.data(),
+            .pushConstantRangeCount = 0u,
+            .pPushConstantRanges = nullptr
+        };
+        if (
+            vk::Result result = logical_device.createPipelineLayout(&pipeline_layout_ci, nullptr, &render_pipeline_layout);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to create vk::PipelineLayout!");
+        }
+
+        // Create graphic pipeline
+        vk::GraphicsPipelineCreateInfo graphics_pipeline_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .stageCount = static_cast<std::uint32_t>(pipeline_shader_stage_cis.size()),
+            .pStages = pipeline_shader_stage_cis.data(),
+            .pVertexInputState = &vertex_input_state_ci,
+            .pInputAssemblyState = &input_assembly_state_ci,
+            .pTessellationState = &tessellation_state_ci,
+            .pViewportState = &viewport_state_ci,
+            .pRasterizationState = &rasterization_state_ci,
+            .pMultisampleState = &multisample_state_ci,
+            .pDepthStencilState = nullptr,
+            .pColorBlendState = &color_blend_state_ci,
+            .pDynamicState = &dynamic_state_ci,
+            .layout = render_pipeline_layout,
+            .renderPass = render_pass,
+            .subpass = 0u,
+            .basePipelineHandle = nullptr,
+            .basePipelineIndex = 0,
+        };
+        if (
+            vk::Result result = logical_device.createGraphicsPipelines(
+                nullptr, 1u, &graphics_pipeline_ci, nullptr, &render_pipeline
+            );
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to create vk::Pipeline!");
+        }
+
+        logical_device.destroyShaderModule(vert_shader_module, nullptr);
+        logical_device.destroyShaderModule(frag_shader_module, nullptr);
+    }
+
+    void create_frame_buffers() {
+        frame_buffers.resize(swapchain_imageviews.size());
+        for (std::size_t i { 0uz }; i < swapchain_imageviews.size(); ++i) {
+            std::array<vk::ImageView, 1uz> imageviews = { swapchain_imageviews[i] };
+            vk::FramebufferCreateInfo frame_buffer_ci {
+                .pNext = nullptr,
+                .flags = {},
+                .renderPass = render_pass,
+                .attachmentCount = static_cast<std::uint32_t>(imageviews.size()),
+                .pAttachments = imageviews.data(),
+                .width = swapchain_extent.width,
+                .height = swapchain_extent.height,
+                .layers = 1u
+            };
+            if (
+                vk::Result result = logical_device.createFramebuffer(&frame_buffer_ci, nullptr, &frame_buffers[i]);
+                result != vk::Result::eSuccess
+            ) {
+                minilog::log_fatal("Failed to create vk::Framebuffer!");
+            }
+        }
+    }
+
+    // The color and depth attachments of the visibility raster, at the resolution of the dispatches
+    void create_visibility_targets() {
+        create_image(
+            width, height, 1u, vk::SampleCountFlagBits::e1,
+            VISIBILITY_FORMAT,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            visibility_image,
+            visibility_image_memory
+        );
+        visibility_imageview = create_imageview(visibility_image, VISIBILITY_FORMAT, vk::ImageAspectFlagBits::eColor, 1u);
+        create_image(
+            width, height, 1u, vk::SampleCountFlagBits::e1,
+            VISIBILITY_DEPTH_FORMAT,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eDepthStencilAttachment,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            visibility_depth_image,
+            visibility_depth_image_memory
+        );
+        visibility_depth_imageview = create_imageview(
+            visibility_depth_image, VISIBILITY_DEPTH_FORMAT, vk::ImageAspectFlagBits::eDepth, 1u
+        );
+    }
+
+    // The color attachment ends up ready for the copy to the visibility buffer, and waits
+    //   for the copy of the previous raster before it is cleared
+    void create_visibility_render_pass() {
+        std::array<vk::AttachmentDescription, 2uz> attachment_descs = {
+            vk::AttachmentDescription {
+                .flags = {},
+                .format = VISIBILITY_FORMAT,
+                .samples = vk::SampleCountFlagBits::e1,
+                .loadOp = vk::AttachmentLoadOp::eClear,
+                .storeOp = vk::AttachmentStoreOp::eStore,
+                .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+                .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+                .initialLayout = vk::ImageLayout::eUndefined,
+                .finalLayout = vk::ImageLayout::eTransferSrcOptimal
+            },
+            vk::AttachmentDescription {
+                .flags = {},
+                .format = VISIBILITY_DEPTH_FORMAT,
+                .samples = vk::SampleCountFlagBits::e1,
+                .loadOp = vk::AttachmentLoadOp::eClear,
+                .storeOp = vk::AttachmentStoreOp::eDontCare,
+                .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+                .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+                .initialLayout = vk::ImageLayout::eUndefined,
+                .finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal
+            }
+        };
+        vk::AttachmentReference attachment_ref_color {
+            .attachment = 0u,
+            .layout = vk::ImageLayout::eColorAttachmentOptimal
+        };
+        vk::AttachmentReference attachment_ref_depth {
+            .attachment = 1u,
+            .layout = vk::ImageLayout::eDepthStencilAttachmentOptimal
+        };
+
+        vk::SubpassDescription subpass_desc {
+            .flags = {},
+            .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
+            .inputAttachmentCount = 0u,
+            .pInputAttachments = nullptr,
+            .colorAttachmentCount = 1u,
+            .pColorAttachments = &attachment_ref_color,
+            .pResolveAttachments = nullptr,
+            .pDepthStencilAttachment = &attachment_ref_depth,
+            .preserveAttachmentCount = 0u,
+            .pPreserveAttachments = nullptr
+        };
+
+        std::array<vk::SubpassDependency, 2uz> subpass_dependencies = {
+            vk::SubpassDependency {
+                .srcSubpass = vk::SubpassExternal,
+                .dstSubpass = 0u,
+                .srcStageMask = vk::PipelineStageFlagBits::eTransfer
+                    | vk::PipelineStageFlagBits::eLateFragmentTests,
+                .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput
+                    | vk::PipelineStageFlagBits::eEarlyFragmentTests,
+                .srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                .dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite
+                    | vk::AccessFlagBits::eDepthStencilAttachmentRead
+                    | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                .dependencyFlags = {}
+            },
+            vk::SubpassDependency {
+                .srcSubpass = 0u,
+                .dstSubpass = vk::SubpassExternal,
+                .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                .dstStageMask = vk::PipelineStageFlagBits::eTransfer,
+                .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+                .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+                .dependencyFlags = {}
+            }
+        };
+
+        vk::RenderPassCreateInfo render_pass_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .attachmentCount = static_cast<std::uint32_t>(attachment_descs.size()),
+            .pAttachments = attachment_descs.data(),
+            .subpassCount = 1u,
+            .pSubpasses = &subpass_desc,
+            .dependencyCount = static_cast<std::uint32_t>(subpass_dependencies.size()),
+            .pDependencies = subpass_dependencies.data()
+        };
+        if (
+            vk::Result result = logical_device.createRenderPass(&render_pass_ci, nullptr, &visibility_render_pass);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to create the visibility vk::RenderPass!");
+        }
+
+        std::array<vk::ImageView, 2uz> imageviews = { visibility_imageview, visibility_depth_imageview };
+        vk::FramebufferCreateInfo frame_buffer_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .renderPass = visibility_render_pass,
+            .attachmentCount = static_cast<std::uint32_t>(imageviews.size()),
+            .pAttachments = imageviews.data(),
+            .width = width,
+            .height = height,
+            .layers = 1u
+        };
+        if (
+            vk::Result result = logical_device.createFramebuffer(&frame_buffer_ci, nullptr, &visibility_framebuffer);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("Failed to create the visibility vk::Framebuffer!");
+        }
+    }
+
+    // No culling, the camera rays hit both sides of a triangle. It shares the pipeline layout
+    //   of the compute passes, bindings 0, 1 and 26 are visible to the vertex stage.
+    void create_visibility_pipeline() {
+        std::vector<char> vert_code = read_shader_file(VISIBILITY_VERT_SHADER_FILE);
+        std::vector<char> frag_code = read_shader_file(VISIBILITY_FRAG_SHADER_FILE);
+        vk::ShaderModule vert_shader_module = create_shader_module(vert_code);
+        vk::ShaderModule frag_shader_module = create_shader_module(frag_code);
+        std::array<vk::SpecializationMapEntry, 2uz> specialization_map_entries = {
+            vk::SpecializationMapEntry { .constantID = 0u, .offset = offsetof(RenderConfig, width), .size = sizeof(std::uint32_t) },
+            vk::SpecializationMapEntry { .constantID = 1u, .offset = offsetof(RenderConfig, height), .size = sizeof(std::uint32_t) }
+        };
+        vk::SpecializationInfo specialization_info { // the aspect ratio of the camera
+            .mapEntryCount = static_cast<std::uint32_t>(specialization_map_entries.size()),
+            .pMapEntries = specialization_map_entries.data(),
+            .dataSize = sizeof(RenderConfig),
+            .pData = &render_config
+        };
+        std::array<vk::PipelineShaderStageCreateInfo, 2uz> pipeline_shader_stage_cis = {
+            vk::PipelineShaderStageCreateInfo {
+                .pNext = nullptr,
+                .flags = {},
+                .stage = vk::ShaderStageFlagBits::eVertex,
+                .module = vert_shader_module,
+                .pName = "main",
+                .pSpecializationInfo = &specialization_info
+            },
+            vk::PipelineShaderStageCreateInfo {
+                .pNext = nullptr,
+                .flags = {},
+                .stage = vk::ShaderStageFlagBits::eFragment,
+                .module = frag_shader_module,
+                .pName = "main",
+                .pSpecializationInfo = nullptr
+            }
+        };
+
+        vk::PipelineVertexInputStateCreateInfo vertex_input_state_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .vertexBindingDescriptionCount = 0u,
+            .pVertexBindingDescriptions = nullptr,
+            .vertexAttributeDescriptionCount = 0u,
+            .pVertexAttributeDescriptions = nullptr
+        };
+
+        vk::PipelineInputAssemblyStateCreateInfo input_assembly_state_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .topology = vk::PrimitiveTopology::eTriangleList,
+            .primitiveRestartEnable = vk::False
+        };
+
+        vk::Viewport viewport {
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = static_cast<float>(width),
+            .height = static_cast<float>(height),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f
+        };
+        vk::Rect2D scissor {
+            .offset { .x = 0, .y = 0 },
+            .extent { .width = width, .height = height }
+        };
+        vk::PipelineViewportStateCreateInfo viewport_state_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .viewportCount = 1u,
+            .pViewports = &viewport,
+            .scissorCount = 1u,
+            .pScissors = &scissor
+        };
+
+        vk::PipelineRasterizationStateCreateInfo rasterization_state_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .depthClampEnable = vk::False,
+            .rasterizerDiscardEnable = vk::False,
+            .polygonMode = vk::PolygonMode::eFill,
+            .cullMode = vk::CullModeFlagBits::eNone,
+            .frontFace = vk::FrontFace::eCounterClockwise,
+            .depthBiasEnable = vk::False,
+            .depthBiasClamp = 0.0f,
+            .depthBiasSlopeFactor = 0.0f,
+            .lineWidth = 1.0f
+        };
+
+        vk::PipelineMultisampleStateCreateInfo multisample_state_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .rasterizationSamples = vk::SampleCountFlagBits::e1,
+            .sampleShadingEnable = vk::False,
+            .minSampleShading = 0.0f,
+            .pSampleMask = nullptr,
+            .alphaToCoverageEnable = vk::False,
+            .alphaToOneEnable = vk::False
+        };
+
+        vk::PipelineDepthStencilStateCreateInfo depth_stencil_state_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .depthTestEnable = vk::True,
+            .depthWriteEnable = vk::True,
+            .depthCompareOp = vk::CompareOp::eGreater, // reversed depth
+            .depthBoundsTestEnable = vk::False,
+            .stencilTestEnable = vk::False,
+            .front = {},
+            .back = {},
+            .minDepthBounds = 0.0f,
+            .maxDepthBounds = 1.0f
+        };
+
+        vk::PipelineColorBlendAttachmentState color_blend_attachment_state { // integer attachment, no blending
+            .blendEnable = vk::False,
+            .srcColorBlendFactor = vk::BlendFactor::eOne,
+            .dstColorBlendFactor = vk::BlendFactor::eZero,
+            .colorBlendOp = vk::BlendOp::eAdd,
+            .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+            .dstAlphaBlendFactor = vk::BlendFactor::eZero,
+            .alphaBlendOp = vk::BlendOp::eAdd,
+            .colorWriteMask = vk::ColorComponentFlagBits::eR
+                | vk::ColorComponentFlagBits::eG
+                | vk::ColorComponentFlagBits::eB
+                | vk::ColorComponentFlagBits::eA
+        };
+        std::array<float, 4uz> blend_constants = { 0.0f, 0.0f, 0.0f, 0.0f }; // RGBA
+        vk::PipelineColorBlendStateCreateInfo color_blend_state_ci {
             .pNext = nullptr,
             .flags = {},
-            .setLayoutCount = static_cast<std::uint32_t>(descriptor_set_layouts.size()),
-            .pSetLayouts = descriptor_set_layouts.data(),
-            .pushConstantRangeCount = 0u,
-            .pPushConstantRanges = nullptr
+            .logicOpEnable = vk::False,
+            .logicOp = vk::LogicOp::eCopy,
+            .attachmentCount = 1u,
+            .pAttachments = &color_blend_attachment_state,
+            .blendConstants = blend_constants
         };
-        if (
-            vk::Result result = logical_device.createPipelineLayout(&pipeline_layout_ci, nullptr, &render_pipeline_layout);
-            result != vk::Result::eSuccess
-        ) {
-            minilog::log_fatal("Failed to create vk::PipelineLayout!");
-        }
 
-        // Create graphic pipeline
         vk::GraphicsPipelineCreateInfo graphics_pipeline_ci {
             .pNext = nullptr,
             .flags = {},
@@ -1221,55 +2735,32 @@ private:
             .pStages = pipeline_shader_stage_cis.data(),
             .pVertexInputState = &vertex_input_state_ci,
             .pInputAssemblyState = &input_assembly_state_ci,
-            .pTessellationState = &tessellation_state_ci,
+            .pTessellationState = nullptr,
             .pViewportState = &viewport_state_ci,
             .pRasterizationState = &rasterization_state_ci,
             .pMultisampleState = &multisample_state_ci,
-            .pDepthStencilState = nullptr,
+            .pDepthStencilState = &depth_stencil_state_ci,
             .pColorBlendState = &color_blend_state_ci,
-            .pDynamicState = &dynamic_state_ci,
-            .layout = render_pipeline_layout,
-            .renderPass = render_pass,
+            .pDynamicState = nullptr,
+            .layout = compute_pipeline_layout,
+            .renderPass = visibility_render_pass,
             .subpass = 0u,
             .basePipelineHandle = nullptr,
             .basePipelineIndex = 0,
         };
         if (
             vk::Result result = logical_device.createGraphicsPipelines(
-                nullptr, 1u, &graphics_pipeline_ci, nullptr, &render_pipeline
+                pipeline_cache, 1u, &graphics_pipeline_ci, nullptr, &visibility_pipeline
             );
             result != vk::Result::eSuccess
         ) {
-            minilog::log_fatal("Failed to create vk::Pipeline!");
+            minilog::log_fatal("Failed to create the visibility vk::Pipeline!");
         }
 
         logical_device.destroyShaderModule(vert_shader_module, nullptr);
         logical_device.destroyShaderModule(frag_shader_module, nullptr);
     }
 
-    void create_frame_buffers() {
-        frame_buffers.resize(swapchain_imageviews.size());
-        for (std::size_t i { 0uz }; i < swapchain_imageviews.size(); ++i) {
-            std::array<vk::ImageView, 1uz> imageviews = { swapchain_imageviews[i] };
-            vk::FramebufferCreateInfo frame_buffer_ci {
-                .pNext = nullptr,
-                .flags = {},
-                .renderPass = render_pass,
-                .attachmentCount = static_cast<std::uint32_t>(imageviews.size()),
-                .pAttachments = imageviews.data(),
-                .width = swapchain_extent.width,
-                .height = swapchain_extent.height,
-                .layers = 1u
-            };
-            if (
-                vk::Result result = logical_device.createFramebuffer(&frame_buffer_ci, nullptr, &frame_buffers[i]);
-                result != vk::Result::eSuccess
-            ) {
-                minilog::log_fatal("Failed to create vk::Framebuffer!");
-            }
-        }
-    }
-
     void create_descriptor_pool() {
         std::array<vk::DescriptorPoolSize, 2uz> descriptor_pool_size = {
             vk::DescriptorPoolSize {
@@ -1278,13 +2769,13 @@ private:
             },
             vk::DescriptorPoolSize {
                 .type = vk::DescriptorType::eStorageBuffer,
-                .descriptorCount = static_cast<std::uint32_t>(MAX_FRAMES_IN_FLIGHT) * 4u
+                .descriptorCount = static_cast<std::uint32_t>(MAX_FRAMES_IN_FLIGHT * STORAGE_BUFFER_COUNT + DISPLAY_COPY_COUNT) // compute + render
             }
         };
         vk::DescriptorPoolCreateInfo descriptor_pool_ci {
             .pNext = nullptr,
             .flags = {},
-            .maxSets = static_cast<std::uint32_t>(MAX_FRAMES_IN_FLIGHT) * 2u,
+            .maxSets = static_cast<std::uint32_t>(MAX_FRAMES_IN_FLIGHT + DISPLAY_COPY_COUNT), // compute + render
             .poolSizeCount = static_cast<std::uint32_t>(descriptor_pool_size.size()),
             .pPoolSizes = descriptor_pool_size.data()
         };
@@ -1321,25 +2812,30 @@ private:
                 .offset = vk::DeviceSize { 0u },
                 .range = vk::DeviceSize { sizeof(UniformBufferObject) }
             };
-            vk::DescriptorBufferInfo descriptor_buffer_info2 { // vertex buffer
-                .buffer = storage_buffers[0uz],
+            vk::DescriptorBufferInfo descriptor_buffer_info2 { // packed triangles
+                .buffer = storage_buffers[PACKED_TRIANGLE_BUFFER],
                 .offset = vk::DeviceSize { 0u },
-                .range = vk::DeviceSize { sizeof(vertices[0uz]) * vertices.size() }
+                .range = vk::DeviceSize { sizeof(model.packed_triangles[0uz]) * model.packed_triangles.size() }
             };
             vk::DescriptorBufferInfo descriptor_buffer_info3 { // index buffer
-                .buffer = storage_buffers[1uz],
+                .buffer = storage_buffers[INDEX_BUFFER],
                 .offset = vk::DeviceSize { 0u },
-                .range = vk::DeviceSize { sizeof(indices[0uz]) * indices.size() }
+                .range = vk::DeviceSize { sizeof(model.indices[0uz]) * model.indices.size() }
             };
             vk::DescriptorBufferInfo descriptor_buffer_info4 { // pixel colors
-                .buffer = storage_buffers[2uz],
+                .buffer = storage_buffers[PIXEL_COLOR_BUFFER],
                 .offset = vk::DeviceSize { 0u },
                 .range = vk::DeviceSize { width * height * 4u * 4u }
             };
-            vk::DescriptorBufferInfo descriptor_buffer_info5 { // seed buffer
-                .buffer = storage_buffers[3uz],
+            vk::DescriptorBufferInfo descriptor_buffer_info5 { // bvh nodes
+                .buffer = storage_buffers[BVH_NODE_BUFFER],
+                .offset = vk::DeviceSize { 0u },
+                .range = vk::DeviceSize { sizeof(model.bvh_nodes[0uz]) * model.bvh_nodes.size() }
+            };
+            vk::DescriptorBufferInfo descriptor_buffer_info6 { // bvh primitives
+                .buffer = storage_buffers[BVH_PRIMITIVE_BUFFER],
                 .offset = vk::DeviceSize { 0u },
-                .range = vk::DeviceSize { width * height * 4u }
+                .range = vk::DeviceSize { sizeof(model.bvh_primitives[0uz]) * model.bvh_primitives.size() }
             };
             std::vector<vk::WriteDescriptorSet> write_descriptor_sets = {
                 vk::WriteDescriptorSet {
@@ -1356,7 +2852,7 @@ private:
                 vk::WriteDescriptorSet {
                     .pNext = nullptr,
                     .dstSet = compute_descriptor_sets[i],
-                    .dstBinding = 1u,
+                    .dstBinding = storage_buffer_binding(PACKED_TRIANGLE_BUFFER),
                     .dstArrayElement = 0u,
                     .descriptorCount = 1u,
                     .descriptorType = vk::DescriptorType::eStorageBuffer,
@@ -1367,7 +2863,7 @@ private:
                 vk::WriteDescriptorSet {
                     .pNext = nullptr,
                     .dstSet = compute_descriptor_sets[i],
-                    .dstBinding = 2u,
+                    .dstBinding = storage_buffer_binding(INDEX_BUFFER),
                     .dstArrayElement = 0u,
                     .descriptorCount = 1u,
                     .descriptorType = vk::DescriptorType::eStorageBuffer,
@@ -1378,7 +2874,7 @@ private:
                 vk::WriteDescriptorSet {
                     .pNext = nullptr,
                     .dstSet = compute_descriptor_sets[i],
-                    .dstBinding = 3u,
+                    .dstBinding = storage_buffer_binding(PIXEL_COLOR_BUFFER),
                     .dstArrayElement = 0u,
                     .descriptorCount = 1u,
                     .descriptorType = vk::DescriptorType::eStorageBuffer,
@@ -1389,15 +2885,45 @@ private:
                 vk::WriteDescriptorSet {
                     .pNext = nullptr,
                     .dstSet = compute_descriptor_sets[i],
-                    .dstBinding = 4u,
+                    .dstBinding = storage_buffer_binding(BVH_NODE_BUFFER),
                     .dstArrayElement = 0u,
                     .descriptorCount = 1u,
                     .descriptorType = vk::DescriptorType::eStorageBuffer,
                     .pImageInfo = nullptr,
                     .pBufferInfo = &descriptor_buffer_info5,
                     .pTexelBufferView = nullptr
+                },
+                vk::WriteDescriptorSet {
+                    .pNext = nullptr,
+                    .dstSet = compute_descriptor_sets[i],
+                    .dstBinding = storage_buffer_binding(BVH_PRIMITIVE_BUFFER),
+                    .dstArrayElement = 0u,
+                    .descriptorCount = 1u,
+                    .descriptorType = vk::DescriptorType::eStorageBuffer,
+                    .pImageInfo = nullptr,
+                    .pBufferInfo = &descriptor_buffer_info6,
+                    .pTexelBufferView = nullptr
                 }
             };
+            std::array<vk::DescriptorBufferInfo, STORAGE_BUFFER_COUNT - PATH_STATE_BUFFER> wavefront_buffer_infos {}; // the bindings of the slots from PATH_STATE_BUFFER on
+            for (std::size_t j { 0uz }; j < wavefront_buffer_infos.size(); ++j) {
+                wavefront_buffer_infos[j] = vk::DescriptorBufferInfo {
+                    .buffer = storage_buffers[PATH_STATE_BUFFER + j],
+                    .offset = vk::DeviceSize { 0u },
+                    .range = vk::WholeSize
+                };
+                write_descriptor_sets.push_back(vk::WriteDescriptorSet {
+                    .pNext = nullptr,
+                    .dstSet = compute_descriptor_sets[i],
+                    .dstBinding = storage_buffer_binding(PATH_STATE_BUFFER + j),
+                    .dstArrayElement = 0u,
+                    .descriptorCount = 1u,
+                    .descriptorType = vk::DescriptorType::eStorageBuffer,
+                    .pImageInfo = nullptr,
+                    .pBufferInfo = &wavefront_buffer_infos[j],
+                    .pTexelBufferView = nullptr
+                });
+            }
             logical_device.updateDescriptorSets(
                 static_cast<std::uint32_t>(write_descriptor_sets.size()),
                 write_descriptor_sets.data(),
@@ -1407,10 +2933,11 @@ private:
         }
     }
 
+    // One per display copy, the frame binds the one of the dispatch it shows
     void create_render_descriptor_sets() {
-        render_descriptor_sets.resize(MAX_FRAMES_IN_FLIGHT);
+        render_descriptor_sets.resize(DISPLAY_COPY_COUNT);
         std::vector<vk::DescriptorSetLayout> descriptor_set_layouts(
-            MAX_FRAMES_IN_FLIGHT,
+            DISPLAY_COPY_COUNT,
             render_descriptor_set_layout
         );
         vk::DescriptorSetAllocateInfo descriptor_set_ai {
@@ -1426,11 +2953,11 @@ private:
             minilog::log_fatal("Failed to create vk::DescriptorSet!");
         }
 
-        for (std::size_t i { 0uz }; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-            vk::DescriptorBufferInfo descriptor_buffer_info { // pixel colors
-                .buffer = storage_buffers[2uz],
+        for (std::size_t i { 0uz }; i < DISPLAY_COPY_COUNT; ++i) {
+            vk::DescriptorBufferInfo descriptor_buffer_info { // pixel colors, their denoised or upscaled copy
+                .buffer = display_copies[i],
                 .offset = vk::DeviceSize { 0u },
-                .range = vk::DeviceSize { width * height * 4u * 4u }
+                .range = vk::DeviceSize { display_width * display_height * 4u * 4u }
             };
             std::vector<vk::WriteDescriptorSet> write_descriptor_sets = {
                 vk::WriteDescriptorSet {
@@ -1457,85 +2984,111 @@ private:
     void create_sync_objects() {
         image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
         render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        compute_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        render_in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-        compute_in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
 
         vk::SemaphoreCreateInfo semaphore_ci {
             .pNext = nullptr,
             .flags = {}
         };
-        vk::FenceCreateInfo fence_ci {
-            .pNext = nullptr,
-            .flags = vk::FenceCreateFlagBits::eSignaled
-        };
         for (std::size_t i { 0uz }; i < MAX_FRAMES_IN_FLIGHT; ++i) {
             if (
                 logical_device.createSemaphore(&semaphore_ci, nullptr, &image_available_semaphores[i]) != vk::Result::eSuccess
                 || logical_device.createSemaphore(&semaphore_ci, nullptr, &render_finished_semaphores[i]) != vk::Result::eSuccess
-                || logical_device.createFence(&fence_ci, nullptr, &render_in_flight_fences[i]) != vk::Result::eSuccess
             ) {
                 minilog::log_fatal("Failed to create render synchronization objects for a frame!");
             }
-
-            if (
-                logical_device.createSemaphore(&semaphore_ci, nullptr, &compute_finished_semaphores[i]) != vk::Result::eSuccess
-                || logical_device.createFence(&fence_ci, nullptr, &compute_in_flight_fences[i]) != vk::Result::eSuccess
-            ) {
-                minilog::log_fatal("Failed to create compute synchronization objects for a frame!");
-            }
         }
-    }
 
-    void draw_frame() {
-        // Compute submission
+        vk::SemaphoreTypeCreateInfo semaphore_type_ci {
+            .pNext = nullptr,
+            .semaphoreType = vk::SemaphoreType::eTimeline,
+            .initialValue = 0u
+        };
+        vk::SemaphoreCreateInfo timeline_ci {
+            .pNext = &semaphore_type_ci,
+            .flags = {}
+        };
         if (
-            vk::Result result = logical_device.waitForFences(
-                1u, &compute_in_flight_fences[current_frame], vk::True, std::numeric_limits<std::uint64_t>::max()
-            );
-            result != vk::Result::eSuccess
+            logical_device.createSemaphore(&timeline_ci, nullptr, &compute_timeline) != vk::Result::eSuccess
+            || logical_device.createSemaphore(&timeline_ci, nullptr, &render_timeline) != vk::Result::eSuccess
         ) {
-            minilog::log_debug("compute: wait for vk::Fence failed!");
+            minilog::log_fatal("Failed to create the timeline semaphores!");
         }
+    }
 
-        update_uniform_buffer(current_frame);
-
+    void wait_timeline(vk::Semaphore timeline, std::uint64_t value) {
+        vk::SemaphoreWaitInfo semaphore_wi {
+            .pNext = nullptr,
+            .flags = {},
+            .semaphoreCount = 1u,
+            .pSemaphores = &timeline,
+            .pValues = &value
+        };
         if (
-            vk::Result result = logical_device.resetFences(1u, &compute_in_flight_fences[current_frame]);
+            vk::Result result = logical_device.waitSemaphores(&semaphore_wi, std::numeric_limits<std::uint64_t>::max());
             result != vk::Result::eSuccess
         ) {
-            minilog::log_debug("compute: reset vk::Fence failed!");
+            minilog::log_debug("wait for the timeline vk::Semaphore failed!");
         }
+    }
+
+    // The value of the submission that used the per-frame resources of the next one
+    static std::uint64_t frame_slot_value(std::uint64_t submitted) {
+        return submitted + 1u > MAX_FRAMES_IN_FLIGHT ? submitted + 1u - MAX_FRAMES_IN_FLIGHT : 0u;
+    }
+
+    // Waits until the dispatch that last used current_frame is done, then records and submits
+    //   the next one. With a window it ends with a copy of the displayed pixels into a display
+    //   copy, once the frame that last showed that copy is rendered. Returns the copy.
+    std::size_t submit_compute() {
+        wait_timeline(compute_timeline, frame_slot_value(compute_timeline_value));
+        update_uniform_buffer(current_frame);
 
+        const std::uint64_t dispatch = ++compute_timeline_value;
+        const std::size_t display_copy = static_cast<std::size_t>(dispatch % DISPLAY_COPY_COUNT);
         compute_command_buffers[current_frame].reset({});
-        record_compute_command_buffer(compute_command_buffers[current_frame]);
+        record_compute_command_buffer(
+            compute_command_buffers[current_frame], options.wavefront,
+            options.headless ? vk::Buffer {} : display_copies[display_copy]
+        );
 
-        vk::SubmitInfo submit_info {
+        const vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eTransfer;
+        vk::TimelineSemaphoreSubmitInfo timeline_si {
             .pNext = nullptr,
-            .waitSemaphoreCount = 0u,
-            .pWaitSemaphores = nullptr,
-            .pWaitDstStageMask = nullptr,
+            .waitSemaphoreValueCount = options.headless ? 0u : 1u,
+            .pWaitSemaphoreValues = &display_copy_reads[display_copy],
+            .signalSemaphoreValueCount = 1u,
+            .pSignalSemaphoreValues = &dispatch
+        };
+        vk::SubmitInfo submit_info {
+            .pNext = &timeline_si,
+            .waitSemaphoreCount = options.headless ? 0u : 1u,
+            .pWaitSemaphores = &render_timeline,
+            .pWaitDstStageMask = &wait_stage,
             .commandBufferCount = 1u,
             .pCommandBuffers = &compute_command_buffers[current_frame],
             .signalSemaphoreCount = 1u,
-            .pSignalSemaphores = &compute_finished_semaphores[current_frame]
+            .pSignalSemaphores = &compute_timeline
         };
         if (
-            vk::Result result = compute_queue.submit(1u, &submit_info, compute_in_flight_fences[current_frame]);
+            vk::Result result = compute_queue.submit(1u, &submit_info, nullptr);
             result != vk::Result::eSuccess
         ) {
             minilog::log_fatal("compute: failed to submit compute command buffer!");
         }
 
+        return display_copy;
+    }
+
+    // The render of dispatch N only waits for that dispatch on the compute timeline, and the
+    //   dispatch N + 1 only for the frame that showed its display copy two frames ago: with an
+    //   async compute queue the dispatch runs while the previous one is presented
+    void draw_frame() {
+        // Compute submission
+        const std::size_t display_copy = submit_compute();
+        const std::uint64_t dispatch = compute_timeline_value;
+
         // Render submission
-        if (
-            vk::Result result = logical_device.waitForFences(
-                1u, &render_in_flight_fences[current_frame], vk::True, std::numeric_limits<std::uint64_t>::max()
-            );
-            result != vk::Result::eSuccess
-        ) {
-            minilog::log_debug("render: wait for vk::Fence failed!");
-        }
+        wait_timeline(render_timeline, frame_slot_value(render_timeline_value));
 
         std::uint32_t image_index { 0u };
         if (
@@ -1554,35 +3107,43 @@ private:
             minilog::log_fatal("Failed to acquire swap chain image!");
         }
 
-        if (
-            vk::Result result = logical_device.resetFences(1u, &render_in_flight_fences[current_frame]);
-            result != vk::Result::eSuccess
-        ) {
-            minilog::log_debug("render: reset vk::Fence failed!");
-        }
-
         render_command_buffers[current_frame].reset({});
-        record_render_command_buffer(render_command_buffers[current_frame], image_index);
+        record_render_command_buffer(render_command_buffers[current_frame], image_index, display_copy);
 
+        const std::uint64_t frame = ++render_timeline_value;
+        display_copy_reads[display_copy] = frame;
         std::array<vk::Semaphore, 2uz> wait_semaphores = {
-            compute_finished_semaphores[current_frame],
+            compute_timeline,
             image_available_semaphores[current_frame]
         };
+        std::array<std::uint64_t, 2uz> wait_values = { dispatch, 0u }; // binary semaphores ignore theirs
         std::array<vk::PipelineStageFlags, 2uz> wait_stages = {
-            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eFragmentShader,
             vk::PipelineStageFlagBits::eColorAttachmentOutput
         };
-        submit_info = vk::SubmitInfo {};
-        submit_info.pNext = nullptr;
+        std::array<vk::Semaphore, 2uz> signal_semaphores = {
+            render_timeline,
+            render_finished_semaphores[current_frame]
+        };
+        std::array<std::uint64_t, 2uz> signal_values = { frame, 0u };
+        vk::TimelineSemaphoreSubmitInfo timeline_si {
+            .pNext = nullptr,
+            .waitSemaphoreValueCount = static_cast<std::uint32_t>(wait_values.size()),
+            .pWaitSemaphoreValues = wait_values.data(),
+            .signalSemaphoreValueCount = static_cast<std::uint32_t>(signal_values.size()),
+            .pSignalSemaphoreValues = signal_values.data()
+        };
+        vk::SubmitInfo submit_info {};
+        submit_info.pNext = &timeline_si;
         submit_info.waitSemaphoreCount = static_cast<std::uint32_t>(wait_semaphores.size());
         submit_info.pWaitSemaphores = wait_semaphores.data();
         submit_info.pWaitDstStageMask = wait_stages.data();
         submit_info.commandBufferCount = 1u;
         submit_info.pCommandBuffers = &render_command_buffers[current_frame];
-        submit_info.signalSemaphoreCount = 1u;
-        submit_info.pSignalSemaphores = &render_finished_semaphores[current_frame];
+        submit_info.signalSemaphoreCount = static_cast<std::uint32_t>(signal_semaphores.size());
+        submit_info.pSignalSemaphores = signal_semaphores.data();
         if (
-            vk::Result result = graphic_queue.submit(1u, &submit_info, render_in_flight_fences[current_frame]);
+            vk::Result result = graphic_queue.submit(1u, &submit_info, nullptr);
             result != vk::Result::eSuccess
         ) {
             minilog::log_fatal("render: failed to submit render command buffer!");
@@ -1636,7 +3197,7 @@ private:
         create_frame_buffers();
     }
 
-    void record_render_command_buffer(vk::CommandBuffer commandBuffer, std::uint32_t imageIndex) {
+    void record_render_command_buffer(vk::CommandBuffer commandBuffer, std::uint32_t imageIndex, std::size_t displayCopy) {
         vk::CommandBufferBeginInfo command_buffer_bi {
             .pNext = nullptr,
             .flags = {},
@@ -1676,7 +3237,7 @@ private:
             vk::PipelineBindPoint::eGraphics,
             render_pipeline_layout,
             0u,
-            1u, &render_descriptor_sets[current_frame],
+            1u, &render_descriptor_sets[displayCopy],
             0u, nullptr
         );
         commandBuffer.draw(3u, 1u, 0u, 0u);
@@ -1698,14 +3259,27 @@ private:
                 queue_family_index.graphic_and_compute = i;
             }
 
-            if (physicalDevice.getSurfaceSupportKHR(i, surface)) {
+            if (!options.headless && physicalDevice.getSurfaceSupportKHR(i, surface)) {
                 queue_family_index.present = i;
             }
 
-            if (queue_family_index.has_value()) { break; }
+            if (queue_family_index.has_value(!options.headless)) { break; }
             ++i;
         }
 
+        // The visibility raster is recorded with the dispatches, so they need a graphics queue
+        for (
+            std::uint32_t family { 0u };
+            family < static_cast<std::uint32_t>(queue_family_properties.size()) && render_config.raster_primary == 0u;
+            ++family
+        ) {
+            const vk::QueueFlags queue_flags = queue_family_properties[family].queueFlags;
+            if ((queue_flags & vk::QueueFlagBits::eCompute) && !(queue_flags & vk::QueueFlagBits::eGraphics)) {
+                queue_family_index.async_compute = family;
+                break;
+            }
+        }
+
         return queue_family_index;
     }
 
@@ -1772,12 +3346,12 @@ private:
     }
 
     std::vector<const char*> get_required_extensions() {
-        std::uint32_t glfw_required_instance_count { 0u };
-        const char** glfw_required_instance_ext = glfwGetRequiredInstanceExtensions(&glfw_required_instance_count);
-        std::vector<const char*> instance_extensions(
-            glfw_required_instance_ext,
-            glfw_required_instance_ext + glfw_required_instance_count
-        );
+        std::vector<const char*> instance_extensions;
+        if (!options.headless) {
+            std::uint32_t glfw_required_instance_count { 0u };
+            const char** glfw_required_instance_ext = glfwGetRequiredInstanceExtensions(&glfw_required_instance_count);
+            instance_extensions.assign(glfw_required_instance_ext, glfw_required_instance_ext + glfw_required_instance_count);
+        }
         if (ENABLE_VALIDATION_LAYER) {
             minilog::log_debug("ENABLE_VALIDATION_LAYER: true");
             instance_extensions.push_back(vk::EXTDebugUtilsExtensionName);
@@ -1797,7 +3371,20 @@ private:
         return required_extensions.empty();
     }
 
+    // The frames are ordered by timeline semaphores, core since Vulkan 1.2
+    bool supports_timeline_semaphores(vk::PhysicalDevice physicalDevice) {
+        if (vk::enumerateInstanceVersion() < vk::ApiVersion12 || physicalDevice.getProperties().apiVersion < vk::ApiVersion12) {
+            return false;
+        }
+        const auto features = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+
+        return features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore == vk::True;
+    }
+
     bool is_physical_device_suitable(vk::PhysicalDevice physicalDevice) {
+        if (!supports_timeline_semaphores(physicalDevice)) { return false; }
+        if (options.headless) { return find_queue_families(physicalDevice).has_value(false); }
+
         bool swapchain_adequate { false };
         bool extensions_supported = check_physical_device_extension_support(physicalDevice);
         if (extensions_supported) {
@@ -1893,9 +3480,9 @@ private:
             .flags = {},
             .size = size,
             .usage = usage,
-            .sharingMode = vk::SharingMode::eExclusive,
-            .queueFamilyIndexCount = 0u,
-            .pQueueFamilyIndices = nullptr
+            .sharingMode = buffer_queue_families.empty() ? vk::SharingMode::eExclusive : vk::SharingMode::eConcurrent,
+            .queueFamilyIndexCount = static_cast<std::uint32_t>(buffer_queue_families.size()),
+            .pQueueFamilyIndices = buffer_queue_families.data()
         };
         if (
             vk::Result result = logical_device.createBuffer(&buffer_ci, nullptr, &buffer);
@@ -2010,11 +3597,18 @@ private:
 
     void update_uniform_buffer(std::uint32_t currentImage) {
         minilog::log_debug("the sample index: {}", ubo.sample_index);
+        ubo.previous_camera = ubo.camera;
+        ubo.camera = camera.uniform();
+        // With sample_index == 0 the per-pixel passes start from scratch anyway
+        reproject_history = camera_moved && ubo.sample_index > 0u;
+        rasterize_visibility = rasterize_visibility || camera_moved;
+        camera_moved = false;
         memcpy(uniform_buffers_mapped[currentImage], &ubo, sizeof(ubo));
         ubo.sample_index++;
     }
 
-    void record_compute_command_buffer(vk::CommandBuffer commandBuffer) {
+    // displayCopy: receives the displayed pixels after the dispatch when it is not null
+    void record_compute_command_buffer(vk::CommandBuffer commandBuffer, bool wavefront, vk::Buffer displayCopy = {}) {
         vk::CommandBufferBeginInfo command_buffer_bi {
             .pNext = nullptr,
             .flags = {},
@@ -2026,8 +3620,8 @@ private:
         ) {
             minilog::log_fatal("Failed to begin recording command buffer!");
         }
+        gpu_profiler->begin_frame(commandBuffer, current_frame);
 
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, compute_pipeline);
         commandBuffer.bindDescriptorSets(
             vk::PipelineBindPoint::eCompute,
             compute_pipeline_layout,
@@ -2035,10 +3629,352 @@ private:
             1u, &compute_descriptor_sets[current_frame],
             0u, nullptr
         );
-        commandBuffer.dispatch(width / 8u, height / 8u, 1u);
+        {
+            profiler::GpuZone dispatch_zone { *gpu_profiler, commandBuffer, "dispatch" };
+            // The previous submission may still write the buffers this one reads
+            record_compute_barrier(commandBuffer);
+            const ComputePipelines& pipelines = get_compute_pipelines(render_config);
+            if (render_config.raster_primary != 0u && rasterize_visibility) {
+                profiler::GpuZone zone { *gpu_profiler, commandBuffer, "visibility" };
+                record_visibility_pass(commandBuffer);
+                rasterize_visibility = false;
+            }
+            if (reproject_history) {
+                profiler::GpuZone zone { *gpu_profiler, commandBuffer, "reprojection" };
+                record_reprojection_pass(commandBuffer, pipelines);
+            }
+            if (render_config.adaptive != 0u) {
+                profiler::GpuZone zone { *gpu_profiler, commandBuffer, "adaptive tiles" };
+                record_adaptive_tiles_pass(commandBuffer, pipelines);
+            }
+            if (wavefront) {
+                profiler::GpuZone zone { *gpu_profiler, commandBuffer, "wavefront" };
+                record_wavefront_passes(commandBuffer, pipelines);
+            } else {
+                if (render_config.restir != 0u) {
+                    profiler::GpuZone zone { *gpu_profiler, commandBuffer, "restir" };
+                    record_restir_passes(commandBuffer, pipelines);
+                }
+                {
+                    profiler::GpuZone zone { *gpu_profiler, commandBuffer, "megakernel" };
+                    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.megakernel);
+                    record_pixel_dispatch(commandBuffer);
+                }
+                if (render_config.radiance_cache != 0u) {
+                    profiler::GpuZone zone { *gpu_profiler, commandBuffer, "radiance cache" };
+                    record_radiance_cache_pass(commandBuffer, pipelines);
+                }
+                if (render_config.guiding != 0u) {
+                    profiler::GpuZone zone { *gpu_profiler, commandBuffer, "guiding" };
+                    record_guiding_pass(commandBuffer, pipelines);
+                }
+                if (render_config.interleave > 1u) {
+                    profiler::GpuZone zone { *gpu_profiler, commandBuffer, "interleave" };
+                    record_interleave_pass(commandBuffer, pipelines);
+                }
+            }
+            if (denoise_each_dispatch()) {
+                profiler::GpuZone zone { *gpu_profiler, commandBuffer, "denoise" };
+                record_denoise_passes(commandBuffer, pipelines);
+            }
+            if (displayCopy && upscaling()) {
+                profiler::GpuZone zone { *gpu_profiler, commandBuffer, "upscale" };
+                record_upscale_passes(commandBuffer, pipelines);
+            }
+            if (displayCopy) {
+                profiler::GpuZone zone { *gpu_profiler, commandBuffer, "display copy" };
+                record_compute_barrier(commandBuffer);
+                vk::BufferCopy buffer_copy {
+                    .srcOffset = 0u,
+                    .dstOffset = 0u,
+                    .size = vk::DeviceSize { display_width } * display_height * 4u * 4u
+                };
+                commandBuffer.copyBuffer(presented_buffer(), displayCopy, 1u, &buffer_copy);
+            }
+        }
         commandBuffer.end(); // command buffer end
     }
 
+    // (generate -> (extend -> shade -> connect) x depth) x spp -> accumulate,
+    //   the extend/shade/connect passes are sized by the queue counters on the GPU
+    void record_wavefront_passes(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        const vk::Buffer queue_buffer = storage_buffers[WAVEFRONT_QUEUE_BUFFER];
+        const std::array<std::uint32_t, 4uz> empty_queue_data = { 1u, 1u, 1u, 0u }; // empty_queue() of wavefront.glsl
+
+        WavefrontConstants constants {};
+        for (constants.path_sample = 0u; constants.path_sample < render_config.spp; ++constants.path_sample) {
+            constants.bounce = 0u;
+            commandBuffer.pushConstants(
+                compute_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0u, sizeof(constants), &constants
+            );
+            // generate appends to the first ray queue, the last connect pass may still read the buffer
+            if (constants.path_sample > 0u) { record_compute_barrier(commandBuffer); }
+            commandBuffer.updateBuffer(queue_buffer, 0u, sizeof(empty_queue_data), empty_queue_data.data());
+            record_compute_barrier(commandBuffer);
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.wavefront[WAVEFRONT_GENERATE]);
+            record_pixel_dispatch(commandBuffer);
+
+            for (; constants.bounce < render_config.depth; ++constants.bounce) {
+                const vk::DeviceSize ray_queue_offset = (constants.bounce & 1u) * WAVEFRONT_QUEUE_SIZE;
+                commandBuffer.pushConstants(
+                    compute_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0u, sizeof(constants), &constants
+                );
+
+                record_compute_barrier(commandBuffer);
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.wavefront[WAVEFRONT_EXTEND]);
+                commandBuffer.dispatchIndirect(queue_buffer, ray_queue_offset);
+
+                record_compute_barrier(commandBuffer);
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.wavefront[WAVEFRONT_SHADE]);
+                commandBuffer.dispatchIndirect(queue_buffer, ray_queue_offset);
+
+                record_compute_barrier(commandBuffer);
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.wavefront[WAVEFRONT_CONNECT]);
+                commandBuffer.dispatchIndirect(queue_buffer, WAVEFRONT_SHADOW_QUEUE * WAVEFRONT_QUEUE_SIZE);
+            }
+        }
+        record_compute_barrier(commandBuffer);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.wavefront[WAVEFRONT_ACCUMULATE]);
+        record_pixel_dispatch(commandBuffer);
+    }
+
+    // Draws every instance into the visibility image, then copies it to the visibility buffer
+    //   the per-pixel passes read
+    void record_visibility_pass(vk::CommandBuffer commandBuffer) {
+        std::array<vk::ClearValue, 2uz> clear_values = {
+            vk::ClearValue { .color { .uint32 = std::array<std::uint32_t, 4uz>{ ~0u, ~0u, ~0u, ~0u } } }, // nothing seen
+            vk::ClearValue { .depthStencil { .depth = 0.0f, .stencil = 0u } }
+        };
+        vk::RenderPassBeginInfo render_pass_bi {
+            .pNext = nullptr,
+            .renderPass = visibility_render_pass,
+            .framebuffer = visibility_framebuffer,
+            .renderArea { .offset { .x = 0, .y = 0 }, .extent { .width = width, .height = height } },
+            .clearValueCount = static_cast<std::uint32_t>(clear_values.size()),
+            .pClearValues = clear_values.data()
+        };
+        commandBuffer.beginRenderPass(&render_pass_bi, vk::SubpassContents::eInline);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, visibility_pipeline);
+        commandBuffer.bindDescriptorSets(
+            vk::PipelineBindPoint::eGraphics,
+            compute_pipeline_layout,
+            0u,
+            1u, &compute_descriptor_sets[current_frame],
+            0u, nullptr
+        );
+        for (std::uint32_t i { 0u }; i < static_cast<std::uint32_t>(model.instances.size()); ++i) {
+            const scene::Mesh& mesh = model.meshes[model.instances[i].mesh];
+            commandBuffer.draw(3u * mesh.triangle_count, 1u, 3u * mesh.first_triangle, i);
+        }
+        commandBuffer.endRenderPass();
+
+        vk::BufferImageCopy buffer_image_copy {
+            .bufferOffset = 0u,
+            .bufferRowLength = 0u,
+            .bufferImageHeight = 0u,
+            .imageSubresource {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .mipLevel = 0u,
+                .baseArrayLayer = 0u,
+                .layerCount = 1u
+            },
+            .imageOffset { .x = 0, .y = 0, .z = 0 },
+            .imageExtent { .width = width, .height = height, .depth = 1u }
+        };
+        commandBuffer.copyImageToBuffer(
+            visibility_image, vk::ImageLayout::eTransferSrcOptimal, storage_buffers[VISIBILITY_BUFFER], 1u, &buffer_image_copy
+        );
+        record_compute_barrier(commandBuffer);
+    }
+
+    // Copies the accumulation of the previous view aside, then rebuilds it for the new view
+    //   from the copies. The tile pass runs after it, disoccluded pixels start again.
+    void record_reprojection_pass(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        const vk::DeviceSize pixel_count = vk::DeviceSize { width } * height;
+        const std::array<std::pair<std::size_t, vk::DeviceSize>, 3uz> history_copies = {{
+            { PIXEL_COLOR_BUFFER, pixel_count * 4u * sizeof(float) },
+            { PIXEL_STATS_BUFFER, pixel_count * PIXEL_STATS_SIZE },
+            { PIXEL_AOV_BUFFER, pixel_count * sizeof(denoiser::PixelAov) }
+        }};
+        for (std::size_t i { 0uz }; i < history_copies.size(); ++i) {
+            vk::BufferCopy buffer_copy {
+                .srcOffset = 0u,
+                .dstOffset = 0u,
+                .size = history_copies[i].second
+            };
+            commandBuffer.copyBuffer(
+                storage_buffers[history_copies[i].first], storage_buffers[HISTORY_COLOR_BUFFER + i], 1u, &buffer_copy
+            );
+        }
+        record_compute_barrier(commandBuffer);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.reproject);
+        commandBuffer.dispatch((width + 7u) / 8u, (height + 7u) / 8u, 1u);
+        record_compute_barrier(commandBuffer);
+    }
+
+    // initial -> temporal -> spatial over the whole screen, adaptive sampling or not: the
+    //   temporal pass of the next dispatch reuses the reservoirs of every pixel
+    void record_restir_passes(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        for (vk::Pipeline pipeline : pipelines.restir) {
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+            commandBuffer.dispatch((width + 7u) / 8u, (height + 7u) / 8u, 1u);
+            record_compute_barrier(commandBuffer);
+        }
+    }
+
+    // Resolves every cell of the table after the megakernel added its samples, the next
+    //   dispatch looks the paths up in the result
+    void record_radiance_cache_pass(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        record_compute_barrier(commandBuffer);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.radiance_cache);
+        commandBuffer.dispatch((RADIANCE_CACHE_CELL_COUNT + 63u) / 64u, 1u, 1u);
+    }
+
+    // Learns from the samples the megakernel added, a workgroup per cell
+    void record_guiding_pass(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        record_compute_barrier(commandBuffer);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.guiding);
+        commandBuffer.dispatch(GUIDING_CELL_COUNT, 1u, 1u);
+    }
+
+    // Fills the pixels the interleaved megakernel skipped, over the whole screen
+    void record_interleave_pass(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        record_compute_barrier(commandBuffer);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.interleave);
+        commandBuffer.dispatch((width + 7u) / 8u, (height + 7u) / 8u, 1u);
+    }
+
+    // Edge-adaptive upscale of the displayed image to the window, then a sharpening pass over it
+    void record_upscale_passes(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        const UpscaleConstants constants {
+            .source = denoise_each_dispatch() ? 1u + (options.denoise_iterations + 1u) % 2u : 0u // see denoised_buffer()
+        };
+        commandBuffer.pushConstants(
+            compute_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0u, sizeof(constants), &constants
+        );
+        for (std::size_t i { 0uz }; i < UPSCALE_PASS_COUNT; ++i) {
+            record_compute_barrier(commandBuffer);
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.upscale[i]);
+            commandBuffer.dispatch((display_width + 7u) / 8u, (display_height + 7u) / 8u, 1u);
+        }
+    }
+
+    // Filters the whole accumulated image, the render submission waits for the last iteration
+    void record_denoise_passes(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.denoise);
+        DenoiseConstants constants { .iteration = 0u, .iteration_count = options.denoise_iterations };
+        for (; constants.iteration < constants.iteration_count; ++constants.iteration) {
+            record_compute_barrier(commandBuffer);
+            commandBuffer.pushConstants(
+                compute_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0u, sizeof(constants), &constants
+            );
+            commandBuffer.dispatch((width + 7u) / 8u, (height + 7u) / 8u, 1u);
+        }
+    }
+
+    // Fills the active tile queue the per-pixel passes of this submission are dispatched with
+    void record_adaptive_tiles_pass(vk::CommandBuffer commandBuffer, const ComputePipelines& pipelines) {
+        const std::array<std::uint32_t, 4uz> tile_queue_data = { 0u, 1u, 1u, 0u }; // grown by the tile pass
+        commandBuffer.updateBuffer(storage_buffers[TILE_QUEUE_BUFFER], 0u, sizeof(tile_queue_data), tile_queue_data.data());
+        record_compute_barrier(commandBuffer);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.adaptive_tiles);
+        commandBuffer.dispatch((tile_count() + 63u) / 64u, 1u, 1u);
+        record_compute_barrier(commandBuffer);
+    }
+
+    // An 8x8 workgroup per pixel tile: the whole screen, the active tiles only, or with
+    //   interleaving a tile of 8x8 cells, see interleave_cell_size() of path_tracing.glsl
+    void record_pixel_dispatch(vk::CommandBuffer commandBuffer) {
+        if (render_config.adaptive != 0u) {
+            commandBuffer.dispatchIndirect(storage_buffers[TILE_QUEUE_BUFFER], 0u);
+        } else {
+            const std::uint32_t cell_width = render_config.interleave > 1u ? 2u : 1u;
+            const std::uint32_t cell_height = render_config.interleave > 2u ? 2u : 1u;
+            const std::uint32_t columns = (width + cell_width - 1u) / cell_width;
+            const std::uint32_t rows = (height + cell_height - 1u) / cell_height;
+            commandBuffer.dispatch((columns + 7u) / 8u, (rows + 7u) / 8u, 1u);
+        }
+    }
+
+    // Makes the storage buffer and vkCmdUpdateBuffer writes of the previous commands visible
+    //   to the next ones, including the indirect dispatch arguments and buffer copies
+    void record_compute_barrier(vk::CommandBuffer commandBuffer) {
+        vk::MemoryBarrier memory_barrier {
+            .pNext = nullptr,
+            .srcAccessMask = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+            .dstAccessMask = vk::AccessFlagBits::eShaderRead
+                | vk::AccessFlagBits::eShaderWrite
+                | vk::AccessFlagBits::eIndirectCommandRead
+                | vk::AccessFlagBits::eTransferRead
+                | vk::AccessFlagBits::eTransferWrite
+        };
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eComputeShader
+            | vk::PipelineStageFlagBits::eDrawIndirect
+            | vk::PipelineStageFlagBits::eTransfer,
+            {},
+            1u, &memory_barrier,
+            0u, nullptr,
+            0u, nullptr
+        );
+    }
+
+    // Renders the same number of samples with the megakernel and the wavefront passes,
+    //   each sample is submitted and waited for alone so both are timed the same way. The
+    //   wall time includes the submission and the wait, the GPU time of the dispatch zone not.
+    void benchmark() {
+        const double path_count = static_cast<double>(width) * static_cast<double>(height) * render_config.spp;
+        for (bool wavefront : { false, true }) {
+            ubo.sample_index = 0u;
+            gpu_profiler->clear();
+            const auto start = std::chrono::steady_clock::now();
+            for (std::uint32_t i { 0u }; i < options.benchmark_samples; ++i) {
+                update_uniform_buffer(current_frame);
+                compute_command_buffers[current_frame].reset({});
+                record_compute_command_buffer(compute_command_buffers[current_frame], wavefront);
+
+                vk::SubmitInfo submit_info {
+                    .pNext = nullptr,
+                    .waitSemaphoreCount = 0u,
+                    .pWaitSemaphores = nullptr,
+                    .pWaitDstStageMask = nullptr,
+                    .commandBufferCount = 1u,
+                    .pCommandBuffers = &compute_command_buffers[current_frame],
+                    .signalSemaphoreCount = 0u,
+                    .pSignalSemaphores = nullptr
+                };
+                if (
+                    vk::Result result = compute_queue.submit(1u, &submit_info, nullptr);
+                    result != vk::Result::eSuccess
+                ) {
+                    minilog::log_fatal("benchmark: failed to submit compute command buffer!");
+                }
+                compute_queue.waitIdle();
+            }
+            const auto stop = std::chrono::steady_clock::now();
+
+            const double milliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+            minilog::log_info(
+                "{}: {} samples in {:.2f} ms, {:.3f} ms/sample, {:.2f} M paths/s",
+                wavefront ? "wavefront" : "megakernel",
+                options.benchmark_samples,
+                milliseconds,
+                milliseconds / options.benchmark_samples,
+                path_count * options.benchmark_samples / (milliseconds * 1000.0)
+            );
+            gpu_profiler->collect();
+            if (const profiler::ZoneSummary* dispatch = gpu_profiler->summary("dispatch")) {
+                minilog::log_info(
+                    "{}: {:.3f} ms/sample on the GPU, {:.2f} M paths/s",
+                    wavefront ? "wavefront" : "megakernel",
+                    dispatch->mean_milliseconds(),
+                    path_count / (dispatch->mean_milliseconds() * 1000.0)
+                );
+            }
+        }
+    }
+
     void create_image(
         std::uint32_t width,
         std::uint32_t height,
@@ -2098,11 +4034,134 @@ private:
 
 
 
-int main() {
+// std::nullopt, after the usage, on an unknown or invalid argument
+std::optional<Options> parse_options(int argc, char** argv) {
+    Options options {};
+    auto read_count = [&](int& i, std::uint32_t& value) {
+        if (i + 1 >= argc) { return false; }
+        const std::string_view text { argv[++i] };
+        std::uint32_t count { 0u };
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+        if (error != std::errc {} || end != text.data() + text.size() || count == 0u) { return false; }
+        value = count;
+        return true;
+    };
+
+    for (int i { 1 }; i < argc; ++i) {
+        const std::string argument { argv[i] };
+        bool valid { true };
+        if (argument == "--wavefront") {
+            options.wavefront = true;
+        } else if (argument == "--benchmark") {
+            valid = read_count(i, options.benchmark_samples);
+        } else if (argument == "--width") {
+            valid = read_count(i, options.render_config.width);
+        } else if (argument == "--height") {
+            valid = read_count(i, options.render_config.height);
+        } else if (argument == "--spp") {
+            valid = read_count(i, options.render_config.spp);
+        } else if (argument == "--depth") {
+            valid = read_count(i, options.render_config.depth);
+        } else if (argument == "--headless") {
+            options.headless = true;
+        } else if (argument == "--samples") {
+            valid = read_count(i, options.samples);
+        } else if (argument == "--time" && i + 1 < argc) {
+            const std::string_view text { argv[++i] };
+            const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), options.time_budget);
+            valid = error == std::errc {} && end == text.data() + text.size() && options.time_budget > 0.0;
+        } else if (argument == "--adaptive" && i + 1 < argc) {
+            const std::string_view text { argv[++i] };
+            float threshold { 0.0f };
+            const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), threshold);
+            valid = error == std::errc {} && end == text.data() + text.size() && threshold > 0.0f;
+            if (valid) {
+                options.render_config.adaptive = 1u;
+                options.render_config.adaptive_threshold = threshold;
+            }
+        } else if (argument == "--restir") {
+            options.render_config.restir = 1u;
+        } else if (argument == "--radiance-cache") {
+            options.render_config.radiance_cache = 1u;
+        } else if (argument == "--radiance-cache-view") {
+            options.render_config.radiance_cache = 2u;
+        } else if (argument == "--guiding") {
+            options.render_config.guiding = 1u;
+        } else if (argument == "--hybrid") {
+            options.render_config.raster_primary = 1u;
+        } else if (argument == "--interleave") {
+            valid = read_count(i, options.render_config.interleave)
+                && (options.render_config.interleave == 1u || options.render_config.interleave == 2u || options.render_config.interleave == 4u);
+        } else if (argument == "--denoise") {
+            valid = read_count(i, options.denoise_iterations);
+        } else if (argument == "--capture-every") {
+            valid = read_count(i, options.capture_interval);
+        } else if (argument == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (argument == "--profile" && i + 1 < argc) {
+            options.profile_output = argv[++i];
+        } else if (argument == "--render-scale") {
+            valid = read_count(i, options.render_scale)
+                && std::find(RENDER_SCALE_PRESETS.begin(), RENDER_SCALE_PRESETS.end(), options.render_scale) != RENDER_SCALE_PRESETS.end();
+        } else if (argument == "--bvh-width") {
+            valid = read_count(i, options.bvh_width) && options.bvh_width >= 2u && options.bvh_width <= bvh::WIDE_NODE_CHILDREN;
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            minilog::log_error("invalid argument: {}", argument);
+            minilog::log_info(
+                "usage: 7_path_tracing [--width <pixels>] [--height <pixels>] [--spp <samples>] [--depth <bounces>]"
+                " [--wavefront] [--benchmark <samples>]"
+                " [--headless] [--samples <samples>] [--time <seconds>] [--output <file.png|.pfm|.exr>]"
+                " [--adaptive <relative error>] [--capture-every <dispatches>] [--denoise <iterations>] [--restir]"
+                " [--radiance-cache] [--radiance-cache-view] [--guiding] [--hybrid] [--interleave <1|2|4>]"
+                " [--profile <file.csv|.json>] [--bvh-width <2 to 8>] [--render-scale <100|77|67|50>]"
+            );
+            return std::nullopt;
+        }
+    }
+    if (options.wavefront && options.render_config.restir != 0u) {
+        minilog::log_warn("--restir is not implemented by the wavefront passes, they keep next event estimation");
+        options.render_config.restir = 0u;
+    }
+    if (options.wavefront && options.render_config.radiance_cache != 0u) {
+        minilog::log_warn("--radiance-cache is not implemented by the wavefront passes, they trace whole paths");
+        options.render_config.radiance_cache = 0u;
+    }
+    if (options.wavefront && options.render_config.guiding != 0u) {
+        minilog::log_warn("--guiding is not implemented by the wavefront passes, they sample the cosine lobe");
+        options.render_config.guiding = 0u;
+    }
+    if (options.wavefront && options.render_config.raster_primary != 0u) {
+        minilog::log_warn("--hybrid is not implemented by the wavefront passes, they trace the camera rays");
+        options.render_config.raster_primary = 0u;
+    }
+    // The interleaved pixels fall behind the dispatch count, the headless sample count would not hold
+    if (
+        options.render_config.interleave > 1u
+        && (options.wavefront || options.benchmark_samples > 0u || options.headless || options.render_config.adaptive != 0u)
+    ) {
+        minilog::log_warn("--interleave is interactive only, it is ignored with --wavefront, --benchmark, --headless and --adaptive");
+        options.render_config.interleave = 1u;
+    }
+    if (options.headless && options.render_scale != 100u) {
+        minilog::log_warn("--render-scale is windowed only, the headless image is traced at --width x --height");
+        options.render_scale = 100u;
+    }
+
+    return options;
+}
+
+
+int main(int argc, char** argv) {
     minilog::set_log_level(minilog::log_level::trace); // default log level is 'info'
     // minilog::set_log_file("./mini.log"); // dump log to a specific file
 
-    PathTracing particle_system {};
+    const std::optional<Options> options = parse_options(argc, argv);
+    if (!options) { return EXIT_FAILURE; }
+    PathTracing particle_system { *options };
 
     try {
         particle_system.run();
@@ -0,0 +1,1050 @@
+// CPU reference of the megakernel of shaders/7_path_tracing.comp: the same scene, Sobol
+//   sampler, next event estimation with MIS, cosine-weighted bounces and Russian roulette.
+//   It checks what the GPU renders (--compare with a *.pfm of 7_path_tracing --headless) and
+//   gives a baseline in rays/s per core. Tiles are spread over the threads by a work-stealing
+//   scheduler, the 8 children of the wide nodes of the bottom-level BVHs and the triangles of
+//   their leaves are tested 8 at a time with AVX2.
+//   Run from the repository root: ./7_path_tracing_cpu [--samples <samples>] [--compare <gpu.pfm>]
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <minilog.hpp>
+#include <hdr_image_writer.hpp>
+
+#include <bvh_builder.hpp>
+
+#define TINYOBJLOADER_IMPLEMENTATION // tiny_obj_loader.h is included by scene.hpp
+#include "scene.hpp"
+#include "work_stealing.hpp"
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+constexpr std::uint32_t TILE_SIZE { 16u }; // pixels, a task of the scheduler
+constexpr std::uint32_t PACKET_WIDTH { 8u }; // triangles of a TrianglePacket, the lanes of an AVX2 register
+// The constants of shaders/path_tracing.glsl
+constexpr std::uint32_t BVH_PRIMITIVE_MASK { 0x7fffffffu };
+constexpr float NO_HIT { 1e30f };
+constexpr float PI { 3.14159265358979323846264338327950288f };
+constexpr float INV_PI { 0.318309886183790671537767526745028724f };
+// Largest mean luminance difference, relative to the GPU image, --compare accepts
+constexpr double COMPARE_TOLERANCE { 0.02 };
+
+
+struct Options {
+    std::uint32_t width { 1920u };
+    std::uint32_t height { 1080u };
+    std::uint32_t spp { 1u }; // samples per pixel and pass, the --spp of the GPU run to compare with
+    std::uint32_t depth { 10u }; // bounces per path
+    std::uint32_t samples { 16u };
+    std::uint32_t threads { 0u }; // 0: std::thread::hardware_concurrency()
+    std::string output { "output_image_cpu.pfm" }; // *.png, or *.pfm / *.exr for the unclamped radiance
+    std::string compare {}; // a *.pfm of 7_path_tracing --headless, rendered with the same options
+    std::uint32_t bvh_width { bvh::WIDE_NODE_CHILDREN }; // children per node of the bottom-level BVHs, 2 to 8
+};
+
+
+// Owen-scrambled Sobol sampler, the Sampler of shaders/path_tracing.glsl draw for draw
+struct Sampler {
+    std::uint32_t pixel_seed;
+    std::uint32_t sample_number;
+    std::uint32_t dimension;
+};
+
+std::uint32_t bitfield_reverse(std::uint32_t x) {
+    x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+    x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+    x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+    x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+    return (x >> 16u) | (x << 16u);
+}
+
+std::uint32_t hash_uint(std::uint32_t x) {
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+std::uint32_t hash_combine(std::uint32_t seed, std::uint32_t v) { return seed ^ (v + 0x9e3779b9u + (seed << 6u) + (seed >> 2u)); }
+
+std::uint32_t laine_karras_permutation(std::uint32_t x, std::uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+std::uint32_t nested_uniform_scramble(std::uint32_t x, std::uint32_t seed) {
+    return bitfield_reverse(laine_karras_permutation(bitfield_reverse(x), seed));
+}
+
+std::uint32_t sobol_dimension_1(std::uint32_t index) {
+    std::uint32_t x { 0u };
+    for (std::uint32_t v { 0x80000000u }; index != 0u; index >>= 1u, v ^= v >> 1u) {
+        if ((index & 1u) != 0u) { x ^= v; }
+    }
+    return x;
+}
+
+float to_unit_float(std::uint32_t x) { return static_cast<float>(x >> 8u) * (1.0f / static_cast<float>(0x01000000u)); }
+
+Sampler make_sampler(std::uint32_t pixel, std::uint32_t sampleNumber) { return Sampler { hash_uint(pixel), sampleNumber, 0u }; }
+
+glm::vec2 sample_2d(Sampler& rng) {
+    const std::uint32_t seed = hash_combine(rng.pixel_seed, rng.dimension++);
+    const std::uint32_t index = nested_uniform_scramble(rng.sample_number, seed);
+    const std::uint32_t x = nested_uniform_scramble(bitfield_reverse(index), hash_combine(seed, 0u));
+    const std::uint32_t y = nested_uniform_scramble(sobol_dimension_1(index), hash_combine(seed, 1u));
+    return glm::vec2(to_unit_float(x), to_unit_float(y));
+}
+
+float sample_1d(Sampler& rng) {
+    const std::uint32_t seed = hash_combine(rng.pixel_seed, rng.dimension++);
+    const std::uint32_t index = nested_uniform_scramble(rng.sample_number, seed);
+    return to_unit_float(nested_uniform_scramble(bitfield_reverse(index), hash_combine(seed, 0u)));
+}
+
+
+struct Onb {
+    glm::vec3 tangent;
+    glm::vec3 binormal;
+    glm::vec3 normal;
+};
+
+Onb make_onb(const glm::vec3& normal) {
+    const float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+    const float a = -1.0f / (sign + normal.z);
+    const float b = a * normal.x * normal.y;
+
+    return Onb {
+        .tangent = glm::vec3(1.0f + sign * a * normal.x * normal.x, sign * b, -sign * normal.x),
+        .binormal = glm::vec3(b, sign + a * normal.y * normal.y, -normal.y),
+        .normal = normal
+    };
+}
+
+glm::vec3 to_world(const Onb& onb, const glm::vec3& v) { return v.x * onb.tangent + v.y * onb.binormal + v.z * onb.normal; }
+
+glm::vec3 cosine_sample_hemisphere(const glm::vec2& u) {
+    const float r = std::sqrt(u.x);
+    const float phi = 2.0f * PI * u.y;
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), std::sqrt(1.0f - u.x));
+}
+
+float balanced_heuristic(float pdfA, float pdfB) { return pdfA / std::max(pdfA + pdfB, 1e-4f); }
+
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float t_max;
+};
+
+Ray make_ray(const glm::vec3& origin, const glm::vec3& direction, float tMax) { return Ray { origin, glm::normalize(direction), tMax }; }
+
+// Moves p off the surface by a few ulps along n, far from the origin, by a fixed distance near it
+glm::vec3 offset_ray_origin(const glm::vec3& p, const glm::vec3& n) {
+    constexpr float origin { 1.0f / 32.0f };
+    constexpr float float_scale { 1.0f / 65536.0f };
+    constexpr float int_scale { 256.0f };
+
+    glm::vec3 p_final;
+    for (glm::length_t axis { 0 }; axis < 3; ++axis) {
+        const std::int32_t of_i = static_cast<std::int32_t>(int_scale * n[axis]);
+        const float p_i = std::bit_cast<float>(std::bit_cast<std::int32_t>(p[axis]) + (p[axis] < 0.0f ? -of_i : of_i));
+        p_final[axis] = std::abs(p[axis]) < origin ? p[axis] + float_scale * n[axis] : p_i;
+    }
+
+    return p_final;
+}
+
+Ray generate_ray(const scene::CameraUniform& camera, const glm::uvec2& resolution, const glm::vec2& p) {
+    const float tan_half_fov = std::tan(0.5f * glm::radians(camera.position.w));
+    const float aspect_ratio = static_cast<float>(resolution.x) / static_cast<float>(resolution.y);
+    const glm::vec3 wi_local(p.x * tan_half_fov * aspect_ratio, p.y * tan_half_fov, -1.0f);
+    const glm::vec3 wi_world = glm::normalize(
+        wi_local.x * glm::vec3(camera.right) + wi_local.y * glm::vec3(camera.up) - wi_local.z * glm::vec3(camera.front)
+    );
+
+    return make_ray(glm::vec3(camera.position), wi_world, 100000.0f);
+}
+
+glm::vec3 safe_inverse(const glm::vec3& direction) {
+    return 1.0f / glm::mix(direction, glm::vec3(1e-20f), glm::lessThan(glm::abs(direction), glm::vec3(1e-20f)));
+}
+
+// Slab test, returns the entry distance or NO_HIT
+float hit_aabb(const glm::vec3& aabbMin, const glm::vec3& aabbMax, const glm::vec3& origin, const glm::vec3& invDirection, float tMax) {
+    const glm::vec3 t0 = (aabbMin - origin) * invDirection;
+    const glm::vec3 t1 = (aabbMax - origin) * invDirection;
+    const glm::vec3 t_near = glm::min(t0, t1);
+    const glm::vec3 t_far = glm::max(t0, t1);
+    const float t_enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+    const float t_exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, tMax));
+
+    return t_enter <= t_exit ? t_enter : NO_HIT;
+}
+
+float hit_aabb(const bvh::Node& node, const glm::vec3& origin, const glm::vec3& invDirection, float tMax) {
+    return hit_aabb(node.aabb_min, node.aabb_max, origin, invDirection, tMax);
+}
+
+// The interior children before slot (x), and the primitives of the leaf children before it (y)
+glm::uvec2 wide_child_offsets(const bvh::WideNode& node, std::uint32_t slot) {
+    glm::uvec2 offsets(0u);
+    for (std::uint32_t i { 0u }; i < slot; ++i) {
+        const std::uint32_t meta = node.child_meta(i);
+        if (meta == bvh::WIDE_CHILD_INTERIOR) {
+            ++offsets.x;
+        } else {
+            offsets.y += meta;
+        }
+    }
+
+    return offsets;
+}
+
+using WideHits = std::array<std::uint32_t, bvh::WIDE_NODE_CHILDREN>; // slots, nearest first
+
+// Slab test of the children of the node in slots (a bit per slot) at once, the bytes of the
+//   quantized bounds widened to a lane per child. Writes the slots that are hit nearest
+//   first and returns their count.
+std::uint32_t hit_wide_children(
+    const bvh::WideNode& node, std::uint32_t slots, const glm::vec3& origin, const glm::vec3& invDirection, float tMax,
+    WideHits& hits
+) {
+    alignas(32) float distances[bvh::WIDE_NODE_CHILDREN];
+    std::uint32_t hit_mask { 0u };
+#if defined(__AVX2__)
+    const glm::vec3 scale = node.scale();
+    __m256 t_enter = _mm256_setzero_ps();
+    __m256 t_exit = _mm256_set1_ps(tMax);
+    for (glm::length_t axis { 0 }; axis < 3; ++axis) {
+        // Slots 0 to 7 are the bytes of two consecutive words
+        const __m256 q_lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&node.bounds[2 * axis]))
+        ));
+        const __m256 q_hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&node.bounds[6 + 2 * axis]))
+        ));
+        const __m256 node_origin = _mm256_set1_ps(node.origin[axis]);
+        const __m256 axis_scale = _mm256_set1_ps(scale[axis]);
+        const __m256 ray_origin = _mm256_set1_ps(origin[axis]);
+        const __m256 inv_direction = _mm256_set1_ps(invDirection[axis]);
+        // origin + q * scale as WideNode::child_bounds() computes it, then as hit_aabb()
+        const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(node_origin, _mm256_mul_ps(q_lo, axis_scale)), ray_origin), inv_direction);
+        const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(node_origin, _mm256_mul_ps(q_hi, axis_scale)), ray_origin), inv_direction);
+        t_enter = _mm256_max_ps(t_enter, _mm256_min_ps(t0, t1));
+        t_exit = _mm256_min_ps(t_exit, _mm256_max_ps(t0, t1));
+    }
+    const __m256i meta = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(node.meta)));
+    const __m256 occupied = _mm256_castsi256_ps(_mm256_cmpgt_epi32(meta, _mm256_setzero_si256()));
+    _mm256_store_ps(distances, t_enter);
+    hit_mask = static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_and_ps(occupied, _mm256_cmp_ps(t_enter, t_exit, _CMP_LE_OQ))));
+    hit_mask &= slots;
+#else
+    for (std::uint32_t slot { 0u }; slot < bvh::WIDE_NODE_CHILDREN; ++slot) {
+        if (((slots >> slot) & 1u) == 0u || node.child_meta(slot) == bvh::WIDE_CHILD_EMPTY) { continue; }
+        const bvh::Aabb child = node.child_bounds(slot);
+        distances[slot] = hit_aabb(child.min, child.max, origin, invDirection, tMax);
+        if (distances[slot] != NO_HIT) { hit_mask |= 1u << slot; }
+    }
+#endif
+
+    std::uint32_t hit_count { 0u };
+    for (; hit_mask != 0u; hit_mask &= hit_mask - 1u) {
+        const std::uint32_t slot = static_cast<std::uint32_t>(std::countr_zero(hit_mask));
+        std::uint32_t i = hit_count++;
+        for (; i > 0u && distances[hits[i - 1u]] > distances[slot]; --i) { hits[i] = hits[i - 1u]; }
+        hits[i] = slot;
+    }
+
+    return hit_count;
+}
+
+// The slots of hits from first on, as a bit per slot
+std::uint32_t remaining_wide_children(const WideHits& hits, std::uint32_t first, std::uint32_t hitCount) {
+    std::uint32_t slots { 0u };
+    for (std::uint32_t i { first }; i < hitCount; ++i) { slots |= 1u << hits[i]; }
+
+    return slots;
+}
+
+
+// The triangles of a BVH leaf, PACKET_WIDTH at a time in structure-of-arrays layout: one
+//   AVX2 register per coordinate of v0, e1 and e2 of the scene::PackedTriangle
+struct alignas(32) TrianglePacket {
+    float v0[3][PACKET_WIDTH];
+    float e1[3][PACKET_WIDTH];
+    float e2[3][PACKET_WIDTH];
+    std::uint32_t primitive[PACKET_WIDTH]; // into Scene::packed_triangles, ~0u for unused lanes
+    std::uint32_t lane_mask[PACKET_WIDTH]; // ~0u for the lanes with a triangle
+    std::uint32_t occluder_mask[PACKET_WIDTH]; // ~0u for the lanes shadow rays test, not emissive
+};
+
+
+struct SurfaceHitRecord {
+    std::uint32_t inst { ~0u };
+    std::uint32_t prim { ~0u };
+    glm::vec2 bary { -1.0f };
+    float time { 0.0f };
+};
+
+
+struct LightSample {
+    glm::vec3 position;
+    glm::vec3 normal; // the side the triangle emits to
+    glm::vec3 emission;
+    float pdf_area; // 0 without lights
+};
+
+
+// The scene of 7_path_tracing as the shaders read it, traced on the CPU. Leaf children of the
+//   bottom-level BVHs get a range of packets, the rest is traversed as path_tracing.glsl does.
+class ReferenceTracer {
+public:
+    explicit ReferenceTracer(const scene::Scene& tracedScene)
+        : model { tracedScene }
+        , lights { scene::build_light_table(tracedScene) }
+        , leaf_packets(tracedScene.bvh_primitives.size(), 0u)
+    {
+        for (const bvh::WideNode& node : model.bvh_nodes) {
+            std::uint32_t leaf = node.primitive_base;
+            for (std::uint32_t slot { 0u }; slot < bvh::WIDE_NODE_CHILDREN; ++slot) {
+                const std::uint32_t count = node.child_meta(slot);
+                if (count == bvh::WIDE_CHILD_EMPTY || count == bvh::WIDE_CHILD_INTERIOR) { continue; }
+                add_leaf_packets(leaf, count);
+                leaf += count;
+            }
+        }
+
+        minilog::log_debug(
+            "{} triangle packets over {} triangles, {:.2f} triangles per packet",
+            packets.size(), model.packed_triangles.size(),
+            static_cast<double>(model.packed_triangles.size()) / static_cast<double>(std::max(packets.size(), 1uz))
+        );
+    }
+
+    // One pixel of a dispatch of the megakernel: the mean of spp paths, rays counted as the shader does
+    glm::vec3 render_pixel(
+        const scene::CameraUniform& camera, const glm::uvec2& resolution, const glm::uvec2& coord,
+        std::uint32_t firstSample, std::uint32_t spp, std::uint32_t maxDepth, std::uint64_t& rayCount
+    ) const {
+        const std::uint32_t index = coord.x + coord.y * resolution.x;
+        glm::vec3 radiance(0.0f);
+        for (std::uint32_t i { 0u }; i < spp; ++i) {
+            Sampler rng = make_sampler(index, firstSample + i);
+            const glm::vec2 jitter = sample_2d(rng);
+            const glm::vec2 pixel_coord(
+                (static_cast<float>(coord.x) + jitter.x) / static_cast<float>(resolution.x) * 2.0f - 1.0f,
+                1.0f - (static_cast<float>(coord.y) + jitter.y) / static_cast<float>(resolution.y) * 2.0f
+            );
+            Ray ray = generate_ray(camera, resolution, pixel_coord);
+            glm::vec3 beta(1.0f);
+            float pdf_bsdf { 0.0f };
+            for (std::uint32_t depth { 0u }; depth < maxDepth; ++depth) {
+                const SurfaceHitRecord hit_record = hit_scene(ray);
+                ++rayCount;
+                if (hit_record.prim == ~0u) { break; }
+                const glm::vec3 p = triangle_point(hit_record.inst, hit_record.prim, hit_record.bary);
+                const glm::vec3 n = geometric_normal(hit_record.inst, hit_record.prim);
+                const float cos_wo = glm::dot(-ray.direction, n);
+                if (cos_wo < 1e-4f) { break; }
+
+                const scene::Material& material = material_of(hit_record.prim);
+                if (material.emissive()) {
+                    const glm::vec3 emission(material.emission);
+                    if (depth == 0u) {
+                        radiance += emission;
+                    } else {
+                        const float distance = glm::length(p - ray.origin);
+                        const float pdf_light = distance * distance * light_pdf_area(hit_record.prim) / cos_wo;
+                        radiance += balanced_heuristic(pdf_bsdf, pdf_light) * beta * emission;
+                    }
+                    break;
+                }
+
+                const glm::vec3 pp = offset_ray_origin(p, n);
+                const glm::vec3 albedo(material.albedo);
+                const LightSample light = sample_light(rng);
+                const glm::vec3 pp_light = offset_ray_origin(light.position, light.normal);
+                const float d_light = glm::distance(pp, pp_light);
+                const glm::vec3 wi_light = glm::normalize(pp_light - pp);
+                const bool occluded = intersect_any(make_ray(offset_ray_origin(pp, n), wi_light, d_light));
+                ++rayCount;
+                const float cos_wi_light = glm::dot(wi_light, n);
+                const float cos_light = -glm::dot(light.normal, wi_light);
+                if (!occluded && cos_wi_light > 1e-4f && cos_light > 1e-4f && light.pdf_area > 0.0f) {
+                    const float pdf_light = d_light * d_light * light.pdf_area / cos_light;
+                    const float mis_weight = balanced_heuristic(pdf_light, cos_wi_light * INV_PI);
+                    const glm::vec3 bsdf = albedo * INV_PI * cos_wi_light;
+                    radiance += beta * bsdf * mis_weight * light.emission / std::max(pdf_light, 1e-4f);
+                }
+
+                const glm::vec3 wi_local = cosine_sample_hemisphere(sample_2d(rng));
+                ray = make_ray(pp, to_world(make_onb(n), wi_local), 100000.0f);
+                pdf_bsdf = std::abs(wi_local.z) * INV_PI;
+                beta *= albedo;
+
+                const float l = scene::luminance(beta);
+                if (l == 0.0f) { break; }
+                const float q = std::max(l, 0.05f);
+                if (sample_1d(rng) >= q) { break; }
+                beta *= 1.0f / q;
+            }
+        }
+
+        return radiance / static_cast<float>(spp);
+    }
+
+private:
+    const scene::Material& material_of(std::uint32_t prim) const { return model.materials[model.indices[prim].material]; }
+
+    float light_pdf_area(std::uint32_t prim) const {
+        return scene::luminance(glm::vec3(material_of(prim).emission)) / lights.header.light_power;
+    }
+
+    glm::vec3 triangle_point(std::uint32_t inst, std::uint32_t prim, const glm::vec2& bary) const {
+        const scene::PackedTriangle& triangle = model.packed_triangles[prim];
+        return model.instances[inst].to_world(
+            glm::vec4(glm::vec3(triangle.v0 + bary.x * triangle.e1 + bary.y * triangle.e2), 1.0f)
+        );
+    }
+
+    // Normals transform with the inverse transpose, the rows of world_to_object are its columns
+    glm::vec3 geometric_normal(std::uint32_t inst, std::uint32_t prim) const {
+        const glm::vec3 n(model.packed_triangles[prim].normal);
+        const scene::Instance& instance = model.instances[inst];
+        return glm::normalize(
+            n.x * glm::vec3(instance.world_to_object[0])
+            + n.y * glm::vec3(instance.world_to_object[1])
+            + n.z * glm::vec3(instance.world_to_object[2])
+        );
+    }
+
+    // The direction is not normalized, so a distance along the ray is the same in both spaces
+    Ray world_to_object_ray(std::uint32_t inst, const Ray& ray) const {
+        const scene::Instance& instance = model.instances[inst];
+        return Ray {
+            instance.to_object(glm::vec4(ray.origin, 1.0f)),
+            instance.to_object(glm::vec4(ray.direction, 0.0f)),
+            ray.t_max
+        };
+    }
+
+    LightSample sample_light(Sampler& rng) const {
+        const float u_select = sample_1d(rng);
+        const glm::vec2 u_point = sample_2d(rng);
+        const std::uint32_t light_count = lights.header.light_count;
+        if (light_count == 0u) { return LightSample { glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f), 0.0f }; }
+
+        const float scaled = u_select * static_cast<float>(light_count);
+        const std::uint32_t bucket = std::min(static_cast<std::uint32_t>(scaled), light_count - 1u);
+        const scene::LightAlias& entry = scaled - static_cast<float>(bucket) < lights.aliases[bucket].probability
+            ? lights.aliases[bucket]
+            : lights.aliases[lights.aliases[bucket].alias];
+        const float r = std::sqrt(u_point.x);
+        const glm::vec2 bary(r * (1.0f - u_point.y), r * u_point.y);
+
+        return LightSample {
+            triangle_point(entry.instance, entry.triangle, bary),
+            geometric_normal(entry.instance, entry.triangle),
+            glm::vec3(material_of(entry.triangle).emission),
+            light_pdf_area(entry.triangle)
+        };
+    }
+
+    // Closest hit in [0, t_max] among the lanes of a packet, PACKET_WIDTH for none. Ties go
+    //   to the lower lane, as the shader keeps the first of equally distant triangles.
+    static std::uint32_t hit_packet(const TrianglePacket& packet, const Ray& ray, float& t, glm::vec2& bary) {
+#if defined(__AVX2__)
+        const __m256 dx = _mm256_set1_ps(ray.direction.x);
+        const __m256 dy = _mm256_set1_ps(ray.direction.y);
+        const __m256 dz = _mm256_set1_ps(ray.direction.z);
+        const __m256 e1x = _mm256_load_ps(packet.e1[0]);
+        const __m256 e1y = _mm256_load_ps(packet.e1[1]);
+        const __m256 e1z = _mm256_load_ps(packet.e1[2]);
+        const __m256 e2x = _mm256_load_ps(packet.e2[0]);
+        const __m256 e2y = _mm256_load_ps(packet.e2[1]);
+        const __m256 e2z = _mm256_load_ps(packet.e2[2]);
+        // P = cross(d, E2), T = o - A, Q = cross(T, E1)
+        const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+        const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+        const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+        const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+        const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+        const __m256 tx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(packet.v0[0]));
+        const __m256 ty = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(packet.v0[1]));
+        const __m256 tz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(packet.v0[2]));
+        const __m256 u = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det
+        );
+        const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+        const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+        const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+        const __m256 v = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det
+        );
+        const __m256 lane_t = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det
+        );
+
+        // Ordered comparisons, NaNs of degenerate triangles fail them
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        __m256 mask = _mm256_castsi256_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(packet.lane_mask)));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(lane_t, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(lane_t, _mm256_set1_ps(ray.t_max), _CMP_LE_OQ));
+        std::uint32_t hits = static_cast<std::uint32_t>(_mm256_movemask_ps(mask));
+        if (hits == 0u) { return PACKET_WIDTH; }
+
+        alignas(32) float ts[PACKET_WIDTH];
+        alignas(32) float us[PACKET_WIDTH];
+        alignas(32) float vs[PACKET_WIDTH];
+        _mm256_store_ps(ts, lane_t);
+        _mm256_store_ps(us, u);
+        _mm256_store_ps(vs, v);
+        std::uint32_t closest { PACKET_WIDTH };
+        for (; hits != 0u; hits &= hits - 1u) {
+            const std::uint32_t lane = static_cast<std::uint32_t>(std::countr_zero(hits));
+            if (closest == PACKET_WIDTH || ts[lane] < ts[closest]) { closest = lane; }
+        }
+        t = ts[closest];
+        bary = glm::vec2(us[closest], vs[closest]);
+
+        return closest;
+#else
+        std::uint32_t closest { PACKET_WIDTH };
+        for (std::uint32_t lane { 0u }; lane < PACKET_WIDTH; ++lane) {
+            if (packet.lane_mask[lane] == 0u) { continue; }
+            float lane_t { 0.0f };
+            glm::vec2 lane_bary;
+            if (!hit_lane(packet, lane, ray, lane_t, lane_bary)) { continue; }
+            if (lane_t < 0.0f || lane_t > ray.t_max) { continue; }
+            if (closest == PACKET_WIDTH || lane_t < t) {
+                closest = lane;
+                t = lane_t;
+                bary = lane_bary;
+            }
+        }
+
+        return closest;
+#endif
+    }
+
+    // Whether a triangle the shadow rays test crosses the segment (0, t_max)
+    static bool hit_packet_any(const TrianglePacket& packet, const Ray& ray) {
+#if defined(__AVX2__)
+        const __m256 dx = _mm256_set1_ps(ray.direction.x);
+        const __m256 dy = _mm256_set1_ps(ray.direction.y);
+        const __m256 dz = _mm256_set1_ps(ray.direction.z);
+        const __m256 e1x = _mm256_load_ps(packet.e1[0]);
+        const __m256 e1y = _mm256_load_ps(packet.e1[1]);
+        const __m256 e1z = _mm256_load_ps(packet.e1[2]);
+        const __m256 e2x = _mm256_load_ps(packet.e2[0]);
+        const __m256 e2y = _mm256_load_ps(packet.e2[1]);
+        const __m256 e2z = _mm256_load_ps(packet.e2[2]);
+        const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+        const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+        const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+        const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+        const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+        const __m256 tx = _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(packet.v0[0]));
+        const __m256 ty = _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(packet.v0[1]));
+        const __m256 tz = _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(packet.v0[2]));
+        const __m256 u = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det
+        );
+        const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+        const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+        const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+        const __m256 v = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det
+        );
+        const __m256 lane_t = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det
+        );
+
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 mask = _mm256_castsi256_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(packet.occluder_mask)));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(lane_t, zero, _CMP_GT_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(lane_t, _mm256_set1_ps(ray.t_max), _CMP_LT_OQ));
+
+        return _mm256_movemask_ps(mask) != 0;
+#else
+        for (std::uint32_t lane { 0u }; lane < PACKET_WIDTH; ++lane) {
+            if (packet.occluder_mask[lane] == 0u) { continue; }
+            float lane_t { 0.0f };
+            glm::vec2 lane_bary;
+            if (hit_lane(packet, lane, ray, lane_t, lane_bary) && lane_t > 0.0f && lane_t < ray.t_max) { return true; }
+        }
+
+        return false;
+#endif
+    }
+
+#if !defined(__AVX2__)
+    // Moller-Trumbore on a lane, the barycentrics within the triangle but neither bound of t checked
+    static bool hit_lane(const TrianglePacket& packet, std::uint32_t lane, const Ray& ray, float& t, glm::vec2& bary) {
+        const glm::vec3 a(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+        const glm::vec3 e1(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]);
+        const glm::vec3 e2(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]);
+        const glm::vec3 p = glm::cross(ray.direction, e2);
+        const float inv_det = 1.0f / glm::dot(e1, p);
+        const glm::vec3 s = ray.origin - a;
+        const glm::vec3 q = glm::cross(s, e1);
+        bary = glm::vec2(glm::dot(s, p) * inv_det, glm::dot(ray.direction, q) * inv_det);
+        t = glm::dot(e2, q) * inv_det;
+
+        return bary.x >= 0.0f && bary.y >= 0.0f && bary.x + bary.y <= 1.0f;
+    }
+#endif
+
+    static std::uint32_t packet_count(std::uint32_t triangleCount) { return (triangleCount + PACKET_WIDTH - 1u) / PACKET_WIDTH; }
+
+    // The packets of the leaf child of count entries of bvh_primitives from leaf
+    void add_leaf_packets(std::uint32_t leaf, std::uint32_t count) {
+        leaf_packets[leaf] = static_cast<std::uint32_t>(packets.size());
+        for (std::uint32_t first { 0u }; first < count; first += PACKET_WIDTH) {
+            TrianglePacket packet {};
+            for (std::uint32_t lane { 0u }; lane < PACKET_WIDTH; ++lane) {
+                packet.primitive[lane] = ~0u;
+                if (first + lane >= count) { continue; }
+                const std::uint32_t entry = model.bvh_primitives[leaf + first + lane];
+                const std::uint32_t prim = entry & BVH_PRIMITIVE_MASK;
+                const scene::PackedTriangle& triangle = model.packed_triangles[prim];
+                for (glm::length_t axis { 0 }; axis < 3; ++axis) {
+                    packet.v0[axis][lane] = triangle.v0[axis];
+                    packet.e1[axis][lane] = triangle.e1[axis];
+                    packet.e2[axis][lane] = triangle.e2[axis];
+                }
+                packet.primitive[lane] = prim;
+                packet.lane_mask[lane] = ~0u;
+                packet.occluder_mask[lane] = (entry & scene::BVH_EMISSIVE_PRIMITIVE_BIT) != 0u ? 0u : ~0u;
+            }
+            packets.push_back(packet);
+        }
+    }
+
+    // Closest hit in the bottom-level BVH of an instance, for a ray in its object space whose
+    //   t_max is the closest hit so far. Replaces hitRecord when it finds a closer one.
+    //   The leaf children of a node are tested nearest first up to its nearest interior child,
+    //   which is visited next; the other children are pushed as one entry and tested again
+    //   against the closer t_max when it is popped.
+    void hit_blas(Ray ray, std::uint32_t inst, SurfaceHitRecord& hitRecord) const {
+        const glm::vec3 inv_direction = safe_inverse(ray.direction);
+
+        std::array<glm::uvec2, scene::WIDE_BVH_STACK_SIZE> stack; // node, slots left
+        std::uint32_t stack_size { 0u };
+        std::uint32_t node_index = model.instances[inst].blas_root;
+        std::uint32_t slots { 0xffu };
+        while (true) {
+            const bvh::WideNode& node = model.bvh_nodes[node_index];
+            WideHits hits;
+            const std::uint32_t hit_count = hit_wide_children(node, slots, ray.origin, inv_direction, ray.t_max, hits);
+            bool descend { false };
+            for (std::uint32_t i { 0u }; i < hit_count; ++i) {
+                const std::uint32_t meta = node.child_meta(hits[i]);
+                const glm::uvec2 offsets = wide_child_offsets(node, hits[i]);
+                if (meta == bvh::WIDE_CHILD_INTERIOR) {
+                    const std::uint32_t remaining = remaining_wide_children(hits, i + 1u, hit_count);
+                    if (remaining != 0u && stack_size < scene::WIDE_BVH_STACK_SIZE) { stack[stack_size++] = glm::uvec2(node_index, remaining); }
+                    node_index = node.child_base + offsets.x;
+                    slots = 0xffu;
+                    descend = true;
+                    break;
+                }
+
+                const std::uint32_t first = leaf_packets[node.primitive_base + offsets.y];
+                for (std::uint32_t packet { first }; packet < first + packet_count(meta); ++packet) {
+                    float t { 0.0f };
+                    glm::vec2 bary;
+                    const std::uint32_t lane = hit_packet(packets[packet], ray, t, bary);
+                    if (lane != PACKET_WIDTH && (hitRecord.prim == ~0u || t < hitRecord.time)) {
+                        hitRecord = SurfaceHitRecord { .inst = inst, .prim = packets[packet].primitive[lane], .bary = bary, .time = t };
+                        ray.t_max = t;
+                    }
+                }
+            }
+            if (descend) { continue; }
+
+            if (stack_size == 0u) { break; }
+            --stack_size;
+            node_index = stack[stack_size].x;
+            slots = stack[stack_size].y;
+        }
+    }
+
+    SurfaceHitRecord hit_scene(Ray ray) const {
+        SurfaceHitRecord hit_record { .time = ray.t_max };
+        const glm::vec3 inv_direction = safe_inverse(ray.direction);
+        if (hit_aabb(model.tlas_nodes[0uz], ray.origin, inv_direction, ray.t_max) == NO_HIT) { return hit_record; }
+
+        std::array<std::uint32_t, scene::BVH_STACK_SIZE> stack;
+        std::uint32_t stack_size { 0u };
+        std::uint32_t node_index { 0u };
+        while (true) {
+            const bvh::Node& node = model.tlas_nodes[node_index];
+            if (node.count > 0u) {
+                for (std::uint32_t i { 0u }; i < node.count; ++i) {
+                    const std::uint32_t inst = model.tlas_instances[node.offset + i];
+                    hit_blas(world_to_object_ray(inst, ray), inst, hit_record);
+                    ray.t_max = hit_record.time;
+                }
+            } else {
+                std::uint32_t near_index = node_index + 1u;
+                std::uint32_t far_index = node.offset;
+                float t_near = hit_aabb(model.tlas_nodes[near_index], ray.origin, inv_direction, ray.t_max);
+                float t_far = hit_aabb(model.tlas_nodes[far_index], ray.origin, inv_direction, ray.t_max);
+                if (t_far < t_near) {
+                    std::swap(near_index, far_index);
+                    std::swap(t_near, t_far);
+                }
+                if (t_near != NO_HIT) {
+                    if (t_far != NO_HIT && stack_size < scene::BVH_STACK_SIZE) { stack[stack_size++] = far_index; }
+                    node_index = near_index;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0u) { break; }
+            node_index = stack[--stack_size];
+        }
+
+        return hit_record;
+    }
+
+    // Occlusion query of a ray in the object space of the instance, t_max never shrinks so the
+    //   children left of a node are pushed as they are
+    bool blas_any(const Ray& ray, std::uint32_t inst) const {
+        const glm::vec3 inv_direction = safe_inverse(ray.direction);
+
+        std::array<glm::uvec2, scene::WIDE_BVH_STACK_SIZE> stack; // node, slots left
+        std::uint32_t stack_size { 0u };
+        std::uint32_t node_index = model.instances[inst].blas_root;
+        std::uint32_t slots { 0xffu };
+        while (true) {
+            const bvh::WideNode& node = model.bvh_nodes[node_index];
+            WideHits hits;
+            const std::uint32_t hit_count = hit_wide_children(node, slots, ray.origin, inv_direction, ray.t_max, hits);
+            bool descend { false };
+            for (std::uint32_t i { 0u }; i < hit_count; ++i) {
+                const std::uint32_t meta = node.child_meta(hits[i]);
+                const glm::uvec2 offsets = wide_child_offsets(node, hits[i]);
+                if (meta == bvh::WIDE_CHILD_INTERIOR) {
+                    const std::uint32_t remaining = remaining_wide_children(hits, i + 1u, hit_count);
+                    if (remaining != 0u && stack_size < scene::WIDE_BVH_STACK_SIZE) { stack[stack_size++] = glm::uvec2(node_index, remaining); }
+                    node_index = node.child_base + offsets.x;
+                    slots = 0xffu;
+                    descend = true;
+                    break;
+                }
+
+                const std::uint32_t first = leaf_packets[node.primitive_base + offsets.y];
+                for (std::uint32_t packet { first }; packet < first + packet_count(meta); ++packet) {
+                    if (hit_packet_any(packets[packet], ray)) { return true; }
+                }
+            }
+            if (descend) { continue; }
+
+            if (stack_size == 0u) { break; }
+            --stack_size;
+            node_index = stack[stack_size].x;
+            slots = stack[stack_size].y;
+        }
+
+        return false;
+    }
+
+    bool intersect_any(const Ray& ray) const {
+        const glm::vec3 inv_direction = safe_inverse(ray.direction);
+        if (hit_aabb(model.tlas_nodes[0uz], ray.origin, inv_direction, ray.t_max) == NO_HIT) { return false; }
+
+        std::array<std::uint32_t, scene::BVH_STACK_SIZE> stack;
+        std::uint32_t stack_size { 0u };
+        std::uint32_t node_index { 0u };
+        while (true) {
+            const bvh::Node& node = model.tlas_nodes[node_index];
+            if (node.count > 0u) {
+                for (std::uint32_t i { 0u }; i < node.count; ++i) {
+                    const std::uint32_t inst = model.tlas_instances[node.offset + i];
+                    if (blas_any(world_to_object_ray(inst, ray), inst)) { return true; }
+                }
+            } else {
+                const std::uint32_t left_index = node_index + 1u;
+                const std::uint32_t right_index = node.offset;
+                const bool hit_left = hit_aabb(model.tlas_nodes[left_index], ray.origin, inv_direction, ray.t_max) != NO_HIT;
+                const bool hit_right = hit_aabb(model.tlas_nodes[right_index], ray.origin, inv_direction, ray.t_max) != NO_HIT;
+                if (hit_left) {
+                    if (hit_right && stack_size < scene::BVH_STACK_SIZE) { stack[stack_size++] = right_index; }
+                    node_index = left_index;
+                    continue;
+                }
+                if (hit_right) {
+                    node_index = right_index;
+                    continue;
+                }
+            }
+
+            if (stack_size == 0u) { break; }
+            node_index = stack[--stack_size];
+        }
+
+        return false;
+    }
+
+    const scene::Scene& model;
+    scene::LightTable lights;
+    std::vector<TrianglePacket> packets;
+    std::vector<std::uint32_t> leaf_packets; // per entry of Scene::bvh_primitives that starts a leaf child: its first packet
+};
+
+
+// The PFM of hdr::write_pfm(): "PF", then the little endian rows bottom to top
+bool read_pfm(const std::string& fileName, std::vector<glm::vec4>& rgba, std::uint32_t& width, std::uint32_t& height) {
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.is_open()) { return false; }
+
+    std::string magic;
+    float scale { 0.0f };
+    file >> magic >> width >> height >> scale;
+    file.get(); // the single whitespace before the data
+    if (!file || magic != "PF" || scale >= 0.0f || width == 0u || height == 0u) { return false; }
+
+    rgba.assign(std::size_t { width } * height, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    std::vector<float> row(width * 3uz);
+    for (std::uint32_t y { height }; y-- > 0u;) {
+        file.read(reinterpret_cast<char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+        for (std::size_t x { 0uz }; x < width; ++x) {
+            rgba[std::size_t { y } * width + x] = glm::vec4(row[3uz * x + 0uz], row[3uz * x + 1uz], row[3uz * x + 2uz], 1.0f);
+        }
+    }
+
+    return file.good();
+}
+
+// Mean luminance of both images and the RMSE between them, relative to the mean of the GPU
+//   image. With the same --spp, --depth and --samples, and none of --adaptive, --restir,
+//   --radiance-cache, --guiding or --hybrid on the GPU, both draw the same sampler dimensions,
+//   so the images only drift apart where rounding sends a path another way.
+bool compare_images(const std::vector<glm::vec4>& colors, const std::string& fileName, std::uint32_t width, std::uint32_t height) {
+    std::vector<glm::vec4> reference;
+    std::uint32_t reference_width { 0u };
+    std::uint32_t reference_height { 0u };
+    if (!read_pfm(fileName, reference, reference_width, reference_height)) {
+        minilog::log_error("failed to read {}!", fileName);
+        return false;
+    }
+    if (reference_width != width || reference_height != height) {
+        minilog::log_error("{} is {}x{}, the CPU image {}x{}", fileName, reference_width, reference_height, width, height);
+        return false;
+    }
+
+    double cpu_mean { 0.0 };
+    double gpu_mean { 0.0 };
+    double squared_error { 0.0 };
+    for (std::size_t i { 0uz }; i < colors.size(); ++i) {
+        const double cpu = scene::luminance(glm::vec3(colors[i]));
+        const double gpu = scene::luminance(glm::vec3(reference[i]));
+        cpu_mean += cpu;
+        gpu_mean += gpu;
+        squared_error += (cpu - gpu) * (cpu - gpu);
+    }
+    const double pixel_count = static_cast<double>(colors.size());
+    cpu_mean /= pixel_count;
+    gpu_mean /= pixel_count;
+    const double relative_difference = (cpu_mean - gpu_mean) / std::max(gpu_mean, 1e-6);
+    const double relative_rmse = std::sqrt(squared_error / pixel_count) / std::max(gpu_mean, 1e-6);
+
+    const bool match = std::abs(relative_difference) <= COMPARE_TOLERANCE;
+    minilog::log_info(
+        "compare with {}: mean luminance CPU {:.5f}, GPU {:.5f} ({:+.3f}%), relative RMSE {:.4f}, {}",
+        fileName, cpu_mean, gpu_mean, 100.0 * relative_difference, relative_rmse, match ? "match" : "MISMATCH"
+    );
+
+    return match;
+}
+
+bool write_image(const std::string& fileName, const std::vector<glm::vec4>& colors, std::uint32_t width, std::uint32_t height) {
+    if (hdr::is_hdr_file(fileName)) { return hdr::write_hdr(fileName, &colors[0uz].x, width, height); }
+
+    std::vector<unsigned char> rgba8(colors.size() * 4uz);
+    for (std::size_t i { 0uz }; i < rgba8.size(); ++i) {
+        const float value = std::fmin(1.0f, std::fmax(0.0f, colors[i / 4uz][static_cast<glm::length_t>(i % 4uz)]));
+        rgba8[i] = static_cast<unsigned char>(std::nearbyint(value * 255.0f));
+    }
+
+    return stbi_write_png(fileName.c_str(), static_cast<int>(width), static_cast<int>(height), 4, rgba8.data(), static_cast<int>(width) * 4) == 1;
+}
+
+
+// std::nullopt, after the usage, on an unknown or invalid argument
+std::optional<Options> parse_options(int argc, char** argv) {
+    Options options {};
+    auto read_count = [&](int& i, std::uint32_t& value) {
+        if (i + 1 >= argc) { return false; }
+        const std::string_view text { argv[++i] };
+        std::uint32_t count { 0u };
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+        if (error != std::errc {} || end != text.data() + text.size() || count == 0u) { return false; }
+        value = count;
+        return true;
+    };
+
+    for (int i { 1 }; i < argc; ++i) {
+        const std::string argument { argv[i] };
+        bool valid { true };
+        if (argument == "--width") {
+            valid = read_count(i, options.width);
+        } else if (argument == "--height") {
+            valid = read_count(i, options.height);
+        } else if (argument == "--spp") {
+            valid = read_count(i, options.spp);
+        } else if (argument == "--depth") {
+            valid = read_count(i, options.depth);
+        } else if (argument == "--samples") {
+            valid = read_count(i, options.samples);
+        } else if (argument == "--threads") {
+            valid = read_count(i, options.threads);
+        } else if (argument == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (argument == "--compare" && i + 1 < argc) {
+            options.compare = argv[++i];
+        } else if (argument == "--bvh-width") {
+            valid = read_count(i, options.bvh_width) && options.bvh_width >= 2u && options.bvh_width <= bvh::WIDE_NODE_CHILDREN;
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            minilog::log_error("invalid argument: {}", argument);
+            minilog::log_info(
+                "usage: 7_path_tracing_cpu [--width <pixels>] [--height <pixels>] [--spp <samples>] [--depth <bounces>]"
+                " [--samples <samples>] [--threads <threads>] [--output <file.png|.pfm|.exr>] [--compare <gpu.pfm>]"
+                " [--bvh-width <2 to 8>]"
+            );
+            return std::nullopt;
+        }
+    }
+
+    return options;
+}
+
+
+int main(int argc, char** argv) {
+    const std::optional<Options> parsed_options = parse_options(argc, argv);
+    if (!parsed_options) { return EXIT_FAILURE; }
+    const Options& options = *parsed_options;
+
+    // Leaves of up to a packet, rather than the 4 triangles of the GPU BVH
+    scene::Scene model {};
+    try {
+        model = scene::load_scene(
+            bvh::BuildOptions { .max_leaf_size = PACKET_WIDTH },
+            bvh::CollapseOptions { .width = options.bvh_width, .max_leaf_size = PACKET_WIDTH }
+        );
+    } catch (const std::exception& e) {
+        minilog::log_fatal("{}", e.what());
+        return EXIT_FAILURE;
+    }
+    if (model.indices.empty()) {
+        minilog::log_error("no triangles in {}!", scene::OBJ_FILE);
+        return EXIT_FAILURE;
+    }
+    const ReferenceTracer tracer { model };
+    const scene::CameraUniform camera = scene::FlyCamera {}.uniform();
+
+    const glm::uvec2 resolution(options.width, options.height);
+    const glm::uvec2 tiles = (resolution + TILE_SIZE - 1u) / TILE_SIZE;
+    scheduling::WorkStealingScheduler scheduler {
+        options.threads > 0u ? options.threads : std::max(std::thread::hardware_concurrency(), 1u)
+    };
+    // A cache line per worker
+    struct alignas(64) WorkerCounter { std::uint64_t rays { 0u }; };
+    std::vector<WorkerCounter> ray_counters(scheduler.size());
+    std::vector<glm::vec4> pixel_colors(std::size_t { options.width } * options.height, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    // Passes of spp samples, as the dispatches of the GPU: the mean of a pass is clamped,
+    //   then blended into the pixel
+    const std::uint32_t pass_count = (options.samples + options.spp - 1u) / options.spp;
+    std::uint64_t steals { 0u };
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint32_t pass { 0u }; pass < pass_count; ++pass) {
+        scheduler.run(tiles.x * tiles.y, [&] (std::uint32_t worker, std::uint32_t tile) {
+            const glm::uvec2 tile_origin = glm::uvec2(tile % tiles.x, tile / tiles.x) * TILE_SIZE;
+            const glm::uvec2 tile_end = glm::min(tile_origin + TILE_SIZE, resolution);
+            std::uint64_t rays { 0u };
+            for (std::uint32_t y { tile_origin.y }; y < tile_end.y; ++y) {
+                for (std::uint32_t x { tile_origin.x }; x < tile_end.x; ++x) {
+                    glm::vec3 radiance = tracer.render_pixel(
+                        camera, resolution, glm::uvec2(x, y), pass * options.spp, options.spp, options.depth, rays
+                    );
+                    if (glm::any(glm::isnan(radiance))) { radiance = glm::vec3(0.0f); }
+                    glm::vec4& pixel = pixel_colors[x + std::size_t { y } * options.width];
+                    pixel = glm::vec4(
+                        glm::mix(glm::vec3(pixel), glm::clamp(radiance, 0.0f, 30.0f), 1.0f / static_cast<float>(pass + 1u)), 1.0f
+                    );
+                }
+            }
+            ray_counters[worker].rays += rays;
+        });
+        steals += scheduler.steal_count();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::uint64_t rays { 0u };
+    for (const WorkerCounter& counter : ray_counters) { rays += counter.rays; }
+    const std::uint32_t samples = pass_count * options.spp;
+    minilog::log_info(
+        "cpu: {} samples per pixel at {}x{} on {} threads in {:.3f} s, {:.2f} M rays/s, {:.2f} M rays/s per core, {} tiles stolen",
+        samples, options.width, options.height, scheduler.size(), seconds,
+        static_cast<double>(rays) / seconds / 1e6, static_cast<double>(rays) / seconds / 1e6 / scheduler.size(), steals
+    );
+#if !defined(__AVX2__)
+    minilog::log_warn("built without AVX2, the triangle packets and wide nodes are tested one lane at a time");
+#endif
+
+    if (write_image(options.output, pixel_colors, options.width, options.height)) {
+        minilog::log_info("write {} successful!", options.output);
+    } else {
+        minilog::log_error("failed to write {}!", options.output);
+    }
+
+    if (!options.compare.empty() && !compare_images(pixel_colors, options.compare, options.width, options.height)) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
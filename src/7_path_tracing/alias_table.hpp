@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace sampling {
+
+struct AliasBucket {
+    float probability { 1.0f }; // of keeping the bucket's own index rather than its alias
+    std::uint32_t alias { 0u };
+};
+
+
+// Vose's alias method: picks index i with probability weights[i] / sum(weights) from a
+//   uniform bucket and a single comparison. Weights must be >= 0 with a positive sum.
+inline std::vector<AliasBucket> build_alias_table(std::span<const double> weights) {
+    const std::size_t count = weights.size();
+    std::vector<AliasBucket> buckets(count);
+    if (count == 0uz) { return buckets; }
+
+    double sum { 0.0 };
+    for (double weight : weights) { sum += weight; }
+
+    // Weights scaled so that the mean is 1, under-full buckets get topped up by over-full ones
+    std::vector<double> scaled(count);
+    std::vector<std::uint32_t> small;
+    std::vector<std::uint32_t> large;
+    for (std::size_t i { 0uz }; i < count; ++i) {
+        scaled[i] = weights[i] * static_cast<double>(count) / sum;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<std::uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        const std::uint32_t s = small.back();
+        small.pop_back();
+        const std::uint32_t l = large.back();
+        buckets[s] = AliasBucket { .probability = static_cast<float>(scaled[s]), .alias = l };
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Left over by rounding, full up to it
+    for (std::uint32_t i : large) { buckets[i] = AliasBucket { .probability = 1.0f, .alias = i }; }
+    for (std::uint32_t i : small) { buckets[i] = AliasBucket { .probability = 1.0f, .alias = i }; }
+
+    return buckets;
+}
+
+} // namespace sampling end
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+namespace denoiser {
+
+// Matches the std430 layout of PixelAov in shaders/path_tracing.glsl (32 bytes)
+struct PixelAov {
+    glm::vec4 albedo;
+    glm::vec4 normal_depth;
+};
+static_assert(sizeof(PixelAov) == 32u, "denoiser::PixelAov must match the std430 layout");
+
+// The constants of shaders/denoise_atrous.comp
+constexpr float SIGMA_COLOR { 4.0f };
+constexpr float SIGMA_NORMAL { 0.3f };
+constexpr float SIGMA_ALBEDO { 0.1f };
+constexpr float SIGMA_DEPTH { 0.05f };
+constexpr float ALBEDO_EPSILON { 1e-3f };
+constexpr float KERNEL_WEIGHTS[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+
+inline float luminance(const glm::vec3& color) { return glm::dot(glm::vec3(0.212671f, 0.715160f, 0.072169f), color); }
+
+// Single-threaded reference of the denoise_atrous.comp passes, pass by pass in the same
+//   order and precision, for checking the GPU result of a headless render
+inline std::vector<glm::vec4> denoise_reference(
+    std::span<const glm::vec4> colors,
+    std::span<const PixelAov> aovs,
+    std::uint32_t width,
+    std::uint32_t height,
+    std::uint32_t iterationCount
+) {
+    auto demodulation = [&aovs] (std::size_t index) { return glm::max(glm::vec3(aovs[index].albedo), glm::vec3(ALBEDO_EPSILON)); };
+
+    std::vector<glm::vec3> input(colors.size());
+    for (std::size_t i { 0uz }; i < colors.size(); ++i) { input[i] = glm::vec3(colors[i]) / demodulation(i); }
+    std::vector<glm::vec3> output(colors.size());
+
+    for (std::uint32_t iteration { 0u }; iteration < iterationCount; ++iteration) {
+        const int step = 1 << iteration;
+        for (std::uint32_t y { 0u }; y < height; ++y) {
+            for (std::uint32_t x { 0u }; x < width; ++x) {
+                const std::size_t index = x + std::size_t { y } * width;
+                const glm::vec3 color = input[index];
+                const glm::vec3 albedo = glm::vec3(aovs[index].albedo);
+                const glm::vec4 normal_depth = aovs[index].normal_depth;
+                const float color_luminance = std::max(luminance(color), 1e-2f);
+                const float color_scale = SIGMA_COLOR * SIGMA_COLOR * color_luminance * color_luminance
+                    / static_cast<float>(1u << (2u * iteration));
+                const float depth_scale = SIGMA_DEPTH * std::max(normal_depth.w, 1e-3f);
+
+                glm::vec3 sum { 0.0f };
+                float weight_sum { 0.0f };
+                for (int dy { -2 }; dy <= 2; ++dy) {
+                    for (int dx { -2 }; dx <= 2; ++dx) {
+                        const int tap_x = static_cast<int>(x) + dx * step;
+                        const int tap_y = static_cast<int>(y) + dy * step;
+                        if (tap_x < 0 || tap_y < 0 || tap_x >= static_cast<int>(width) || tap_y >= static_cast<int>(height)) {
+                            continue;
+                        }
+                        const std::size_t tap_index = static_cast<std::size_t>(tap_x) + static_cast<std::size_t>(tap_y) * width;
+
+                        const glm::vec3 tap_color = input[tap_index];
+                        const glm::vec3 color_delta = tap_color - color;
+                        const glm::vec3 normal_delta = glm::vec3(aovs[tap_index].normal_depth) - glm::vec3(normal_depth);
+                        const glm::vec3 albedo_delta = glm::vec3(aovs[tap_index].albedo) - albedo;
+                        const float depth_delta = (aovs[tap_index].normal_depth.w - normal_depth.w) / depth_scale;
+                        const float weight = KERNEL_WEIGHTS[std::abs(dx)] * KERNEL_WEIGHTS[std::abs(dy)] * std::exp(
+                            -glm::dot(color_delta, color_delta) / color_scale
+                            - glm::dot(normal_delta, normal_delta) / (SIGMA_NORMAL * SIGMA_NORMAL)
+                            - glm::dot(albedo_delta, albedo_delta) / (SIGMA_ALBEDO * SIGMA_ALBEDO)
+                            - depth_delta * depth_delta
+                        );
+                        sum += weight * tap_color;
+                        weight_sum += weight;
+                    }
+                }
+                output[index] = sum / weight_sum;
+            }
+        }
+        std::swap(input, output);
+    }
+
+    std::vector<glm::vec4> result(colors.size());
+    for (std::size_t i { 0uz }; i < colors.size(); ++i) {
+        result[i] = glm::vec4(iterationCount > 0u ? input[i] * demodulation(i) : glm::vec3(colors[i]), 1.0f);
+    }
+
+    return result;
+}
+
+} // namespace denoiser end
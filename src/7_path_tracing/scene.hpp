@@ -0,0 +1,468 @@
+#pragma once
+
+#ifndef GLM_ENABLE_EXPERIMENTAL
+#define GLM_ENABLE_EXPERIMENTAL // glm/gtx/hash.hpp
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <tiny_obj_loader.h>
+
+#include <minilog.hpp>
+
+#include <bvh_builder.hpp>
+#include <thread_pool.hpp>
+
+#include "alias_table.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// The scene of 7_path_tracing as both renderers see it: the GPU one uploads these arrays as
+//   they are, the CPU reference of 7_path_tracing_cpu.cpp traces them directly
+namespace scene {
+
+const std::string OBJ_FILE { "./resource/cornell_box.obj" };
+const std::string MTL_DIRECTORY { "./resource/" };
+// Set on the entries of bvh_primitives that reference an emissive triangle, occlusion rays skip them
+constexpr std::uint32_t BVH_EMISSIVE_PRIMITIVE_BIT { 0x80000000u };
+// bvh_stack_size of shaders/path_tracing.glsl, for the binary top-level BVH
+constexpr std::uint32_t BVH_STACK_SIZE { 32u };
+// wide_bvh_stack_size of shaders/path_tracing.glsl, an entry holds the children left of a node
+constexpr std::uint32_t WIDE_BVH_STACK_SIZE { 16u };
+
+
+// std140 Camera of shaders/path_tracing.glsl
+struct CameraUniform {
+    glm::vec4 position; // w: vertical field of view in degrees
+    glm::vec4 front;
+    glm::vec4 up;
+    glm::vec4 right;
+};
+
+
+// WASD / Q E: move, arrow keys: look around, as the KeyboardMovementController of 4_object_viewer.
+//   Starts at the camera the compute shader used to have built in.
+struct FlyCamera {
+    glm::vec3 position { -0.01f, 0.995f, 5.0f };
+    float yaw { 0.0f }; // radians, 0 looks down -z
+    float pitch { 0.0f };
+    float fov { 27.8f }; // vertical, degrees
+
+    glm::vec3 front() const {
+        return glm::vec3(std::sin(yaw) * std::cos(pitch), std::sin(pitch), -std::cos(yaw) * std::cos(pitch));
+    }
+
+    CameraUniform uniform() const {
+        const glm::vec3 f = front();
+        const glm::vec3 right = glm::normalize(glm::cross(f, glm::vec3(0.0f, 1.0f, 0.0f)));
+        const glm::vec3 up = glm::cross(right, f);
+
+        return CameraUniform {
+            .position = glm::vec4(position, fov),
+            .front = glm::vec4(f, 0.0f),
+            .up = glm::vec4(up, 0.0f),
+            .right = glm::vec4(right, 0.0f)
+        };
+    }
+};
+
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 color;
+    glm::vec2 uv;
+
+    bool operator==(const Vertex& other) const {
+        return position == other.position
+            && color == other.color
+            && uv == other.uv;
+    }
+};
+
+} // namespace scene end
+
+namespace std {
+template<> struct hash<scene::Vertex> {
+    std::size_t operator()(const scene::Vertex& vertex) const {
+        auto x = hash<glm::vec3>()(vertex.position);
+        auto y = hash<glm::vec3>()(vertex.color) << 1;
+        auto z = hash<glm::vec2>()(vertex.uv) << 1;
+        return ((x ^ y) >> 1) ^ z;
+    }
+};
+} // namespace std end
+
+namespace scene {
+
+struct Triangle {
+    std::uint32_t t0;
+    std::uint32_t t1;
+    std::uint32_t t2;
+    std::uint32_t material { 0u }; // into Scene::materials
+};
+
+
+// std430 PackedTriangle of shaders/path_tracing.glsl, what the intersection test and the
+//   geometric normal need in 16-byte members, see load_obj_model()
+struct PackedTriangle {
+    glm::vec4 v0;
+    glm::vec4 e1; // v1 - v0
+    glm::vec4 e2; // v2 - v0
+    glm::vec4 normal; // normalize(cross(e1, e2))
+};
+static_assert(sizeof(PackedTriangle) == 64uz, "PackedTriangle must match the std430 layout");
+
+
+// std430 ShadingVertex of shaders/path_tracing.glsl, Vertex without the position.
+//   The Vertex itself only lives on the host, its vec3 members do not match std430.
+struct ShadingVertex {
+    glm::vec4 color;
+    glm::vec2 uv;
+    glm::vec2 padding { 0.0f };
+};
+static_assert(sizeof(ShadingVertex) == 32uz, "ShadingVertex must match the std430 layout");
+
+
+// A group of the .obj: a range of Scene::indices with its own bottom-level BVH
+struct Mesh {
+    std::uint32_t first_triangle { 0u };
+    std::uint32_t triangle_count { 0u };
+    std::uint32_t blas_root { 0u }; // into Scene::bvh_nodes
+    bvh::Aabb bounds {}; // in object space
+};
+
+
+// std430 Instance of shaders/path_tracing.glsl: a mesh placed in the scene by an affine
+//   transform, of which the first three rows are stored
+struct Instance {
+    glm::vec4 object_to_world[3];
+    glm::vec4 world_to_object[3];
+    std::uint32_t mesh { 0u }; // into Scene::meshes
+    std::uint32_t blas_root { 0u };
+    glm::uvec2 padding { 0u };
+
+    static Instance make(std::uint32_t mesh, std::uint32_t blasRoot, const glm::mat4& objectToWorld) {
+        const glm::mat4 world_to_object = glm::inverse(objectToWorld);
+        Instance instance { .mesh = mesh, .blas_root = blasRoot };
+        for (glm::length_t row { 0 }; row < 3; ++row) {
+            instance.object_to_world[row] = glm::vec4(
+                objectToWorld[0][row], objectToWorld[1][row], objectToWorld[2][row], objectToWorld[3][row]
+            );
+            instance.world_to_object[row] = glm::vec4(
+                world_to_object[0][row], world_to_object[1][row], world_to_object[2][row], world_to_object[3][row]
+            );
+        }
+
+        return instance;
+    }
+
+    glm::vec3 to_world(const glm::vec4& p) const {
+        return glm::vec3(glm::dot(object_to_world[0], p), glm::dot(object_to_world[1], p), glm::dot(object_to_world[2], p));
+    }
+
+    glm::vec3 to_object(const glm::vec4& p) const {
+        return glm::vec3(glm::dot(world_to_object[0], p), glm::dot(world_to_object[1], p), glm::dot(world_to_object[2], p));
+    }
+};
+static_assert(sizeof(Instance) == 112uz, "Instance must match the std430 layout");
+
+
+// std430 Material of shaders/path_tracing.glsl: Kd and Ke of the .mtl
+struct Material {
+    glm::vec4 albedo;
+    glm::vec4 emission;
+
+    bool emissive() const { return emission.x > 0.0f || emission.y > 0.0f || emission.z > 0.0f; }
+};
+
+
+// The header of the Lights buffer of shaders/path_tracing.glsl, the LightAlias buckets follow
+struct LightTableHeader {
+    std::uint32_t light_count { 0u };
+    float light_power { 0.0f };
+};
+
+
+// std430 LightAlias of shaders/path_tracing.glsl
+struct LightAlias {
+    std::uint32_t triangle { 0u };
+    float probability { 1.0f };
+    std::uint32_t alias { 0u };
+    std::uint32_t instance { 0u }; // of the triangle
+};
+
+
+struct LightTable {
+    LightTableHeader header {};
+    std::vector<LightAlias> aliases; // a bucket even without lights, to keep the buffer valid
+};
+
+
+struct Scene {
+    std::vector<Vertex> vertices;
+    std::vector<Triangle> indices;
+    std::vector<PackedTriangle> packed_triangles;
+    std::vector<ShadingVertex> shading_vertices;
+    std::vector<Material> materials;
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+    std::vector<bvh::WideNode> bvh_nodes; // the bottom-level BVHs of all meshes, collapsed into wide nodes
+    std::vector<std::uint32_t> bvh_primitives;
+    std::vector<bvh::Node> tlas_nodes;
+    std::vector<std::uint32_t> tlas_instances;
+};
+
+
+// luminance() of shaders/path_tracing.glsl
+inline float luminance(const glm::vec3& color) { return glm::dot(glm::vec3(0.212671f, 0.715160f, 0.072169f), color); }
+
+
+inline void load_obj_model(Scene& scene, const std::string& objFile = OBJ_FILE, const std::string& mtlDirectory = MTL_DIRECTORY) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> obj_materials;
+    std::string warn {};
+    std::string err {};
+    if (!tinyobj::LoadObj(&attrib, &shapes, &obj_materials, &warn, &err, objFile.c_str(), mtlDirectory.c_str())) {
+        minilog::log_fatal("{}", warn + err);
+    }
+    if (!warn.empty()) { minilog::log_warn("{}", warn); }
+
+    // Faces without a material get the last one, a white diffuse
+    for (const auto& obj_material : obj_materials) {
+        scene.materials.push_back(Material {
+            .albedo = glm::vec4(obj_material.diffuse[0], obj_material.diffuse[1], obj_material.diffuse[2], 0.0f),
+            .emission = glm::vec4(obj_material.emission[0], obj_material.emission[1], obj_material.emission[2], 0.0f)
+        });
+    }
+    const std::uint32_t default_material = static_cast<std::uint32_t>(scene.materials.size());
+    scene.materials.push_back(Material { .albedo = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f), .emission = glm::vec4(0.0f) });
+
+    std::vector<std::uint32_t> flat_indices;
+    std::vector<std::uint32_t> face_materials;
+    std::unordered_map<Vertex, std::uint32_t> unique_vertices {};
+    for (const auto& shape : shapes) {
+        if (shape.mesh.indices.empty()) { continue; } // lines or points only
+        scene.meshes.push_back(Mesh {
+            .first_triangle = static_cast<std::uint32_t>(flat_indices.size() / 3uz),
+            .triangle_count = static_cast<std::uint32_t>(shape.mesh.indices.size() / 3uz)
+        });
+        for (const auto& index : shape.mesh.indices) {
+            Vertex vertex {
+                .position = {
+                    attrib.vertices[static_cast<std::size_t>(3 * index.vertex_index + 0)],
+                    attrib.vertices[static_cast<std::size_t>(3 * index.vertex_index + 1)],
+                    attrib.vertices[static_cast<std::size_t>(3 * index.vertex_index + 2)]
+                },
+                .color = { 1.0f, 1.0f, 1.0f },
+                .uv = {
+                    // attrib.texcoords[static_cast<std::size_t>(2 * index.texcoord_index)],
+                    // 1.0f - attrib.texcoords[static_cast<std::size_t>(2 * index.texcoord_index + 1)]
+                    0.0f, 0.0f // TODO: use texture
+                }
+            };
+            if (unique_vertices.count(vertex) == 0) {
+                unique_vertices[vertex] = static_cast<std::uint32_t>(scene.vertices.size());
+                scene.vertices.push_back(vertex);
+            }
+            flat_indices.push_back(unique_vertices[vertex]);
+        }
+        for (int material_id : shape.mesh.material_ids) {
+            face_materials.push_back(material_id < 0 ? default_material : static_cast<std::uint32_t>(material_id));
+        }
+    }
+
+    scene.indices.resize(flat_indices.size() / 3uz);
+    for (std::size_t i { 0uz }; i < scene.indices.size(); ++i) {
+        scene.indices[i] = Triangle {
+            flat_indices[3uz * i + 0uz],
+            flat_indices[3uz * i + 1uz],
+            flat_indices[3uz * i + 2uz],
+            face_materials[i]
+        };
+    }
+
+    scene.packed_triangles.resize(scene.indices.size());
+    for (std::size_t i { 0uz }; i < scene.indices.size(); ++i) {
+        const glm::vec3 v0 = scene.vertices[scene.indices[i].t0].position;
+        const glm::vec3 e1 = scene.vertices[scene.indices[i].t1].position - v0;
+        const glm::vec3 e2 = scene.vertices[scene.indices[i].t2].position - v0;
+        scene.packed_triangles[i] = PackedTriangle {
+            .v0 = glm::vec4(v0, 0.0f),
+            .e1 = glm::vec4(e1, 0.0f),
+            .e2 = glm::vec4(e2, 0.0f),
+            .normal = glm::vec4(glm::normalize(glm::cross(e1, e2)), 0.0f)
+        };
+    }
+    scene.shading_vertices.resize(scene.vertices.size());
+    for (std::size_t i { 0uz }; i < scene.vertices.size(); ++i) {
+        scene.shading_vertices[i] = ShadingVertex { .color = glm::vec4(scene.vertices[i].color, 0.0f), .uv = scene.vertices[i].uv };
+    }
+}
+
+// A bottom-level BVH per mesh, built once and collapsed into wide nodes. They are appended
+//   to bvh_nodes and bvh_primitives with the child and primitive bases rebased, and the
+//   primitives turned into indices of the whole triangle array.
+inline void build_bvh(Scene& scene, const bvh::BuildOptions& options = {}, const bvh::CollapseOptions& collapseOptions = {}) {
+    const auto start = std::chrono::steady_clock::now();
+    // One pool for the meshes large enough to build in parallel, made by the first of them
+    std::unique_ptr<bvh::ThreadPool> thread_pool;
+    bvh::BuildOptions blas_options = options;
+    std::uint32_t max_depth { 0u };
+    std::size_t binary_node_count { 0uz };
+    for (Mesh& mesh : scene.meshes) {
+        if (!blas_options.thread_pool && mesh.triangle_count >= 2u * options.parallel_threshold) {
+            const std::uint32_t thread_count = options.thread_count > 0u
+                ? options.thread_count
+                : std::max(std::thread::hardware_concurrency(), 1u);
+            thread_pool = std::make_unique<bvh::ThreadPool>(thread_count);
+            blas_options.thread_pool = thread_pool.get();
+        }
+        const std::vector<Triangle> mesh_triangles(
+            scene.indices.begin() + mesh.first_triangle,
+            scene.indices.begin() + mesh.first_triangle + mesh.triangle_count
+        );
+        const bvh::Bvh binary = bvh::build(bvh::triangle_bounds(scene.vertices, mesh_triangles), blas_options);
+        const bvh::WideBvh blas = bvh::collapse(binary, collapseOptions);
+        binary_node_count += binary.nodes.size();
+        max_depth = std::max(max_depth, blas.depth);
+
+        const std::uint32_t node_base = static_cast<std::uint32_t>(scene.bvh_nodes.size());
+        const std::uint32_t primitive_base = static_cast<std::uint32_t>(scene.bvh_primitives.size());
+        mesh.blas_root = node_base;
+        if (!binary.nodes.empty()) { mesh.bounds = bvh::Aabb { .min = binary.nodes[0uz].aabb_min, .max = binary.nodes[0uz].aabb_max }; }
+        for (bvh::WideNode node : blas.nodes) {
+            node.child_base += node_base;
+            node.primitive_base += primitive_base;
+            scene.bvh_nodes.push_back(node);
+        }
+        for (std::uint32_t primitive : blas.primitives) {
+            const std::uint32_t triangle = mesh.first_triangle + primitive;
+            const bool emissive = scene.materials[scene.indices[triangle].material].emissive();
+            scene.bvh_primitives.push_back(emissive ? triangle | BVH_EMISSIVE_PRIMITIVE_BIT : triangle);
+        }
+    }
+    const auto stop = std::chrono::steady_clock::now();
+
+    minilog::log_debug(
+        "the BLAS of {} meshes have {} {}-wide nodes ({} KiB, {} KiB binary) over {} triangles, depth: {}, built in {:.2f} ms",
+        scene.meshes.size(), scene.bvh_nodes.size(), collapseOptions.width,
+        sizeof(bvh::WideNode) * scene.bvh_nodes.size() / 1024uz, sizeof(bvh::Node) * binary_node_count / 1024uz,
+        scene.indices.size(), max_depth, std::chrono::duration<double, std::milli>(stop - start).count()
+    );
+    // Deeper paths would drop children once the traversal stack is full, and render holes
+    if (max_depth > WIDE_BVH_STACK_SIZE + 1u) {
+        throw std::runtime_error(std::format(
+            "the BLAS depth {} exceeds the traversal stack of {} entries, use a wider --bvh-width", max_depth, WIDE_BVH_STACK_SIZE
+        ));
+    }
+}
+
+// The .obj places every mesh once, where it was modelled
+inline void place_instances(Scene& scene) {
+    for (std::uint32_t mesh { 0u }; mesh < static_cast<std::uint32_t>(scene.meshes.size()); ++mesh) {
+        scene.instances.push_back(Instance::make(mesh, scene.meshes[mesh].blas_root, glm::mat4(1.0f)));
+    }
+}
+
+// The top-level BVH over the world bounds of the instances. Only this one has to be
+//   rebuilt when instances move, the bottom-level BVHs stay in object space.
+inline void build_tlas(Scene& scene) {
+    std::vector<bvh::Aabb> bounds(scene.instances.size());
+    for (std::size_t i { 0uz }; i < scene.instances.size(); ++i) {
+        const bvh::Aabb& root = scene.meshes[scene.instances[i].mesh].bounds;
+        for (std::uint32_t corner { 0u }; corner < 8u; ++corner) {
+            bounds[i].grow(scene.instances[i].to_world(glm::vec4(
+                (corner & 1u) != 0u ? root.max.x : root.min.x,
+                (corner & 2u) != 0u ? root.max.y : root.min.y,
+                (corner & 4u) != 0u ? root.max.z : root.min.z,
+                1.0f
+            )));
+        }
+    }
+
+    bvh::Bvh tlas = bvh::build(bounds);
+    minilog::log_debug("the TLAS has {} nodes over {} instances, depth: {}", tlas.nodes.size(), scene.instances.size(), tlas.depth);
+    // Deeper paths would drop subtrees once the traversal stack is full
+    if (tlas.depth > BVH_STACK_SIZE + 1u) {
+        throw std::runtime_error(std::format(
+            "the TLAS depth {} exceeds the traversal stack of {} entries", tlas.depth, BVH_STACK_SIZE
+        ));
+    }
+    scene.tlas_nodes = std::move(tlas.nodes);
+    scene.tlas_instances = std::move(tlas.primitives);
+}
+
+// load_obj_model() -> build_bvh() -> place_instances() -> build_tlas()
+inline Scene load_scene(const bvh::BuildOptions& blasOptions = {}, const bvh::CollapseOptions& collapseOptions = {}) {
+    Scene scene {};
+    load_obj_model(scene);
+    build_bvh(scene, blasOptions, collapseOptions);
+    place_instances(scene);
+    build_tlas(scene);
+
+    return scene;
+}
+
+// An alias table over the emissive triangles weighted by area * luminance(emission).
+//   Every instance of an emissive triangle is a light of its own, with its world area.
+inline LightTable build_light_table(const Scene& scene) {
+    std::vector<std::uint32_t> light_triangles;
+    std::vector<std::uint32_t> light_instances;
+    std::vector<double> light_weights;
+    for (std::uint32_t inst { 0u }; inst < static_cast<std::uint32_t>(scene.instances.size()); ++inst) {
+        const Instance& instance = scene.instances[inst];
+        const Mesh& mesh = scene.meshes[instance.mesh];
+        for (std::uint32_t i { mesh.first_triangle }; i < mesh.first_triangle + mesh.triangle_count; ++i) {
+            const Material& material = scene.materials[scene.indices[i].material];
+            if (!material.emissive()) { continue; }
+            const double area = 0.5 * glm::length(glm::cross(
+                instance.to_world(glm::vec4(glm::vec3(scene.packed_triangles[i].e1), 0.0f)),
+                instance.to_world(glm::vec4(glm::vec3(scene.packed_triangles[i].e2), 0.0f))
+            ));
+            light_triangles.push_back(i);
+            light_instances.push_back(inst);
+            light_weights.push_back(area * luminance(glm::vec3(material.emission)));
+        }
+    }
+
+    LightTable table { .header = {}, .aliases = std::vector<LightAlias>(1uz) };
+    double light_power { 0.0 };
+    for (double weight : light_weights) { light_power += weight; }
+    if (light_power > 0.0) {
+        const std::vector<sampling::AliasBucket> buckets = sampling::build_alias_table(light_weights);
+        table.aliases.resize(buckets.size());
+        for (std::size_t i { 0uz }; i < buckets.size(); ++i) {
+            table.aliases[i] = LightAlias {
+                .triangle = light_triangles[i],
+                .probability = buckets[i].probability,
+                .alias = buckets[i].alias,
+                .instance = light_instances[i]
+            };
+        }
+        table.header = LightTableHeader {
+            .light_count = static_cast<std::uint32_t>(buckets.size()),
+            .light_power = static_cast<float>(light_power)
+        };
+    } else {
+        minilog::log_warn("the scene has no emissive triangles, next event estimation is off");
+    }
+    minilog::log_debug("{} emissive triangles, total power {:.3f}", table.header.light_count, table.header.light_power);
+
+    return table;
+}
+
+} // namespace scene end
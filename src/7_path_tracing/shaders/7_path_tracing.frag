@@ -4,7 +4,9 @@ layout(location = 0) in vec2 uv;
 layout(location = 0) out vec4 pixel_color;
 layout(set = 0, binding = 0, std430) readonly buffer PixelColors { vec4 pixel_colors[]; };
 
-const uvec2 screen_size = uvec2(1920u, 1080u);
+layout(constant_id = 12) const uint output_width = 1920u; // same ids as the compute shaders
+layout(constant_id = 13) const uint output_height = 1080u;
+const uvec2 screen_size = uvec2(output_width, output_height); // of the display copies, upscaled with a render scale
 const float hdr2ldr_scale = 2.0f;
 
 vec3 linear_to_srgb(vec3 x) {
@@ -0,0 +1,108 @@
+// Online path guiding of the megakernel (RenderConfig::guiding): a grid over the scene bounds,
+//   each cell with a histogram of directions over the sphere, learned from the radiance the
+//   paths of earlier dispatches brought back. The bins are equal-area: 16 steps of cos(theta)
+//   by 16 of phi, both in world space, so a bin spans 4 pi / 256 steradians.
+// The megakernel samples a bounce from the guide of its cell with probability
+//   guiding_fraction and from the cosine lobe otherwise, and weights it by the density of the
+//   mixture, which the MIS with the light samples uses too: the estimate stays unbiased. At
+//   the end of a path every vertex adds f * L * cos / pdf of its bounce to the bin it took.
+//   guiding_resolve.comp then adds the sums of the dispatch to the cell and rebuilds its CDF.
+// Included after path_tracing.glsl, or after restir.glsl which includes it.
+
+
+// The sums are reset by every resolve, the density only grows: the scene stays where it is,
+//   so every dispatch adds an unbiased estimate of the same integral per bin
+struct GuidingCell {
+    uint sums[256]; // of this dispatch, in guiding_fixed_point steps
+    float density[256]; // all dispatches so far
+    float cdf[256]; // inclusive and normalized, all 0 while the cell has not learned anything
+};
+
+
+// A bounce of the path, its radiance is added to the guide when the path ends
+struct GuidingVertex {
+    uint cell;
+    uint bin;
+    vec3 beta; // before the bounce
+    vec3 radiance; // the radiance of the invocation before the bounce
+};
+
+
+layout(set = 0, binding = 30, std430) buffer Guiding { GuidingCell guiding_cells[]; }; // grid over the scene bounds
+
+
+const uint guiding_grid_size = 16u; // cells per axis, GUIDING_GRID_SIZE
+const uint guiding_cell_count = guiding_grid_size * guiding_grid_size * guiding_grid_size;
+const uint guiding_bin_steps = 16u; // of cos(theta) and phi
+const uint guiding_bin_count = guiding_bin_steps * guiding_bin_steps;
+const float guiding_fraction = 0.5f; // of the bounces sampled from a trained guide
+const float guiding_fixed_point = 256.0f; // steps per unit of f * L * cos / pdf in the sums
+const float guiding_max_weight = 64.0f; // per sample, 2^18 samples a bin and dispatch before the sums overflow
+const uint guiding_path_vertices = 4u; // the first bounces of a path teach the guide
+
+
+uint guiding_cell(vec3 position) {
+    const vec3 bounds_min = tlas_nodes[0u].aabb_min;
+    const vec3 extent = max(tlas_nodes[0u].aabb_max - bounds_min, vec3(1e-6f));
+    const uvec3 grid = uvec3(clamp((position - bounds_min) / extent * float(guiding_grid_size), vec3(0.0f), vec3(float(guiding_grid_size) - 0.5f)));
+
+    return grid.x + (grid.y + grid.z * guiding_grid_size) * guiding_grid_size;
+}
+
+// A cell the megakernel may sample from, ~0u while it has not learned anything
+uint trained_guiding_cell(vec3 position) {
+    const uint cell = guiding_cell(position);
+
+    return guiding_cells[cell].cdf[guiding_bin_count - 1u] > 0.0f ? cell : ~0u;
+}
+
+uint guiding_bin(vec3 direction) {
+    const uint s = min(uint((direction.z * 0.5f + 0.5f) * float(guiding_bin_steps)), guiding_bin_steps - 1u);
+    const float phi = atan(direction.y, direction.x);
+    const uint t = min(uint((phi < 0.0f ? phi + 2.0f * pi : phi) * 0.5f * inv_pi * float(guiding_bin_steps)), guiding_bin_steps - 1u);
+
+    return s + t * guiding_bin_steps;
+}
+
+// Solid angle density of the guide of a trained cell
+float guiding_pdf(uint cell, vec3 direction) {
+    const uint bin = guiding_bin(direction);
+    const float probability = guiding_cells[cell].cdf[bin] - (bin > 0u ? guiding_cells[cell].cdf[bin - 1u] : 0.0f);
+
+    return probability * float(guiding_bin_count) * 0.25f * inv_pi;
+}
+
+// The bin from u.x over the CDF, then a uniform direction in it from u.x rescaled and u.y
+vec3 sample_guiding(uint cell, vec2 u) {
+    uint low = 0u;
+    uint high = guiding_bin_count - 1u;
+    while (low < high) {
+        const uint middle = (low + high) / 2u;
+        if (guiding_cells[cell].cdf[middle] <= u.x) {
+            low = middle + 1u;
+        } else {
+            high = middle;
+        }
+    }
+    const float cdf_low = low > 0u ? guiding_cells[cell].cdf[low - 1u] : 0.0f;
+    const float v = clamp((u.x - cdf_low) / max(guiding_cells[cell].cdf[low] - cdf_low, 1e-8f), 0.0f, 1.0f);
+
+    const float z = (float(low % guiding_bin_steps) + v) / float(guiding_bin_steps) * 2.0f - 1.0f;
+    const float phi = (float(low / guiding_bin_steps) + u.y) / float(guiding_bin_steps) * 2.0f * pi;
+    const float r = sqrt(max(1.0f - z * z, 0.0f));
+
+    return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+// Density of a bounce: the cosine lobe alone without a trained cell, the mixture with its guide otherwise
+float guided_bounce_pdf(uint cell, vec3 direction, float cos_wi) {
+    const float pdf_cosine = max(cos_wi, 0.0f) * inv_pi;
+    if (cell == ~0u) { return pdf_cosine; }
+
+    return mix(pdf_cosine, guiding_pdf(cell, direction), guiding_fraction);
+}
+
+void add_guiding_sample(uint cell, uint bin, float weight) {
+    if (isnan(weight) || weight <= 0.0f) { return; }
+    atomicAdd(guiding_cells[cell].sums[bin], uint(min(weight, guiding_max_weight) * guiding_fixed_point + 0.5f));
+}
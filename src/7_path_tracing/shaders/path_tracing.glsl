@@ -0,0 +1,912 @@
+// Shared by the megakernel (7_path_tracing.comp) and the wavefront passes (wavefront_*.comp)
+
+struct Onb {
+    vec3 tangent;
+    vec3 binormal;
+    vec3 normal;
+};
+Onb make_onb(vec3 normal) {
+    const float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+    const float a = -1.0f / (sign + normal.z);
+    const float b = a * normal.x * normal.y;
+    Onb onb = Onb(
+        vec3(1.0f + sign * a * normal.x * normal.x, sign * b, -sign * normal.x),
+        vec3(b, sign + a * normal.y * normal.y, -normal.y),
+        normal
+    );
+
+    return onb;
+}
+vec3 to_world(Onb onb, vec3 v) {
+    return v.x * onb.tangent
+         + v.y * onb.binormal
+         + v.z * onb.normal;
+}
+
+
+struct Ray {
+    vec3 origin;
+    vec3 direction;
+    float t_max;
+};
+Ray make_ray(vec3 origin, vec3 direction, float t_max) {
+    return Ray(origin, normalize(direction), t_max);
+}
+vec3 ray_at(Ray ray, float t) { return ray.origin + t * ray.direction; }
+vec3 offset_ray_origin(vec3 p, vec3 n) {
+    const float origin = 1.0f / 32.0f;
+    const float float_scale = 1.0f / 65536.0f;
+    const float int_scale = 256.0f;
+
+    const ivec3 of_i = ivec3(int_scale * n);
+    const vec3 p_i = vec3(
+        intBitsToFloat(floatBitsToInt(p.x) + (p.x < 0.0f ? -of_i.x : of_i.x)),
+        intBitsToFloat(floatBitsToInt(p.y) + (p.y < 0.0f ? -of_i.y : of_i.y)),
+        intBitsToFloat(floatBitsToInt(p.z) + (p.z < 0.0f ? -of_i.z : of_i.z))
+    );
+    const vec3 p_final = vec3(
+        abs(p.x) < origin ? p.x + float_scale * n.x : p_i.x,
+        abs(p.y) < origin ? p.y + float_scale * n.y : p_i.y,
+        abs(p.z) < origin ? p.z + float_scale * n.z : p_i.z
+    );
+
+    return p_final;
+}
+
+
+struct Camera {
+    vec3 position;
+    vec3 front;
+    vec3 up;
+    vec3 right;
+    float fov;
+    uvec2 resolution;
+};
+Ray generate_ray(Camera camera, vec2 p) {
+    const float fov_radians = radians(camera.fov);
+    const float aspect_ratio = float(camera.resolution.x) / float(camera.resolution.y);
+    const vec3 wi_local = vec3(
+        p.x * tan(0.5f * fov_radians) * aspect_ratio,
+        p.y * tan(0.5f * fov_radians),
+        -1.0f
+    );
+    const vec3 wi_world = normalize(
+        wi_local.x * camera.right
+        + wi_local.y * camera.up
+        - wi_local.z * camera.front
+    );
+
+    return make_ray(camera.position, wi_world, 100000.0f);
+}
+// Inverse of generate_ray(): the continuous pixel position of p (pixel centres at .5)
+//   and its distance to the camera. False behind the camera.
+bool project_to_pixel(Camera camera, vec3 p, out vec2 pixel, out float distance_to_camera) {
+    const vec3 d = p - camera.position;
+    const float z = dot(d, camera.front);
+    distance_to_camera = length(d);
+    if (z <= 0.0f) { return false; }
+
+    const float tan_half_fov = tan(0.5f * radians(camera.fov));
+    const float aspect_ratio = float(camera.resolution.x) / float(camera.resolution.y);
+    const vec2 p_ndc = vec2(dot(d, camera.right) / (tan_half_fov * aspect_ratio), dot(d, camera.up) / tan_half_fov) / z;
+    pixel = vec2(0.5f * (p_ndc.x + 1.0f), 0.5f * (1.0f - p_ndc.y)) * vec2(camera.resolution);
+
+    return true;
+}
+
+
+// Running mean over the samples of a pixel of what its camera rays hit first, the
+//   edge-stopping functions of the denoiser (denoise_atrous.comp) read it
+struct PixelAov {
+    vec4 albedo; // w unused
+    vec4 normal_depth; // geometric normal, distance along the camera ray
+};
+
+
+struct SurfaceHitRecord {
+    uint inst;
+    uint prim;
+    vec2 bary;
+    float time;
+};
+
+
+// Built once by scene::load_obj_model(): hit_surface() gets the triangle from three
+//   16-byte loads without going through the vertex indices, shading reuses the normal
+struct PackedTriangle {
+    vec4 v0; // w unused
+    vec4 e1; // v1 - v0, w unused
+    vec4 e2; // v2 - v0, w unused
+    vec4 normal; // normalize(cross(e1, e2)), w unused
+};
+
+
+// Per-vertex attributes of the shading point, reached through the Triangle indices
+struct ShadingVertex {
+    vec4 color; // w unused
+    vec2 uv;
+    vec2 padding;
+};
+
+
+// A placement of a mesh in the scene, the leaves of the top-level BVH point to them. The
+//   transforms are affine, stored as their first three rows.
+struct Instance {
+    vec4 object_to_world[3];
+    vec4 world_to_object[3];
+    uint mesh; // into Scene::meshes of scene.hpp
+    uint blas_root; // the root of the bottom-level BVH of the mesh in bvh_nodes
+    uvec2 padding;
+};
+
+
+struct Triangle {
+    uint t0;
+    uint t1;
+    uint t2;
+    uint material; // into scene_materials
+};
+
+
+// Kd and Ke of the .mtl, w unused
+struct Material {
+    vec4 albedo;
+    vec4 emission;
+};
+
+
+// A bucket of the alias table over the emissive triangles of all instances, see sample_light()
+struct LightAlias {
+    uint triangle;
+    float probability; // of taking this bucket's triangle rather than the one of its alias
+    uint alias; // bucket
+    uint instance; // of the triangle
+};
+
+
+// Depth-first layout: the left child of an interior node follows its parent,
+//   offset holds the right child (interior) or the first primitive (leaf).
+struct BvhNode {
+    vec3 aabb_min;
+    uint offset;
+    vec3 aabb_max;
+    uint count;
+};
+
+
+// bvh::WideNode: up to 8 children with their bounds quantized to bytes, a child spans
+//   origin + q_lo * scale to origin + q_hi * scale. Slot i is byte i % 4 of the words
+//   i / 4 of meta and of each pair of bounds.
+struct WideBvhNode {
+    vec3 origin;
+    uint exponents; // biased float exponents of the scales: x | y << 8 | z << 16
+    uint child_base; // the interior children, in the order of the slots
+    uint primitive_base; // the primitives of the leaf children, in the order of the slots
+    uint meta[2]; // 0: empty, 0x80: interior, else a leaf of that many primitives
+    uint bounds[12]; // q_lo of x, y, z then q_hi of x, y, z, two words each
+};
+
+
+// The first three members are a VkDispatchIndirectCommand. The passes that append to
+//   a queue keep the dispatch size up to date with atomicMax.
+struct Queue {
+    uint dispatch_x;
+    uint dispatch_y;
+    uint dispatch_z;
+    uint count;
+};
+
+
+// The Camera in the uniform buffer, see CameraUniform of scene.hpp
+struct CameraUniform {
+    vec4 position; // w: vertical field of view in degrees
+    vec4 front;
+    vec4 up;
+    vec4 right;
+};
+
+
+// std140 (uniform) / std430 (SSBO)
+// Align memory with a size of 4 bytes
+layout(set = 0, binding = 0, std140) uniform UniformBuffer {
+    CameraUniform camera_uniform;
+    CameraUniform previous_camera_uniform; // of the previous dispatch, see reproject.comp
+    uint sample_index;
+}; // uniform buffer(read-only)
+layout(set = 0, binding = 1, std430) readonly buffer PackedTriangles { PackedTriangle triangles[]; }; // intersection layout
+layout(set = 0, binding = 2, std430) readonly buffer IndexBuffer { Triangle indices[]; }; // index buffer
+layout(set = 0, binding = 3, std430) buffer PixelColors { vec4 pixel_colors[]; }; // pixel colors
+layout(set = 0, binding = 4, std430) readonly buffer BvhNodes { WideBvhNode bvh_nodes[]; }; // bottom-level bvh nodes of all meshes
+layout(set = 0, binding = 5, std430) readonly buffer BvhPrimitives { uint bvh_primitives[]; }; // bottom-level bvh primitives
+layout(set = 0, binding = 11, std430) buffer RayCounter { uint ray_count_low; uint ray_count_high; }; // ray counter
+// x: dispatches accumulated, y: mean luminance, z: sum of squared deviations from the mean (Welford)
+layout(set = 0, binding = 12, std430) buffer PixelStats { vec4 pixel_stats[]; }; // per-pixel variance, .w the samples drawn
+layout(set = 0, binding = 13, std430) buffer TileQueue { Queue tile_queue; }; // active tile count and dispatch
+layout(set = 0, binding = 14, std430) buffer ActiveTiles { uint active_tiles[]; }; // tiles that did not converge
+layout(set = 0, binding = 15, std430) buffer PixelAovs { PixelAov pixel_aovs[]; }; // first-hit albedo and normal
+layout(set = 0, binding = 21, std430) readonly buffer Materials { Material scene_materials[]; }; // materials
+layout(set = 0, binding = 22, std430) readonly buffer Lights {
+    uint light_count; // emissive triangles, 0 without any
+    float light_power; // sum of area * luminance(emission) over them
+    LightAlias light_aliases[];
+}; // alias table of the emissive triangles
+layout(set = 0, binding = 25, std430) readonly buffer ShadingVertices { ShadingVertex shading_vertices[]; }; // shading attributes
+layout(set = 0, binding = 26, std430) readonly buffer Instances { Instance instances[]; }; // mesh instances
+layout(set = 0, binding = 27, std430) readonly buffer TlasNodes { BvhNode tlas_nodes[]; }; // top-level bvh nodes
+layout(set = 0, binding = 28, std430) readonly buffer TlasInstances { uint tlas_instances[]; }; // top-level bvh primitives
+// x: instance, y: triangle, ~0u where the camera sees nothing, zw: barycentrics as bits
+layout(set = 0, binding = 31, std430) readonly buffer VisibilityBuffer { uvec4 visibility[]; }; // rasterized primary hits
+
+const float pi = 3.14159265358979323846264338327950288f;
+const float inv_pi = 0.318309886183790671537767526745028724f;
+// Specialization constants, set by PathTracing::create_compute_shader_pipeline() from the command line
+layout(constant_id = 0) const uint screen_width = 1920u;
+layout(constant_id = 1) const uint screen_height = 1080u;
+layout(constant_id = 2) const uint spp_per_dispatch = 1u;
+layout(constant_id = 3) const uint depth_per_dispatch = 10u;
+layout(constant_id = 4) const bool count_rays = false; // headless throughput report
+layout(constant_id = 5) const bool adaptive_sampling = false;
+layout(constant_id = 6) const float adaptive_threshold = 0.02f; // relative standard error of a converged pixel
+layout(constant_id = 7) const bool restir_direct = false; // direct lighting at the primary hit from reservoirs, see restir.glsl
+layout(constant_id = 8) const uint radiance_cache_mode = 0u; // 1: paths stop at the radiance cache, 2: and it is shown, see radiance_cache.glsl
+layout(constant_id = 9) const bool path_guiding = false; // bounces sampled from a learned guide too, see guiding.glsl
+layout(constant_id = 10) const bool raster_primary = false; // primary hits from the visibility buffer, see visibility.vert
+layout(constant_id = 11) const uint interleave = 1u; // pixels per traced pixel, see interleaved_pixel()
+layout(constant_id = 12) const uint output_width = 1920u; // the window, larger than the screen with a render scale, see upscale_edge.comp
+layout(constant_id = 13) const uint output_height = 1080u;
+const uvec2 screen_size = uvec2(screen_width, screen_height);
+const uvec2 output_size = uvec2(output_width, output_height);
+const uint adaptive_min_samples = 16u; // dispatches a pixel gets before it may converge
+const uint tile_size = 8u; // a tile is the 8x8 workgroup of the per-pixel passes
+const uint tile_dispatch_width = 4096u; // the active tiles are dispatched as rows of that many workgroups
+const uint bvh_stack_size = 32u; // of the binary top-level BVH, see BVH_STACK_SIZE
+const uint wide_bvh_stack_size = 16u; // an entry holds the children left of a node, see WIDE_BVH_STACK_SIZE
+const uint wide_child_interior = 0x80u;
+const uint bvh_emissive_bit = 0x80000000u; // bvh_primitives entries of the light, see BVH_EMISSIVE_PRIMITIVE_BIT
+const uint bvh_primitive_mask = 0x7fffffffu;
+const float no_hit = 1e30f;
+
+Camera make_camera(CameraUniform uniform_camera) {
+    return Camera(
+        uniform_camera.position.xyz,
+        uniform_camera.front.xyz,
+        uniform_camera.up.xyz,
+        uniform_camera.right.xyz,
+        uniform_camera.position.w,
+        screen_size
+    );
+}
+Camera current_camera() { return make_camera(camera_uniform); }
+Camera previous_camera() { return make_camera(previous_camera_uniform); }
+
+
+
+// Owen-scrambled Sobol sampler (Burley 2020, "Practical Hash-based Owen Scrambling").
+// Every draw takes a new dimension: the first two Sobol dimensions, shuffled and
+//   scrambled with a hash of the pixel and the dimension. Nothing but the
+//   dimension counter is carried from one draw to the next.
+struct Sampler {
+    uint pixel_seed;
+    uint sample_number; // samples of the pixel drawn before this one
+    uint dimension;
+};
+
+uint hash_uint(uint x) {
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+uint hash_combine(uint seed, uint v) { return seed ^ (v + 0x9e3779b9u + (seed << 6u) + (seed >> 2u)); }
+
+uint laine_karras_permutation(uint x, uint seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nested_uniform_scramble(uint x, uint seed) {
+    return bitfieldReverse(laine_karras_permutation(bitfieldReverse(x), seed));
+}
+
+// The direction numbers of the second dimension follow v[k + 1] = v[k] ^ (v[k] >> 1)
+uint sobol_dimension_1(uint index) {
+    uint x = 0u;
+    for (uint v = 0x80000000u; index != 0u; index >>= 1u, v ^= v >> 1u) {
+        if ((index & 1u) != 0u) { x ^= v; }
+    }
+    return x;
+}
+
+float to_unit_float(uint x) { return float(x >> 8u) * (1.0f / float(0x01000000u)); }
+
+Sampler make_sampler(uint pixel, uint sample_number) { return Sampler(hash_uint(pixel), sample_number, 0u); }
+
+vec2 sample_2d(inout Sampler rng) {
+    const uint seed = hash_combine(rng.pixel_seed, rng.dimension++);
+    const uint index = nested_uniform_scramble(rng.sample_number, seed);
+    const uint x = nested_uniform_scramble(bitfieldReverse(index), hash_combine(seed, 0u));
+    const uint y = nested_uniform_scramble(sobol_dimension_1(index), hash_combine(seed, 1u));
+    return vec2(to_unit_float(x), to_unit_float(y));
+}
+
+float sample_1d(inout Sampler rng) {
+    const uint seed = hash_combine(rng.pixel_seed, rng.dimension++);
+    const uint index = nested_uniform_scramble(rng.sample_number, seed);
+    return to_unit_float(nested_uniform_scramble(bitfieldReverse(index), hash_combine(seed, 0u)));
+}
+
+// The first sample of the pixel in this dispatch, the pixels keep their own count. It is the
+//   samples drawn rather than dispatches * spp_per_dispatch, which PgUp / PgDn change.
+uint first_sample_number(uint index) { return uint(pixel_stats[index].w); }
+
+vec3 cosine_sample_hemisphere(vec2 u) {
+    const float r = sqrt(u.x);
+    const float phi = 2.0f * pi * u.y;
+    return vec3(r * cos(phi), r * sin(phi), sqrt(1.0f - u.x));
+}
+
+float balanced_heuristic(float pdf_a, float pdf_b) {
+    return pdf_a / max(pdf_a + pdf_b, 1e-4f);
+}
+
+// The triangles are stored in the object space of their mesh, the traversal moves the
+//   ray there and the shading moves the hit back into the world
+vec3 object_to_world_point(uint inst, vec3 p) {
+    const vec4 p_h = vec4(p, 1.0f);
+    return vec3(
+        dot(instances[inst].object_to_world[0], p_h),
+        dot(instances[inst].object_to_world[1], p_h),
+        dot(instances[inst].object_to_world[2], p_h)
+    );
+}
+
+// The direction is not normalized, so a distance along the ray is the same in both spaces
+Ray world_to_object_ray(uint inst, Ray ray) {
+    const vec4 origin = vec4(ray.origin, 1.0f);
+    const vec4 direction = vec4(ray.direction, 0.0f);
+    return Ray(
+        vec3(
+            dot(instances[inst].world_to_object[0], origin),
+            dot(instances[inst].world_to_object[1], origin),
+            dot(instances[inst].world_to_object[2], origin)
+        ),
+        vec3(
+            dot(instances[inst].world_to_object[0], direction),
+            dot(instances[inst].world_to_object[1], direction),
+            dot(instances[inst].world_to_object[2], direction)
+        ),
+        ray.t_max
+    );
+}
+
+// The point at the barycentrics of hit_surface(): u weighs v1 and v the v2 of the triangle
+vec3 triangle_point(uint inst, uint prim, vec2 bary) {
+    return object_to_world_point(
+        inst, triangles[prim].v0.xyz + bary.x * triangles[prim].e1.xyz + bary.y * triangles[prim].e2.xyz
+    );
+}
+
+// Normals transform with the inverse transpose, the rows of world_to_object are its columns
+vec3 geometric_normal(uint inst, uint prim) {
+    const vec3 n = triangles[prim].normal.xyz;
+    return normalize(
+        n.x * instances[inst].world_to_object[0].xyz
+        + n.y * instances[inst].world_to_object[1].xyz
+        + n.z * instances[inst].world_to_object[2].xyz
+    );
+}
+
+SurfaceHitRecord hit_surface(Ray ray, uint index) {
+    SurfaceHitRecord record;
+    record.inst = ~0u;
+    record.prim = ~0u;
+    record.bary = vec2(-1.0f);
+    record.time = ray.t_max;
+
+    const vec3 A = triangles[index].v0.xyz;
+    const vec3 E1 = triangles[index].e1.xyz;
+    const vec3 E2 = triangles[index].e2.xyz;
+    const vec3 P = cross(ray.direction, E2);
+    const float det = dot(E1, P);
+    const float invDet = 1.0f / det;
+
+    const vec3 T = ray.origin - A;
+    const float u = dot(T, P) * invDet;
+    if (u < 0.0f || u > 1.0f) { return record; }
+
+    const vec3 Q = cross(T, E1);
+    const float v = dot(ray.direction, Q) * invDet;
+    if (v < 0.0f || u + v > 1.0f) { return record; }
+
+    const float t = dot(E2, Q) * invDet;
+    if (t < 0.0f || t > ray.t_max) { return record; }
+
+    record.prim = index;
+    record.bary = vec2(u, v);
+    record.time = t;
+
+    return record;
+}
+
+vec3 safe_inverse(vec3 direction) {
+    const vec3 d = mix(direction, vec3(1e-20f), lessThan(abs(direction), vec3(1e-20f)));
+    return 1.0f / d;
+}
+
+// Slab test, returns the entry distance or no_hit
+float hit_aabb(vec3 aabb_min, vec3 aabb_max, vec3 origin, vec3 inv_direction, float t_max) {
+    const vec3 t0 = (aabb_min - origin) * inv_direction;
+    const vec3 t1 = (aabb_max - origin) * inv_direction;
+    const vec3 t_near = min(t0, t1);
+    const vec3 t_far = max(t0, t1);
+    const float t_enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0f));
+    const float t_exit = min(min(t_far.x, t_far.y), min(t_far.z, t_max));
+
+    return t_enter <= t_exit ? t_enter : no_hit;
+}
+
+uint wide_child_meta(WideBvhNode node, uint slot) { return (node.meta[slot >> 2u] >> ((slot & 3u) * 8u)) & 0xffu; }
+
+// The interior children before slot (x), and the primitives of the leaf children before it (y)
+uvec2 wide_child_offsets(WideBvhNode node, uint slot) {
+    uvec2 offsets = uvec2(0u);
+    for (uint i = 0u; i < slot; ++i) {
+        const uint meta = wide_child_meta(node, i);
+        if (meta == wide_child_interior) {
+            ++offsets.x;
+        } else {
+            offsets.y += meta;
+        }
+    }
+
+    return offsets;
+}
+
+// Slab test of the children of the node in slots (a bit per slot) at once. Returns the slots
+//   that are hit nearest first, 3 bits each from bit 0, with their count from bit 24.
+uint hit_wide_children(WideBvhNode node, uint slots, vec3 origin, vec3 inv_direction, float t_max) {
+    const vec3 scale = vec3(
+        uintBitsToFloat((node.exponents & 0xffu) << 23u),
+        uintBitsToFloat(((node.exponents >> 8u) & 0xffu) << 23u),
+        uintBitsToFloat(((node.exponents >> 16u) & 0xffu) << 23u)
+    );
+
+    float hit_distances[8];
+    uint hit_slots[8];
+    uint hit_count = 0u;
+    for (uint slot = 0u; slot < 8u; ++slot) {
+        if (((slots >> slot) & 1u) == 0u || wide_child_meta(node, slot) == 0u) { continue; }
+
+        const uint word = slot >> 2u;
+        const uint shift = (slot & 3u) * 8u;
+        const vec3 q_lo = vec3(
+            (node.bounds[word] >> shift) & 0xffu,
+            (node.bounds[2u + word] >> shift) & 0xffu,
+            (node.bounds[4u + word] >> shift) & 0xffu
+        );
+        const vec3 q_hi = vec3(
+            (node.bounds[6u + word] >> shift) & 0xffu,
+            (node.bounds[8u + word] >> shift) & 0xffu,
+            (node.bounds[10u + word] >> shift) & 0xffu
+        );
+        const float t = hit_aabb(node.origin + q_lo * scale, node.origin + q_hi * scale, origin, inv_direction, t_max);
+        if (t == no_hit) { continue; }
+
+        uint i = hit_count++;
+        for (; i > 0u && hit_distances[i - 1u] > t; --i) {
+            hit_distances[i] = hit_distances[i - 1u];
+            hit_slots[i] = hit_slots[i - 1u];
+        }
+        hit_distances[i] = t;
+        hit_slots[i] = slot;
+    }
+
+    uint hits = hit_count << 24u;
+    for (uint i = 0u; i < hit_count; ++i) { hits |= hit_slots[i] << (3u * i); }
+
+    return hits;
+}
+
+// The slots after the first of hits that are hit, as a bit per slot
+uint remaining_wide_children(uint hits, uint first) {
+    uint slots = 0u;
+    for (uint i = first; i < (hits >> 24u); ++i) { slots |= 1u << ((hits >> (3u * i)) & 7u); }
+
+    return slots;
+}
+
+// Closest hit in the bottom-level BVH of an instance, for a ray in its object space whose
+//   t_max is the closest hit so far. Replaces hit_record when it finds a closer one.
+//   The leaf children of a node are tested nearest first up to its nearest interior child,
+//   which is visited next; the other children are pushed as one entry and tested again
+//   against the closer t_max when it is popped.
+void hit_blas(Ray ray, uint inst, inout SurfaceHitRecord hit_record) {
+    const vec3 inv_direction = safe_inverse(ray.direction);
+
+    uvec2 stack[wide_bvh_stack_size]; // node, slots left
+    uint stack_size = 0u;
+    uint node_index = instances[inst].blas_root;
+    uint slots = 0xffu;
+    while (true) {
+        const WideBvhNode node = bvh_nodes[node_index];
+        const uint hits = hit_wide_children(node, slots, ray.origin, inv_direction, ray.t_max);
+        bool descend = false;
+        for (uint i = 0u; i < (hits >> 24u); ++i) {
+            const uint slot = (hits >> (3u * i)) & 7u;
+            const uint meta = wide_child_meta(node, slot);
+            const uvec2 offsets = wide_child_offsets(node, slot);
+            if (meta == wide_child_interior) {
+                const uint remaining = remaining_wide_children(hits, i + 1u);
+                if (remaining != 0u && stack_size < wide_bvh_stack_size) { stack[stack_size++] = uvec2(node_index, remaining); }
+                node_index = node.child_base + offsets.x;
+                slots = 0xffu;
+                descend = true;
+                break;
+            }
+
+            for (uint p = node.primitive_base + offsets.y; p < node.primitive_base + offsets.y + meta; ++p) {
+                const SurfaceHitRecord current_hit_record = hit_surface(ray, bvh_primitives[p] & bvh_primitive_mask);
+                if (
+                    (current_hit_record.prim != ~0u)
+                    && (hit_record.prim == ~0u || current_hit_record.time < hit_record.time)
+                ) {
+                    hit_record = current_hit_record;
+                    hit_record.inst = inst;
+                    ray.t_max = current_hit_record.time;
+                }
+            }
+        }
+        if (descend) { continue; }
+
+        if (stack_size == 0u) { break; }
+        --stack_size;
+        node_index = stack[stack_size].x;
+        slots = stack[stack_size].y;
+    }
+}
+
+// Two levels: the top-level BVH over the world bounds of the instances, then the
+//   bottom-level BVH of the mesh of each instance it reaches, in object space
+SurfaceHitRecord hit_scene(Ray ray) {
+    SurfaceHitRecord hit_record;
+    hit_record.inst = ~0u;
+    hit_record.prim = ~0u;
+    hit_record.bary = vec2(-1.0f);
+    hit_record.time = ray.t_max;
+
+    const vec3 inv_direction = safe_inverse(ray.direction);
+    if (hit_aabb(tlas_nodes[0u].aabb_min, tlas_nodes[0u].aabb_max, ray.origin, inv_direction, ray.t_max) == no_hit) {
+        return hit_record;
+    }
+
+    uint stack[bvh_stack_size];
+    uint stack_size = 0u;
+    uint node_index = 0u;
+    while (true) {
+        const BvhNode node = tlas_nodes[node_index];
+        if (node.count > 0u) {
+            for (uint i = 0u; i < node.count; ++i) {
+                const uint inst = tlas_instances[node.offset + i];
+                hit_blas(world_to_object_ray(inst, ray), inst, hit_record);
+                ray.t_max = hit_record.time;
+            }
+        } else {
+            // visit the nearer child first, the farther one is pushed
+            uint near_index = node_index + 1u;
+            uint far_index = node.offset;
+            float t_near = hit_aabb(
+                tlas_nodes[near_index].aabb_min, tlas_nodes[near_index].aabb_max,
+                ray.origin, inv_direction, ray.t_max
+            );
+            float t_far = hit_aabb(
+                tlas_nodes[far_index].aabb_min, tlas_nodes[far_index].aabb_max,
+                ray.origin, inv_direction, ray.t_max
+            );
+            if (t_far < t_near) {
+                const uint index = near_index; near_index = far_index; far_index = index;
+                const float t = t_near; t_near = t_far; t_far = t;
+            }
+            if (t_near != no_hit) {
+                if (t_far != no_hit && stack_size < bvh_stack_size) { stack[stack_size++] = far_index; }
+                node_index = near_index;
+                continue;
+            }
+        }
+
+        if (stack_size == 0u) { break; }
+        node_index = stack[--stack_size];
+    }
+
+    return hit_record;
+}
+
+// Only reports whether the segment (0, t_max) crosses the triangle, no hit record is built
+bool hit_surface_any(Ray ray, uint index) {
+    const vec3 A = triangles[index].v0.xyz;
+    const vec3 E1 = triangles[index].e1.xyz;
+    const vec3 E2 = triangles[index].e2.xyz;
+    const vec3 P = cross(ray.direction, E2);
+    const float invDet = 1.0f / dot(E1, P);
+
+    const vec3 T = ray.origin - A;
+    const float u = dot(T, P) * invDet;
+    const vec3 Q = cross(T, E1);
+    const float v = dot(ray.direction, Q) * invDet;
+    const float t = dot(E2, Q) * invDet;
+
+    return u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < ray.t_max;
+}
+
+// Occlusion query for shadow rays: stops at the first blocking triangle and never
+//   shrinks t_max, so the children left of a node are pushed as they are. Emissive
+//   triangles are skipped through their bvh_primitives flag.
+//   For a ray in the object space of the instance.
+bool blas_any(Ray ray, uint inst) {
+    const vec3 inv_direction = safe_inverse(ray.direction);
+
+    uvec2 stack[wide_bvh_stack_size]; // node, slots left
+    uint stack_size = 0u;
+    uint node_index = instances[inst].blas_root;
+    uint slots = 0xffu;
+    while (true) {
+        const WideBvhNode node = bvh_nodes[node_index];
+        const uint hits = hit_wide_children(node, slots, ray.origin, inv_direction, ray.t_max);
+        bool descend = false;
+        for (uint i = 0u; i < (hits >> 24u); ++i) {
+            const uint slot = (hits >> (3u * i)) & 7u;
+            const uint meta = wide_child_meta(node, slot);
+            const uvec2 offsets = wide_child_offsets(node, slot);
+            if (meta == wide_child_interior) {
+                const uint remaining = remaining_wide_children(hits, i + 1u);
+                if (remaining != 0u && stack_size < wide_bvh_stack_size) { stack[stack_size++] = uvec2(node_index, remaining); }
+                node_index = node.child_base + offsets.x;
+                slots = 0xffu;
+                descend = true;
+                break;
+            }
+
+            for (uint p = node.primitive_base + offsets.y; p < node.primitive_base + offsets.y + meta; ++p) {
+                const uint primitive = bvh_primitives[p];
+                if ((primitive & bvh_emissive_bit) != 0u) { continue; }
+                if (hit_surface_any(ray, primitive)) { return true; }
+            }
+        }
+        if (descend) { continue; }
+
+        if (stack_size == 0u) { break; }
+        --stack_size;
+        node_index = stack[stack_size].x;
+        slots = stack[stack_size].y;
+    }
+
+    return false;
+}
+
+// The same over the top-level BVH, down to the bottom-level ones of the instances it reaches
+bool intersect_any(Ray ray) {
+    const vec3 inv_direction = safe_inverse(ray.direction);
+    if (hit_aabb(tlas_nodes[0u].aabb_min, tlas_nodes[0u].aabb_max, ray.origin, inv_direction, ray.t_max) == no_hit) {
+        return false;
+    }
+
+    uint stack[bvh_stack_size];
+    uint stack_size = 0u;
+    uint node_index = 0u;
+    while (true) {
+        const BvhNode node = tlas_nodes[node_index];
+        if (node.count > 0u) {
+            for (uint i = 0u; i < node.count; ++i) {
+                const uint inst = tlas_instances[node.offset + i];
+                if (blas_any(world_to_object_ray(inst, ray), inst)) { return true; }
+            }
+        } else {
+            const uint left_index = node_index + 1u;
+            const uint right_index = node.offset;
+            const bool hit_left = hit_aabb(
+                tlas_nodes[left_index].aabb_min, tlas_nodes[left_index].aabb_max,
+                ray.origin, inv_direction, ray.t_max
+            ) != no_hit;
+            const bool hit_right = hit_aabb(
+                tlas_nodes[right_index].aabb_min, tlas_nodes[right_index].aabb_max,
+                ray.origin, inv_direction, ray.t_max
+            ) != no_hit;
+            if (hit_left) {
+                if (hit_right && stack_size < bvh_stack_size) { stack[stack_size++] = right_index; }
+                node_index = left_index;
+                continue;
+            }
+            if (hit_right) {
+                node_index = right_index;
+                continue;
+            }
+        }
+
+        if (stack_size == 0u) { break; }
+        node_index = stack[--stack_size];
+    }
+
+    return false;
+}
+
+// 64-bit add, compiled out unless count_rays is specialized to true
+void add_ray_count(uint count) {
+    if (!count_rays || count == 0u) { return; }
+    const uint low = atomicAdd(ray_count_low, count);
+    if (low + count < low) { atomicAdd(ray_count_high, 1u); } // carry
+}
+
+// The camera ray of a sample, through the jittered position in the pixel. With raster_primary
+//   it goes through the centre, where visibility.vert sampled the pixel: the jitter is drawn
+//   all the same, so the dimensions the path draws next do not move.
+Ray camera_ray(uvec2 coord, inout Sampler rng) {
+    vec2 jitter = sample_2d(rng);
+    if (raster_primary) { jitter = vec2(0.5f, 0.5f); }
+    const vec2 pixel_coord = vec2(
+        (float(coord.x) + jitter.x) / float(screen_size.x) * 2.0f - 1.0f,
+        1.0f - (float(coord.y) + jitter.y) / float(screen_size.y) * 2.0f
+    );
+
+    return generate_ray(current_camera(), pixel_coord);
+}
+
+// The hit of a camera ray: traced, or with raster_primary read from the visibility buffer,
+//   the distance recomputed from the barycentrics
+SurfaceHitRecord primary_hit(uint index, Ray ray) {
+    if (!raster_primary) { return hit_scene(ray); }
+
+    const uvec4 entry = visibility[index];
+    SurfaceHitRecord hit_record;
+    hit_record.inst = entry.x;
+    hit_record.prim = entry.y;
+    hit_record.bary = uintBitsToFloat(entry.zw);
+    hit_record.time = entry.y == ~0u ? ray.t_max : distance(ray.origin, triangle_point(entry.x, entry.y, hit_record.bary));
+
+    return hit_record;
+}
+
+uvec2 tile_count() { return (screen_size + tile_size - 1u) / tile_size; }
+
+// Interleaved rendering splits the screen into cells of 2x1 pixels (interleave 2, a
+//   checkerboard) or 2x2 pixels (interleave 4), a dispatch traces one pixel of every cell
+uvec2 interleave_cell_size() { return uvec2(interleave > 1u ? 2u : 1u, interleave > 2u ? 2u : 1u); }
+
+// The pixel of the cell the dispatch traces, another one every dispatch: the checkerboard
+//   swaps its diagonals, the 2x2 cells take the pixels 0, 3, 1, 2 so the diagonals alternate
+uvec2 interleave_offset(uvec2 cell) {
+    if (interleave > 2u) {
+        const uint slot = (0x2130u >> ((sample_index & 3u) * 4u)) & 3u;
+        return uvec2(slot & 1u, slot >> 1u);
+    }
+
+    return uvec2(interleave > 1u ? (cell.y + sample_index) & 1u : 0u, 0u);
+}
+
+// True for the pixels the per-pixel passes of this dispatch trace, all of them without interleaving
+bool interleaved_pixel(uvec2 coord) {
+    const uvec2 cell = coord / interleave_cell_size();
+
+    return all(equal(coord, cell * interleave_cell_size() + interleave_offset(cell)));
+}
+
+// Pixel of the invocation in a per-pixel pass: the whole screen is dispatched, with adaptive
+//   sampling one workgroup per active tile, with interleaving one invocation per cell.
+//   False for no pixel.
+bool invocation_pixel(out uvec2 coord) {
+    coord = gl_GlobalInvocationID.xy;
+    if (adaptive_sampling) {
+        const uint tile_index = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+        if (tile_index >= tile_queue.count) { return false; }
+        const uint tile = active_tiles[tile_index];
+        coord = uvec2(tile % tile_count().x, tile / tile_count().x) * tile_size + gl_LocalInvocationID.xy;
+    } else if (interleave > 1u) {
+        coord = coord * interleave_cell_size() + interleave_offset(coord);
+    }
+
+    return coord.x < screen_size.x && coord.y < screen_size.y;
+}
+
+float luminance(vec3 color) { return dot(vec3(0.212671f, 0.715160f, 0.072169f), color); }
+
+// Called when sample_index == 0, before the first accumulate_pixel()
+void reset_pixel(uint index) {
+    pixel_colors[index] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    pixel_stats[index] = vec4(0.0f);
+}
+
+// Blends the mean radiance of the spp_per_dispatch samples of a dispatch into the pixel,
+//   weighted by its share of the samples drawn. The pixel keeps its own counts, adaptive
+//   sampling skips converged pixels so they can fall behind sample_index. The variance is
+//   over the dispatch means.
+void accumulate_pixel(uint index, vec3 radiance) {
+    if (any(isnan(radiance))) { radiance = vec3(0.0f, 0.0f, 0.0f); }
+    const vec3 pixel_color = vec3(clamp(radiance, 0.0f, 30.0f));
+
+    vec4 stats = pixel_stats[index];
+    const float n = stats.x + 1.0f;
+    stats.w += float(spp_per_dispatch);
+    pixel_colors[index] = vec4(mix(pixel_colors[index].xyz, pixel_color, float(spp_per_dispatch) / stats.w), 1.0f);
+
+    const float l = luminance(pixel_color);
+    const float delta = l - stats.y;
+    stats.x = n;
+    stats.y += delta / n;
+    stats.z += delta * (l - stats.y);
+    pixel_stats[index] = stats;
+}
+
+// Standard error of the mean luminance relative to the mean, dark pixels are
+//   compared against a floor so they do not need an absurd sample count
+bool pixel_converged(vec4 stats) {
+    if (stats.x < float(adaptive_min_samples)) { return false; }
+    const float variance_of_mean = stats.z / ((stats.x - 1.0f) * stats.x);
+
+    return sqrt(variance_of_mean) <= adaptive_threshold * max(stats.y, 1e-2f);
+}
+
+vec3 get_color(uint index) { return scene_materials[indices[index].material].albedo.xyz; }
+
+vec3 get_emission(uint index) { return scene_materials[indices[index].material].emission.xyz; }
+
+// Lights end the path: they are neither reflected off nor block shadow rays
+bool is_emissive(uint index) { return any(greaterThan(get_emission(index), vec3(0.0f, 0.0f, 0.0f))); }
+
+struct LightSample {
+    vec3 position;
+    vec3 normal; // the side the triangle emits to
+    vec3 emission;
+    float pdf_area; // 0 without lights
+    uint inst;
+    uint prim;
+    vec2 bary;
+};
+
+// Triangles are picked proportional to area * luminance(emission), the pdf of a point
+//   with respect to area is then the same luminance(emission) / light_power on each of them
+float light_pdf_area(uint index) { return luminance(get_emission(index)) / light_power; }
+
+// The point at bary of an emissive triangle of an instance, as sample_light() returns it
+LightSample light_at(uint inst, uint prim, vec2 bary) {
+    return LightSample(
+        triangle_point(inst, prim, bary), geometric_normal(inst, prim), get_emission(prim), light_pdf_area(prim),
+        inst, prim, bary
+    );
+}
+
+// An emissive triangle in O(1) from the alias table, then a uniform point on it
+LightSample sample_light(inout Sampler rng) {
+    const float u_select = sample_1d(rng);
+    const vec2 u_point = sample_2d(rng);
+    if (light_count == 0u) {
+        return LightSample(vec3(0.0f), vec3(0.0f, 1.0f, 0.0f), vec3(0.0f), 0.0f, ~0u, ~0u, vec2(0.0f));
+    }
+
+    const float scaled = u_select * float(light_count);
+    const uint bucket = min(uint(scaled), light_count - 1u);
+    const LightAlias entry = scaled - float(bucket) < light_aliases[bucket].probability
+        ? light_aliases[bucket]
+        : light_aliases[light_aliases[bucket].alias];
+    const float r = sqrt(u_point.x);
+
+    return light_at(entry.instance, entry.triangle, vec2(r * (1.0f - u_point.y), r * u_point.y));
+}
+
+// Emissive surfaces get a white albedo, so their radiance passes the demodulation of the denoiser
+void accumulate_first_hit(uint index, uint sample_number, uint inst, uint prim, float time) {
+    vec3 albedo = vec3(0.0f, 0.0f, 0.0f);
+    vec4 normal_depth = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    if (prim != ~0u) {
+        albedo = is_emissive(prim) ? vec3(1.0f, 1.0f, 1.0f) : get_color(prim);
+        normal_depth = vec4(geometric_normal(inst, prim), time);
+    }
+
+    const float weight = 1.0f / float(sample_number + 1u);
+    pixel_aovs[index].albedo = mix(pixel_aovs[index].albedo, vec4(albedo, 1.0f), weight);
+    pixel_aovs[index].normal_depth = mix(pixel_aovs[index].normal_depth, normal_depth, weight);
+}
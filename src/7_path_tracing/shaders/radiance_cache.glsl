@@ -0,0 +1,119 @@
+// World-space radiance cache of the megakernel (RenderConfig::radiance_cache), a hash table of
+//   cells keyed by the position, the dominant axis of the normal and a level of detail: the
+//   cells grow with the distance to the camera, as in spatially hashed radiance caches.
+// Every path vertex adds the radiance it sends back along the path to its cell. From the
+//   second bounce on, a path stops at a cell with enough samples and takes its radiance
+//   instead of tracing further. radiance_cache_resolve.comp runs after the megakernel: it
+//   folds the samples of the dispatch into the radiance the lookups read, and frees the
+//   cells no path reaches any more.
+// The lookups bias the image: the cached radiance is the mean over a cell, a dispatch behind.
+
+// Included after path_tracing.glsl, or after restir.glsl which includes it: the shared
+//   include has no guard.
+
+
+struct RadianceCacheCell {
+    uint key; // radiance_cache_key().y of the cell, 0: free
+    uint age; // resolves without a sample, freed at radiance_cache_max_age
+    uint sample_count; // added in this dispatch
+    uint padding;
+    uvec4 radiance; // sum of this dispatch in radiance_cache_fixed_point steps, w unused
+    vec4 resolved; // xyz: mean radiance, w: samples behind it, up to radiance_cache_max_samples
+};
+
+
+// A path vertex that adds its outgoing radiance to its cell when the path ends: what the
+//   path gathered after it, divided by the throughput up to it
+struct RadianceCacheVertex {
+    uint cell;
+    vec3 beta;
+    vec3 radiance; // the radiance of the invocation when the path reached the vertex
+};
+
+
+layout(set = 0, binding = 29, std430) buffer RadianceCache { RadianceCacheCell radiance_cache_cells[]; }; // hash table
+
+
+const uint radiance_cache_cell_count = 1u << 18u; // RADIANCE_CACHE_CELL_COUNT
+const uint radiance_cache_probe_count = 8u; // slots tried from the hashed one on
+const float radiance_cache_cell_size = 0.005f; // of level 0, every level doubles it
+const float radiance_cache_cell_spread = 0.005f; // the cells are about that size per unit of distance to the camera
+const uint radiance_cache_level_count = 16u;
+const float radiance_cache_fixed_point = 256.0f; // steps per unit of radiance in the sums
+const float radiance_cache_max_radiance = 32.0f; // per sample: a cell takes 2^19 samples a dispatch before its sums overflow
+const float radiance_cache_min_samples = 8.0f; // behind a radiance a path may stop at
+const float radiance_cache_max_samples = 256.0f; // then the mean becomes a moving average
+const uint radiance_cache_max_age = 64u;
+const uint radiance_cache_lookup_depth = 2u; // the hit after the first secondary bounce
+const uint radiance_cache_path_vertices = 4u; // the first vertices of a path write to the cache
+const uint radiance_cache_training_ratio = 8u; // 1 in that many samples ignores the cache
+
+
+uint radiance_cache_hash(ivec3 grid, uint lod, uint seed) {
+    uint h = hash_uint(seed ^ uint(grid.x));
+    h = hash_uint(h ^ uint(grid.y));
+    h = hash_uint(h ^ uint(grid.z));
+
+    return hash_uint(h ^ lod);
+}
+
+// x: the slot the probes start from, y: the key of the cell, never 0. Both hash the cell
+//   with another seed, so cells that share a slot still tell each other apart.
+uvec2 radiance_cache_key(vec3 position, vec3 normal) {
+    const float distance = length(position - camera_uniform.position.xyz);
+    const uint level = uint(clamp(
+        floor(log2(max(distance * radiance_cache_cell_spread / radiance_cache_cell_size, 1.0f))),
+        0.0f, float(radiance_cache_level_count - 1u)
+    ));
+    const ivec3 grid = ivec3(floor(position / (radiance_cache_cell_size * exp2(float(level)))));
+
+    const vec3 a = abs(normal);
+    const uint axis = a.x >= a.y && a.x >= a.z ? 0u : (a.y >= a.z ? 1u : 2u);
+    const uint lod = level | ((2u * axis + (normal[axis] < 0.0f ? 1u : 0u)) << 4u);
+
+    return uvec2(
+        radiance_cache_hash(grid, lod, 0u) % radiance_cache_cell_count,
+        max(radiance_cache_hash(grid, lod, 0x5bd1e995u), 1u)
+    );
+}
+
+// The cell of the key, ~0u when it is not in the table
+uint find_radiance_cache_cell(uvec2 key) {
+    for (uint i = 0u; i < radiance_cache_probe_count; ++i) {
+        const uint cell = (key.x + i) % radiance_cache_cell_count;
+        if (radiance_cache_cells[cell].key == key.y) { return cell; }
+    }
+
+    return ~0u;
+}
+
+// The cell of the key, or a free one claimed for it, ~0u when the probed slots are taken.
+//   A cell freed before the one of the key is claimed again, the lookups then find the new
+//   cell first and the old one ages out.
+uint insert_radiance_cache_cell(uvec2 key) {
+    for (uint i = 0u; i < radiance_cache_probe_count; ++i) {
+        const uint cell = (key.x + i) % radiance_cache_cell_count;
+        const uint previous = atomicCompSwap(radiance_cache_cells[cell].key, 0u, key.y);
+        if (previous == 0u || previous == key.y) { return cell; }
+    }
+
+    return ~0u;
+}
+
+// xyz: mean radiance, w: samples behind it, 0 without the cell
+vec4 cached_radiance(uint cell) { return cell == ~0u ? vec4(0.0f, 0.0f, 0.0f, 0.0f) : radiance_cache_cells[cell].resolved; }
+
+void add_radiance_cache_sample(uint cell, vec3 radiance) {
+    if (cell == ~0u || any(isnan(radiance))) { return; }
+    const uvec3 steps = uvec3(clamp(radiance, 0.0f, radiance_cache_max_radiance) * radiance_cache_fixed_point + 0.5f);
+    atomicAdd(radiance_cache_cells[cell].radiance.x, steps.x);
+    atomicAdd(radiance_cache_cells[cell].radiance.y, steps.y);
+    atomicAdd(radiance_cache_cells[cell].radiance.z, steps.z);
+    atomicAdd(radiance_cache_cells[cell].sample_count, 1u);
+}
+
+// The other samples stop at the cache, these trace the whole path so the cells they stop at
+//   keep learning from more than their own cached radiance
+bool radiance_cache_training_sample(uint index, uint sample_number) {
+    return hash_uint(hash_combine(hash_uint(index), sample_number)) % radiance_cache_training_ratio == 0u;
+}
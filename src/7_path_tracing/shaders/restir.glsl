@@ -0,0 +1,141 @@
+// Reservoir-based spatiotemporal importance resampling of direct lighting (ReSTIR DI,
+//   Bitterli et al. 2020) at the primary hit of the first sample of every dispatch.
+//   PathTracing::record_restir_passes() runs, before the megakernel:
+//   restir_initial (candidates from the light alias table, visibility of the survivor)
+//   -> restir_temporal (the reservoir of the previous dispatch, reprojected)
+//   -> restir_spatial (neighbouring reservoirs of this dispatch)
+//   and the megakernel shades with the result in reservoir_direct_lighting().
+// The reuse is the biased one of the paper: reused samples are not traced again for
+//   visibility at the pixel that reuses them, only the final one is.
+
+#include "path_tracing.glsl"
+
+
+// The light sample y a reservoir kept out of the weight_sum of the candidates it saw
+struct Reservoir {
+    vec2 light_bary;
+    uint light_triangle; // ~0u: empty
+    float weight_sum;
+    float m; // candidates seen
+    float contribution_weight; // W = weight_sum / (m * target_pdf(y)), an estimate of 1 / pdf(y)
+    uint light_instance;
+    uint padding;
+};
+
+
+// The primary hit the reservoirs of a pixel belong to
+struct RestirSurface {
+    vec3 position;
+    uint prim; // ~0u: the camera ray missed
+    vec3 normal;
+    float distance; // to the camera
+};
+
+
+const uint restir_pixel_count = screen_size.x * screen_size.y;
+const uint restir_candidate_count = 32u; // light samples streamed through the initial reservoir
+const float restir_history_limit = 20.0f; // the previous reservoir counts for at most that many current ones
+const uint restir_spatial_count = 4u; // neighbours per pixel
+const float restir_spatial_radius = 16.0f; // pixels
+const float restir_depth_tolerance = 0.1f; // relative distance to the camera of a reusable neighbour
+const float restir_normal_tolerance = 0.9f; // minimal cosine
+// First Sampler dimensions of the passes, past the ones a path of the megakernel draws
+const uint restir_initial_dimension = 1024u;
+const uint restir_temporal_dimension = restir_initial_dimension + 3u * restir_candidate_count;
+const uint restir_spatial_dimension = restir_temporal_dimension + 1u;
+
+// [0, pixels): initial and temporal reservoirs of this dispatch, then the final reservoirs
+//   of the even and of the odd dispatches, so the previous ones survive the spatial pass
+layout(set = 0, binding = 23, std430) buffer Reservoirs { Reservoir reservoirs[]; }; // 3 x pixels
+// The surfaces of the even and of the odd dispatches
+layout(set = 0, binding = 24, std430) buffer RestirSurfaces { RestirSurface restir_surfaces[]; }; // 2 x pixels
+
+uint final_reservoir_slot(uint index, uint dispatch) { return (1u + (dispatch & 1u)) * restir_pixel_count + index; }
+uint restir_surface_slot(uint index, uint dispatch) { return (dispatch & 1u) * restir_pixel_count + index; }
+
+// The sample number of the first sample the megakernel draws in this dispatch, it resets the
+//   pixel after restir_initial.comp read pixel_stats when sample_index == 0
+uint restir_sample_number(uint index) { return sample_index == 0u ? 0u : first_sample_number(index); }
+
+Reservoir empty_reservoir() { return Reservoir(vec2(0.0f), ~0u, 0.0f, 0.0f, 0.0f, ~0u, 0u); }
+
+// Weighted reservoir sampling: keeps the new sample with probability weight / weight_sum
+bool reservoir_update(inout Reservoir reservoir, uint instance, uint triangle, vec2 bary, float weight, float m, float u) {
+    reservoir.weight_sum += weight;
+    reservoir.m += m;
+    if (weight > 0.0f && u * reservoir.weight_sum < weight) {
+        reservoir.light_instance = instance;
+        reservoir.light_triangle = triangle;
+        reservoir.light_bary = bary;
+        return true;
+    }
+
+    return false;
+}
+
+// targetPdf: of the sample the reservoir kept
+void reservoir_finalize(inout Reservoir reservoir, float targetPdf) {
+    reservoir.contribution_weight = targetPdf > 0.0f ? reservoir.weight_sum / (reservoir.m * targetPdf) : 0.0f;
+}
+
+// Unshadowed diffuse reflection of the light sample, the luminance of it
+float restir_target_pdf(vec3 position, vec3 normal, vec3 albedo, LightSample light) {
+    const vec3 to_light = light.position - position;
+    const float distance_squared = dot(to_light, to_light);
+    const vec3 wi = to_light * inversesqrt(distance_squared);
+    const float cos_surface = dot(normal, wi);
+    const float cos_light = -dot(light.normal, wi);
+    if (cos_surface <= 1e-4f || cos_light <= 1e-4f) { return 0.0f; }
+
+    return luminance(light.emission * albedo) * inv_pi * cos_surface * cos_light / distance_squared;
+}
+
+// Target pdf of the sample of a reservoir at another surface, 0 for an empty reservoir
+float restir_target_pdf(RestirSurface surface, Reservoir reservoir) {
+    if (reservoir.light_triangle == ~0u || surface.prim == ~0u) { return 0.0f; }
+
+    return restir_target_pdf(
+        surface.position, surface.normal, get_color(surface.prim),
+        light_at(reservoir.light_instance, reservoir.light_triangle, reservoir.light_bary)
+    );
+}
+
+// Streams a reservoir into another one as a single candidate standing for its m
+bool reservoir_combine(inout Reservoir combined, Reservoir reservoir, float targetPdf, float u) {
+    return reservoir_update(
+        combined, reservoir.light_instance, reservoir.light_triangle, reservoir.light_bary,
+        targetPdf * reservoir.contribution_weight * reservoir.m, reservoir.m, u
+    );
+}
+
+// A neighbour's reservoir is only reused when it sampled about the same surface
+bool restir_similar(RestirSurface surface, RestirSurface other) {
+    return other.prim != ~0u
+        && abs(other.distance - surface.distance) <= restir_depth_tolerance * surface.distance
+        && dot(other.normal, surface.normal) >= restir_normal_tolerance;
+}
+
+// Offset as the next event estimation of the megakernel does it
+bool light_visible(vec3 position, vec3 normal, LightSample light) {
+    const vec3 pp = offset_ray_origin(position, normal);
+    const vec3 pp_light = offset_ray_origin(light.position, light.normal);
+
+    return !intersect_any(make_ray(offset_ray_origin(pp, normal), normalize(pp_light - pp), distance(pp, pp_light)));
+}
+
+// Direct lighting at the primary hit (p, n) of the pixel: the sample of its final
+//   reservoir, traced for visibility and weighted by the contribution weight
+vec3 reservoir_direct_lighting(uint index, vec3 p, vec3 n, vec3 albedo) {
+    const Reservoir reservoir = reservoirs[final_reservoir_slot(index, sample_index)];
+    if (reservoir.light_triangle == ~0u || reservoir.contribution_weight <= 0.0f) { return vec3(0.0f, 0.0f, 0.0f); }
+
+    const LightSample light = light_at(reservoir.light_instance, reservoir.light_triangle, reservoir.light_bary);
+    const vec3 to_light = light.position - p;
+    const float distance_squared = dot(to_light, to_light);
+    const vec3 wi = to_light * inversesqrt(distance_squared);
+    const float cos_surface = dot(n, wi);
+    const float cos_light = -dot(light.normal, wi);
+    if (cos_surface <= 1e-4f || cos_light <= 1e-4f || !light_visible(p, n, light)) { return vec3(0.0f, 0.0f, 0.0f); }
+
+    return albedo * inv_pi * cos_surface * light.emission * cos_light / distance_squared * reservoir.contribution_weight;
+}
@@ -0,0 +1,12 @@
+#version 450
+
+layout(location = 0) in vec2 bary;
+layout(location = 1) flat in uint inst;
+layout(location = 2) flat in uint prim;
+layout(location = 0) out uvec4 visibility;
+
+
+// The closest triangle at the pixel centre, see visibility_hit() of path_tracing.glsl
+void main() {
+    visibility = uvec4(inst, prim, floatBitsToUint(bary));
+}
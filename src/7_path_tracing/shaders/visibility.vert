@@ -0,0 +1,73 @@
+#version 450
+
+// Rasterizes the primary hits of RenderConfig::raster_primary into the visibility buffer, a
+//   draw per instance without vertex buffers: gl_VertexIndex is a corner of a triangle of the
+//   mesh, gl_InstanceIndex the instance. The corner becomes a barycentric coordinate the
+//   rasterizer interpolates. The projection is the one of generate_ray() through the pixel
+//   centres, with reversed depth and no far plane: visibility_near maps to 1, infinity to 0.
+
+// The std430 / std140 structs of path_tracing.glsl the draw reads
+struct PackedTriangle {
+    vec4 v0; // w unused
+    vec4 e1; // v1 - v0, w unused
+    vec4 e2; // v2 - v0, w unused
+    vec4 normal; // w unused
+};
+
+struct Instance {
+    vec4 object_to_world[3];
+    vec4 world_to_object[3];
+    uint mesh;
+    uint blas_root;
+    uvec2 padding;
+};
+
+struct CameraUniform {
+    vec4 position; // w: vertical field of view in degrees
+    vec4 front;
+    vec4 up;
+    vec4 right;
+};
+
+layout(set = 0, binding = 0, std140) uniform UniformBuffer {
+    CameraUniform camera_uniform;
+    CameraUniform previous_camera_uniform;
+    uint sample_index;
+};
+layout(set = 0, binding = 1, std430) readonly buffer PackedTriangles { PackedTriangle triangles[]; };
+layout(set = 0, binding = 26, std430) readonly buffer Instances { Instance instances[]; };
+
+layout(constant_id = 0) const uint screen_width = 1920u; // same ids as the compute shaders
+layout(constant_id = 1) const uint screen_height = 1080u;
+const float visibility_near = 1e-3f;
+
+layout(location = 0) out vec2 bary;
+layout(location = 1) flat out uint inst;
+layout(location = 2) flat out uint prim;
+
+
+void main() {
+    prim = uint(gl_VertexIndex) / 3u;
+    inst = uint(gl_InstanceIndex);
+    const uint corner = uint(gl_VertexIndex) % 3u;
+    bary = vec2(corner == 1u ? 1.0f : 0.0f, corner == 2u ? 1.0f : 0.0f);
+
+    const vec4 p_object = vec4(
+        triangles[prim].v0.xyz + bary.x * triangles[prim].e1.xyz + bary.y * triangles[prim].e2.xyz, 1.0f
+    );
+    const vec3 p = vec3(
+        dot(instances[inst].object_to_world[0], p_object),
+        dot(instances[inst].object_to_world[1], p_object),
+        dot(instances[inst].object_to_world[2], p_object)
+    );
+
+    const vec3 d = p - camera_uniform.position.xyz;
+    const float tan_half_fov = tan(0.5f * radians(camera_uniform.position.w));
+    const float aspect_ratio = float(screen_width) / float(screen_height);
+    gl_Position = vec4(
+        dot(d, camera_uniform.right.xyz) / (tan_half_fov * aspect_ratio),
+        -dot(d, camera_uniform.up.xyz) / tan_half_fov, // the rows of the framebuffer go down
+        visibility_near,
+        dot(d, camera_uniform.front.xyz)
+    );
+}
@@ -0,0 +1,67 @@
+// Path state and queues shared by the wavefront passes, the host records them in
+//   PathTracing::record_wavefront_passes():
+//   (generate -> (extend -> shade -> connect) x depth_per_dispatch) x spp_per_dispatch -> accumulate
+// Every pixel owns one path (path index == pixel index) at a time, its radiance
+//   is summed over the spp_per_dispatch samples. With adaptive sampling only the
+//   pixels of the active tiles start paths.
+
+#include "path_tracing.glsl"
+
+
+struct PathState {
+    vec3 origin;
+    uint sample_number; // Sampler of the path, the pixel seed is hashed from the path index
+    vec3 direction;
+    float pdf_bsdf; // pdf of the bsdf sample that generated direction
+    vec3 beta;
+    uint dimension;
+    vec3 radiance;
+    uint padding1;
+};
+
+
+struct PathHit {
+    uint prim;
+    float time;
+    vec2 bary;
+    uint inst;
+    uint padding;
+};
+
+
+struct ShadowRay {
+    vec3 origin;
+    float t_max;
+    vec3 direction;
+    uint path;
+    vec3 contribution; // added to the radiance of the path when the ray is not occluded
+    uint padding;
+};
+
+
+const uint wavefront_group_size = 64u;
+const uint wavefront_path_count = screen_size.x * screen_size.y;
+// queues[0] and queues[1] hold the extension rays of the even and odd bounces
+const uint shadow_queue = 2u;
+
+layout(set = 0, binding = 6, std430) buffer PathStates { PathState path_states[]; }; // path states
+layout(set = 0, binding = 7, std430) buffer PathHits { PathHit path_hits[]; }; // closest hits of the extension rays
+layout(set = 0, binding = 8, std430) buffer Queues { Queue queues[3]; }; // queue counters and indirect dispatches
+layout(set = 0, binding = 9, std430) buffer RayQueues { uint ray_queues[]; }; // 2 x wavefront_path_count path indices
+layout(set = 0, binding = 10, std430) buffer ShadowRays { ShadowRay shadow_rays[]; }; // shadow queue
+layout(push_constant) uniform WavefrontConstants {
+    uint bounce;
+    uint path_sample; // 0 - spp_per_dispatch-1, the paths of a pixel are traced one after the other
+};
+
+Sampler path_sampler(uint path, PathState state) {
+    Sampler rng = make_sampler(path, state.sample_number);
+    rng.dimension = state.dimension;
+    return rng;
+}
+
+uint ray_queue(uint bounce_index) { return bounce_index & 1u; }
+
+Queue empty_queue() { return Queue(1u, 1u, 1u, 0u); }
+
+uint dispatch_size(uint count) { return max((count + wavefront_group_size - 1u) / wavefront_group_size, 1u); }
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <optional>
+#include <vector>
+
+
+namespace scheduling {
+
+// Runs a task over the items [0, itemCount) on a fixed number of threads. The items are
+//   dealt out in contiguous runs, one deque per worker: a worker pops its own items from the
+//   front and, once they are gone, steals from the back of the other deques, away from where
+//   their owners work. Items that take much longer than the others (a tile of the light, of
+//   the glossy corners...) then do not leave the other threads idle at the end of a pass.
+//   The workers besides the calling thread live in a bvh::ThreadPool for the lifetime of
+//   the scheduler, a run() hands them one task each rather than starting threads.
+class WorkStealingScheduler {
+public:
+    explicit WorkStealingScheduler(std::uint32_t threadCount)
+        : queues(std::max(threadCount, 1u)), pool(std::max(threadCount, 1u) - 1u)
+    {
+        for (auto& queue : queues) { queue = std::make_unique<WorkerQueue>(); }
+    }
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    std::uint32_t size() const { return static_cast<std::uint32_t>(queues.size()); }
+    // Items the workers took from another deque during the last run()
+    std::uint64_t steal_count() const { return steals; }
+
+    // task(worker, item) with worker in [0, size()), returns once every item ran. The calling
+    //   thread is worker 0. Tasks must not throw.
+    template <typename Task>
+    void run(std::uint32_t itemCount, const Task& task) {
+        const std::uint32_t worker_count = size();
+        for (std::uint32_t worker { 0u }; worker < worker_count; ++worker) {
+            WorkerQueue& queue = *queues[worker];
+            queue.range.store(
+                pack(itemCount * worker / worker_count, itemCount * (worker + 1u) / worker_count), std::memory_order_relaxed
+            );
+            queue.steals = 0u;
+        }
+
+        // The futures order the stores above before the workers start, and their work before get()
+        std::vector<std::future<void>> workers;
+        workers.reserve(worker_count - 1u);
+        for (std::uint32_t worker { 1u }; worker < worker_count; ++worker) {
+            workers.push_back(pool.submit([this, worker, &task] () { work(worker, task); }));
+        }
+        work(0u, task);
+        for (auto& worker : workers) { worker.get(); }
+
+        steals = 0u;
+        for (const auto& queue : queues) { steals += queue->steals; }
+    }
+
+private:
+    // A cache line each. No item is added during a run, so a deque is the range [front, back)
+    //   of its items in one word: the owner and the thieves take an item with a single
+    //   compare-exchange instead of a lock.
+    struct alignas(64) WorkerQueue {
+        std::atomic<std::uint64_t> range { 0u }; // front in the low 32 bits, back in the high
+        std::uint64_t steals { 0u }; // written by the owner only
+    };
+
+    static std::uint64_t pack(std::uint32_t front, std::uint32_t back) {
+        return std::uint64_t { front } | std::uint64_t { back } << 32u;
+    }
+
+    std::optional<std::uint32_t> pop(std::uint32_t worker) {
+        std::atomic<std::uint64_t>& range = queues[worker]->range;
+        std::uint64_t current = range.load(std::memory_order_relaxed);
+        while (true) {
+            const auto front = static_cast<std::uint32_t>(current);
+            const auto back = static_cast<std::uint32_t>(current >> 32u);
+            if (front == back) { return std::nullopt; }
+            if (range.compare_exchange_weak(current, pack(front + 1u, back), std::memory_order_relaxed)) { return front; }
+        }
+    }
+
+    // The victims are tried from the next worker on, so the thieves spread over them
+    std::optional<std::uint32_t> steal(std::uint32_t worker) {
+        const std::uint32_t worker_count = size();
+        for (std::uint32_t offset { 1u }; offset < worker_count; ++offset) {
+            std::atomic<std::uint64_t>& range = queues[(worker + offset) % worker_count]->range;
+            std::uint64_t current = range.load(std::memory_order_relaxed);
+            while (true) {
+                const auto front = static_cast<std::uint32_t>(current);
+                const auto back = static_cast<std::uint32_t>(current >> 32u);
+                if (front == back) { break; }
+                if (range.compare_exchange_weak(current, pack(front, back - 1u), std::memory_order_relaxed)) { return back - 1u; }
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // No item is added during a run, so a worker that finds every deque empty is done
+    template <typename Task>
+    void work(std::uint32_t worker, const Task& task) {
+        while (true) {
+            std::optional<std::uint32_t> item = pop(worker);
+            if (!item) {
+                item = steal(worker);
+                if (!item) { return; }
+                ++queues[worker]->steals;
+            }
+            task(worker, *item);
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::uint64_t steals { 0u };
+    bvh::ThreadPool pool; // declared last: its threads are joined before the queues go
+};
+
+} // namespace scheduling end
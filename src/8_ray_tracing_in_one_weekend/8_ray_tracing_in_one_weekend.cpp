@@ -13,6 +13,7 @@
 #include <glm/gtc/random.hpp>
 
 #include "minilog.hpp"
+#include <hdr_image_writer.hpp>
 #include "constantData.hpp"
 #include "camera.hpp"
 #include "image.hpp"
@@ -68,12 +69,14 @@ struct RayTracingWithComputeShader {
     HittableDump hittables;
     MaterialDump materials;
     const std::size_t maxSamplesForSingleShader = 50;
+    std::string hdrOutput; // --output <file.pfm|.exr>, the PPM alone when empty
 
     RayTracingWithComputeShader(
         const uint32_t& w,
-        const uint32_t& h
+        const uint32_t& h,
+        const std::string& hdrOutputPath = {}
     )
-        : width(w), height(h)
+        : width(w), height(h), hdrOutput(hdrOutputPath)
     {}
 
     ~RayTracingWithComputeShader() { cleanUp(); }
@@ -797,9 +800,20 @@ struct RayTracingWithComputeShader {
         logicalDevice.unmapMemory(memory);
 	}
 
+    // The linear result before gamma and clamping, from the copy output() read back
+    void outputHdr() {
+        std::filesystem::path out(hdrOutput);
+        if (hdr::write_hdr(out.string(), reinterpret_cast<const float*>(target.imageData.data()), width, height)) {
+            std::cout << "HDR Output Path: " << std::filesystem::absolute(out) << "\n";
+        } else {
+            minilog::log_error("failed to write {}!", out.string());
+        }
+    }
+
     bool finish = false;
     void output() {
         ReadMemory(storageBufferMemorys[0], target.imageData.data(), target.imageSize());
+        if (!hdrOutput.empty()) { outputHdr(); }
         std::filesystem::path out("./RenderingTarget.ppm");
         auto absPath = std::filesystem::absolute(out);
         std::cout << "Output Path: " << absPath << "\n";
@@ -831,7 +845,19 @@ struct RayTracingWithComputeShader {
 
 
 int main(int argc, const char* argv[]) {
-    RayTracingWithComputeShader app { 800u, 600u };
+    std::string hdrOutput;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument { argv[i] };
+        if (argument == "--output" && i + 1 < argc && hdr::is_hdr_file(argv[i + 1])) {
+            hdrOutput = argv[++i];
+        } else {
+            minilog::log_error("invalid argument: {}", argument);
+            minilog::log_info("usage: 8_ray_tracing_in_one_weekend [--output <file.pfm|.exr>]");
+            return EXIT_FAILURE;
+        }
+    }
+
+    RayTracingWithComputeShader app { 800u, 600u, hdrOutput };
 
     try {
         app.run();
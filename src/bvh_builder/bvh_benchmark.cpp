@@ -0,0 +1,125 @@
+// Builds the BVH of a few models with 1 thread and with all hardware threads, then collapses
+//   it into 4- and 8-wide nodes, run from the repository root: ./bvh_benchmark [model.obj ...]
+#include <bvh_builder.hpp>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <minilog.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Same layout as the Vertex/Triangle of 7_path_tracing, only the positions matter here
+struct Vertex {
+    glm::vec3 position;
+};
+
+struct Triangle {
+    std::uint32_t t0;
+    std::uint32_t t1;
+    std::uint32_t t2;
+};
+
+constexpr std::uint32_t RUN_COUNT { 5u };
+
+
+bool load_obj_model(const std::string& path, std::vector<Vertex>& vertices, std::vector<Triangle>& triangles) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn;
+    std::string err;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), nullptr)) {
+        minilog::log_error("failed to load {}: {}{}", path, warn, err);
+        return false;
+    }
+
+    vertices.clear();
+    triangles.clear();
+    for (std::size_t i { 0uz }; i + 2uz < attrib.vertices.size(); i += 3uz) {
+        vertices.push_back(Vertex { .position = { attrib.vertices[i], attrib.vertices[i + 1uz], attrib.vertices[i + 2uz] } });
+    }
+    for (const tinyobj::shape_t& shape : shapes) {
+        const std::vector<tinyobj::index_t>& shape_indices = shape.mesh.indices;
+        for (std::size_t i { 0uz }; i + 2uz < shape_indices.size(); i += 3uz) {
+            triangles.push_back(Triangle {
+                .t0 = static_cast<std::uint32_t>(shape_indices[i].vertex_index),
+                .t1 = static_cast<std::uint32_t>(shape_indices[i + 1uz].vertex_index),
+                .t2 = static_cast<std::uint32_t>(shape_indices[i + 2uz].vertex_index)
+            });
+        }
+    }
+
+    return true;
+}
+
+bvh::Bvh benchmark(const std::vector<bvh::Aabb>& bounds, std::uint32_t threadCount) {
+    bvh::BuildOptions options { .thread_count = threadCount };
+
+    bvh::Bvh bvh;
+    double best_ms { std::numeric_limits<double>::max() };
+    for (std::uint32_t run { 0u }; run < RUN_COUNT; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        bvh = bvh::build(bounds, options);
+        const auto stop = std::chrono::steady_clock::now();
+        best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+
+    minilog::log_info(
+        "  {:>2} threads: {:.2f} ms (best of {}), {} nodes, depth {}, SAH cost {:.2f}",
+        threadCount, best_ms, RUN_COUNT, bvh.nodes.size(), bvh.depth, bvh.sah_cost()
+    );
+
+    return bvh;
+}
+
+void report_collapse(const bvh::Bvh& binary, std::uint32_t width) {
+    const auto start = std::chrono::steady_clock::now();
+    const bvh::WideBvh wide = bvh::collapse(binary, bvh::CollapseOptions { .width = width });
+    const auto stop = std::chrono::steady_clock::now();
+
+    minilog::log_info(
+        "  {}-wide: {:.2f} ms, {} nodes ({} KiB, binary {} KiB), depth {}",
+        width, std::chrono::duration<double, std::milli>(stop - start).count(), wide.nodes.size(),
+        wide.nodes.size() * sizeof(bvh::WideNode) / 1024uz, binary.nodes.size() * sizeof(bvh::Node) / 1024uz, wide.depth
+    );
+}
+
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths;
+    for (int i { 1 }; i < argc; ++i) { paths.emplace_back(argv[i]); }
+    if (paths.empty()) {
+        paths = {
+            "./resource/cornell_box.obj",
+            "./resource/viking_room.obj",
+            "./src/4_object_viewer/models/flat_vase.obj",
+            "./src/4_object_viewer/models/smooth_vase.obj"
+        };
+    }
+
+    const std::uint32_t hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (const std::string& path : paths) {
+        std::vector<Vertex> vertices;
+        std::vector<Triangle> triangles;
+        if (!load_obj_model(path, vertices, triangles)) { continue; }
+
+        const std::vector<bvh::Aabb> bounds = bvh::triangle_bounds(vertices, triangles);
+        minilog::log_info("{}: {} triangles", path, triangles.size());
+        const bvh::Bvh binary = benchmark(bounds, 1u);
+        if (hardware_threads > 1u) { benchmark(bounds, hardware_threads); }
+        report_collapse(binary, 4u);
+        report_collapse(binary, bvh::WIDE_NODE_CHILDREN);
+    }
+
+    return 0;
+}
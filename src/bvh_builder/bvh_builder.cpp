@@ -0,0 +1,416 @@
+#include "bvh_builder.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <thread>
+
+
+namespace bvh {
+
+namespace {
+
+struct Range {
+    std::uint32_t first;
+    std::uint32_t count;
+};
+
+// Primitives are partitioned by value so every pass over a range reads memory sequentially
+struct Primitive {
+    Aabb bounds;
+    glm::vec3 centroid;
+    std::uint32_t index;
+};
+
+struct Bin {
+    Aabb bounds;
+    std::uint32_t count { 0u };
+};
+
+struct Split {
+    int axis { -1 };
+    std::uint32_t position { 0u }; // bins [0, position) go to the left child
+    float cost { std::numeric_limits<float>::max() };
+};
+
+// Top levels of the tree, built serially before the subtrees are handed to the pool
+struct TopNode {
+    Aabb bounds;
+    std::uint32_t left { ~0u };
+    std::uint32_t right { ~0u };
+    std::uint32_t task { ~0u }; // index of the subtree built by a task, ~0u for interior nodes
+};
+
+
+class Builder {
+public:
+    Builder(std::span<const Aabb> primitiveBounds, const BuildOptions& buildOptions)
+        : bounds { primitiveBounds }
+        , options { buildOptions }
+        , items(primitiveBounds.size())
+    {
+        options.bin_count = std::max(options.bin_count, 2u);
+        options.max_leaf_size = std::max(options.max_leaf_size, 1u);
+        if (options.thread_count == 0u) {
+            options.thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        // Smaller builds never split into enough work for the pool, see for_each_chunk()
+        if (primitiveBounds.size() < 2uz * options.parallel_threshold) { return; }
+        if (options.thread_pool && options.thread_pool->size() > 0u) {
+            thread_pool = options.thread_pool;
+            options.thread_count = thread_pool->size();
+        } else if (options.thread_count > 1u) {
+            owned_thread_pool = std::make_unique<ThreadPool>(options.thread_count);
+            thread_pool = owned_thread_pool.get();
+        }
+    }
+
+    Bvh run() {
+        Bvh bvh;
+        if (bounds.empty()) { return bvh; }
+
+        const Range root { 0u, static_cast<std::uint32_t>(bounds.size()) };
+        for_each_chunk(root, [this] (Range chunk, std::uint32_t) {
+            for (std::uint32_t i { chunk.first }; i < chunk.first + chunk.count; ++i) {
+                items[i] = Primitive { .bounds = bounds[i], .centroid = bounds[i].centroid(), .index = i };
+            }
+        });
+
+        // Split serially until there is enough independent work for every thread
+        const std::uint32_t granularity = std::max(
+            options.parallel_threshold,
+            root.count / (options.thread_count * 8u)
+        );
+        const std::uint32_t top_root = build_top(root, granularity);
+
+        subtree_nodes.resize(subtrees.size());
+        subtree_depths.resize(subtrees.size());
+        if (thread_pool && subtrees.size() > 1uz) {
+            std::vector<std::future<void>> futures;
+            futures.reserve(subtrees.size());
+            for (std::size_t i { 0uz }; i < subtrees.size(); ++i) {
+                futures.push_back(thread_pool->submit([this, i] () {
+                    subtree_depths[i] = build_subtree(subtrees[i], subtree_nodes[i]);
+                }));
+            }
+            for (auto& future : futures) { future.get(); }
+        } else {
+            for (std::size_t i { 0uz }; i < subtrees.size(); ++i) {
+                subtree_depths[i] = build_subtree(subtrees[i], subtree_nodes[i]);
+            }
+        }
+
+        std::size_t node_count { top_nodes.size() };
+        for (const auto& nodes : subtree_nodes) { node_count += nodes.size(); }
+        bvh.nodes.reserve(node_count);
+        bvh.depth = flatten(top_root, bvh.nodes);
+        bvh.primitives.resize(items.size());
+        for (std::size_t i { 0uz }; i < items.size(); ++i) { bvh.primitives[i] = items[i].index; }
+
+        return bvh;
+    }
+
+private:
+    // Runs function(chunk, chunk_index) over the range, on the pool when the range is large
+    template <typename Function>
+    std::uint32_t for_each_chunk(Range range, Function&& function) {
+        const bool parallel = thread_pool && range.count >= 2u * options.parallel_threshold;
+        if (!parallel) {
+            function(range, 0u);
+            return 1u;
+        }
+
+        const std::uint32_t chunk_count = thread_pool->size();
+        const std::uint32_t chunk_size = (range.count + chunk_count - 1u) / chunk_count;
+        std::vector<std::future<void>> futures;
+        futures.reserve(chunk_count);
+        for (std::uint32_t i { 0u }; i < chunk_count; ++i) {
+            const std::uint32_t first = range.first + i * chunk_size;
+            const std::uint32_t end = std::min(first + chunk_size, range.first + range.count);
+            if (first >= end) { break; }
+            futures.push_back(thread_pool->submit([&function, first, end, i] () {
+                function(Range { first, end - first }, i);
+            }));
+        }
+        for (auto& future : futures) { future.get(); }
+
+        return static_cast<std::uint32_t>(futures.size());
+    }
+
+    void range_bounds(Range range, Aabb& rangeBounds, Aabb& centroidBounds, bool parallel) {
+        const std::uint32_t chunk_count = parallel && thread_pool ? thread_pool->size() : 1u;
+        std::vector<Aabb> chunk_bounds(chunk_count);
+        std::vector<Aabb> chunk_centroid_bounds(chunk_count);
+        auto compute = [&] (Range chunk, std::uint32_t chunkIndex) {
+            for (std::uint32_t i { chunk.first }; i < chunk.first + chunk.count; ++i) {
+                chunk_bounds[chunkIndex].grow(items[i].bounds);
+                chunk_centroid_bounds[chunkIndex].grow(items[i].centroid);
+            }
+        };
+        if (parallel) {
+            for_each_chunk(range, compute);
+        } else {
+            compute(range, 0u);
+        }
+
+        for (std::uint32_t i { 0u }; i < chunk_count; ++i) {
+            rangeBounds.grow(chunk_bounds[i]);
+            centroidBounds.grow(chunk_centroid_bounds[i]);
+        }
+    }
+
+    std::uint32_t bin_index(const glm::vec3& centroid, const Aabb& centroidBounds, int axis, float scale) const {
+        const float offset = (centroid[axis] - centroidBounds.min[axis]) * scale;
+        return std::min(static_cast<std::uint32_t>(std::max(offset, 0.0f)), options.bin_count - 1u);
+    }
+
+    Split find_split(Range range, const Aabb& rangeBounds, const Aabb& centroidBounds, bool parallel) {
+        Split best;
+        const float parent_area = rangeBounds.surface_area();
+        if (parent_area <= 0.0f) { return best; }
+
+        // All three axes are binned in a single pass over the range
+        const std::uint32_t bin_count = options.bin_count;
+        const glm::vec3 extent = centroidBounds.extent();
+        glm::vec3 scale { 0.0f };
+        for (int axis { 0 }; axis < 3; ++axis) {
+            if (extent[axis] > 0.0f) { scale[axis] = static_cast<float>(bin_count) / extent[axis]; }
+        }
+
+        const std::uint32_t chunk_count = parallel && thread_pool ? thread_pool->size() : 1u;
+        std::vector<Bin> chunk_bins(chunk_count * 3u * bin_count);
+        auto compute = [&] (Range chunk, std::uint32_t chunkIndex) {
+            Bin* bins = chunk_bins.data() + chunkIndex * 3u * bin_count;
+            for (std::uint32_t i { chunk.first }; i < chunk.first + chunk.count; ++i) {
+                const Primitive& primitive = items[i];
+                for (int axis { 0 }; axis < 3; ++axis) {
+                    Bin& bin = bins[axis * bin_count + bin_index(primitive.centroid, centroidBounds, axis, scale[axis])];
+                    bin.bounds.grow(primitive.bounds);
+                    ++bin.count;
+                }
+            }
+        };
+        if (parallel) {
+            for_each_chunk(range, compute);
+        } else {
+            compute(range, 0u);
+        }
+
+        std::vector<Bin> bins(3u * bin_count);
+        for (std::uint32_t c { 0u }; c < chunk_count; ++c) {
+            for (std::uint32_t b { 0u }; b < 3u * bin_count; ++b) {
+                bins[b].bounds.grow(chunk_bins[c * 3u * bin_count + b].bounds);
+                bins[b].count += chunk_bins[c * 3u * bin_count + b].count;
+            }
+        }
+
+        std::vector<float> right_costs(bin_count, 0.0f);
+        for (int axis { 0 }; axis < 3; ++axis) {
+            if (extent[axis] <= 0.0f) { continue; }
+            const Bin* axis_bins = bins.data() + axis * bin_count;
+
+            // Sweep from the right to get the cost of every right side, then from the left
+            Aabb right_bounds;
+            std::uint32_t right_count { 0u };
+            for (std::uint32_t b { bin_count - 1u }; b > 0u; --b) {
+                right_bounds.grow(axis_bins[b].bounds);
+                right_count += axis_bins[b].count;
+                right_costs[b] = right_bounds.surface_area() * static_cast<float>(right_count);
+            }
+
+            Aabb left_bounds;
+            std::uint32_t left_count { 0u };
+            for (std::uint32_t b { 1u }; b < bin_count; ++b) {
+                left_bounds.grow(axis_bins[b - 1u].bounds);
+                left_count += axis_bins[b - 1u].count;
+                if (left_count == 0u || left_count == range.count) { continue; }
+
+                const float cost = options.traversal_cost
+                    + options.intersection_cost
+                    * (left_bounds.surface_area() * static_cast<float>(left_count) + right_costs[b])
+                    / parent_area;
+                if (cost < best.cost) {
+                    best.axis = axis;
+                    best.position = b;
+                    best.cost = cost;
+                }
+            }
+        }
+
+        return best;
+    }
+
+    // Partitions the range and returns the first primitive of the right child,
+    //   or ~0u when the range becomes a leaf
+    std::uint32_t split_range(Range range, const Aabb& rangeBounds, const Aabb& centroidBounds, bool parallel) {
+        if (range.count <= options.max_leaf_size) { return ~0u; }
+
+        const glm::vec3 extent = centroidBounds.extent();
+        if (extent.x <= 0.0f && extent.y <= 0.0f && extent.z <= 0.0f) { return ~0u; } // coincident centroids
+
+        const auto begin = items.begin() + range.first;
+        const auto end = begin + range.count;
+        const Split split = find_split(range, rangeBounds, centroidBounds, parallel);
+        if (split.axis >= 0) {
+            const float scale = static_cast<float>(options.bin_count) / extent[split.axis];
+            const auto middle = std::partition(
+                begin, end,
+                [&] (const Primitive& primitive) {
+                    return bin_index(primitive.centroid, centroidBounds, split.axis, scale) < split.position;
+                }
+            );
+            if (middle != begin && middle != end) {
+                return range.first + static_cast<std::uint32_t>(middle - begin);
+            }
+        }
+
+        // Fall back to an object median split along the longest axis
+        int axis { 0 };
+        if (extent.y > extent[axis]) { axis = 1; }
+        if (extent.z > extent[axis]) { axis = 2; }
+        const auto middle = begin + range.count / 2u;
+        std::nth_element(
+            begin, middle, end,
+            [axis] (const Primitive& a, const Primitive& b) { return a.centroid[axis] < b.centroid[axis]; }
+        );
+
+        return range.first + range.count / 2u;
+    }
+
+    std::uint32_t build_top(Range range, std::uint32_t granularity) {
+        const std::uint32_t index = static_cast<std::uint32_t>(top_nodes.size());
+        top_nodes.push_back(TopNode {});
+
+        std::uint32_t middle { ~0u };
+        if (range.count > granularity) {
+            Aabb node_bounds;
+            Aabb centroid_bounds;
+            range_bounds(range, node_bounds, centroid_bounds, true);
+            top_nodes[index].bounds = node_bounds;
+            middle = split_range(range, node_bounds, centroid_bounds, true);
+        }
+
+        if (middle == ~0u) {
+            top_nodes[index].task = static_cast<std::uint32_t>(subtrees.size());
+            subtrees.push_back(range);
+            return index;
+        }
+
+        const std::uint32_t left = build_top(Range { range.first, middle - range.first }, granularity);
+        const std::uint32_t right = build_top(Range { middle, range.first + range.count - middle }, granularity);
+        top_nodes[index].left = left;
+        top_nodes[index].right = right;
+
+        return index;
+    }
+
+    // Builds a subtree into its own depth-first node array, returns its depth
+    std::uint32_t build_subtree(Range range, std::vector<Node>& nodes) {
+        const std::size_t index = nodes.size();
+        nodes.push_back(Node {});
+
+        Aabb node_bounds;
+        Aabb centroid_bounds;
+        range_bounds(range, node_bounds, centroid_bounds, false);
+        nodes[index].aabb_min = node_bounds.min;
+        nodes[index].aabb_max = node_bounds.max;
+
+        const std::uint32_t middle = split_range(range, node_bounds, centroid_bounds, false);
+        if (middle == ~0u) {
+            nodes[index].offset = range.first;
+            nodes[index].count = range.count;
+            return 1u;
+        }
+
+        const std::uint32_t left_depth = build_subtree(Range { range.first, middle - range.first }, nodes);
+        const std::uint32_t right_index = static_cast<std::uint32_t>(nodes.size());
+        const std::uint32_t right_depth = build_subtree(Range { middle, range.first + range.count - middle }, nodes);
+        nodes[index].offset = right_index;
+        nodes[index].count = 0u;
+
+        return std::max(left_depth, right_depth) + 1u;
+    }
+
+    // Emits the top levels and the subtrees as one depth-first array, returns the depth
+    std::uint32_t flatten(std::uint32_t topIndex, std::vector<Node>& nodes) {
+        const TopNode& top_node = top_nodes[topIndex];
+        if (top_node.task != ~0u) {
+            const std::uint32_t base = static_cast<std::uint32_t>(nodes.size());
+            for (Node node : subtree_nodes[top_node.task]) {
+                if (node.count == 0u) { node.offset += base; }
+                nodes.push_back(node);
+            }
+            return subtree_depths[top_node.task];
+        }
+
+        const std::size_t index = nodes.size();
+        nodes.push_back(Node {
+            .aabb_min = top_node.bounds.min,
+            .offset = 0u,
+            .aabb_max = top_node.bounds.max,
+            .count = 0u
+        });
+        const std::uint32_t left_depth = flatten(top_node.left, nodes);
+        const std::uint32_t right_index = static_cast<std::uint32_t>(nodes.size());
+        const std::uint32_t right_depth = flatten(top_node.right, nodes);
+        nodes[index].offset = right_index;
+
+        return std::max(left_depth, right_depth) + 1u;
+    }
+
+    std::span<const Aabb> bounds;
+    BuildOptions options;
+    std::vector<Primitive> items;
+    std::unique_ptr<ThreadPool> owned_thread_pool; // without BuildOptions::thread_pool
+    ThreadPool* thread_pool { nullptr }; // nullptr: a serial build
+
+    std::vector<TopNode> top_nodes;
+    std::vector<Range> subtrees;
+    std::vector<std::vector<Node>> subtree_nodes;
+    std::vector<std::uint32_t> subtree_depths;
+};
+
+} // namespace end
+
+
+float Bvh::sah_cost(float traversalCost, float intersectionCost) const {
+    if (nodes.empty()) { return 0.0f; }
+
+    auto area = [] (const Node& node) {
+        Aabb aabb { .min = node.aabb_min, .max = node.aabb_max };
+        return aabb.surface_area();
+    };
+    const float root_area = area(nodes[0uz]);
+    if (root_area <= 0.0f) { return 0.0f; }
+
+    float cost { 0.0f };
+    for (const Node& node : nodes) {
+        const float weight = area(node) / root_area;
+        cost += node.count == 0u
+            ? traversalCost * weight
+            : intersectionCost * static_cast<float>(node.count) * weight;
+    }
+
+    return cost;
+}
+
+
+Bvh build(std::span<const Aabb> primitiveBounds, const BuildOptions& options) {
+    Builder builder { primitiveBounds, options };
+    return builder.run();
+}
+
+
+std::vector<Aabb> sphere_bounds(std::span<const glm::vec4> spheres) {
+    std::vector<Aabb> bounds(spheres.size());
+    for (std::size_t i { 0uz }; i < spheres.size(); ++i) {
+        const glm::vec3 center { spheres[i].x, spheres[i].y, spheres[i].z };
+        const glm::vec3 radius { spheres[i].w };
+        bounds[i] = Aabb { .min = center - radius, .max = center + radius };
+    }
+
+    return bounds;
+}
+
+} // namespace bvh end
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+
+namespace bvh {
+
+class ThreadPool; // thread_pool.hpp
+
+struct Aabb {
+    glm::vec3 min { std::numeric_limits<float>::max() };
+    glm::vec3 max { std::numeric_limits<float>::lowest() };
+
+    void grow(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const Aabb& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    glm::vec3 centroid() const { return 0.5f * (min + max); }
+    glm::vec3 extent() const { return max - min; }
+
+    float surface_area() const {
+        if (empty()) { return 0.0f; }
+        const glm::vec3 e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+
+// Matches the std430 layout of BvhNode in the shaders (32 bytes), so the node
+//   array can be copied into a storage buffer as it is.
+// The nodes are stored depth-first: the left child of an interior node directly
+//   follows its parent, so only the index of the right child is stored.
+struct Node {
+    glm::vec3 aabb_min;
+    std::uint32_t offset; // interior: index of the right child, leaf: first entry in Bvh::primitives
+    glm::vec3 aabb_max;
+    std::uint32_t count; // 0 for interior nodes
+};
+static_assert(sizeof(Node) == 32u, "bvh::Node must match the std430 layout");
+
+
+struct BuildOptions {
+    std::uint32_t bin_count { 16u };
+    std::uint32_t max_leaf_size { 4u };
+    float traversal_cost { 1.0f };
+    float intersection_cost { 1.0f };
+    std::uint32_t thread_count { 0u }; // 0: std::thread::hardware_concurrency()
+    std::uint32_t parallel_threshold { 4096u }; // smaller subtrees are built by a single task
+    // Shared by the builds of a caller, instead of a pool of thread_count threads per build.
+    //   Either is only used by builds of at least 2 * parallel_threshold primitives.
+    ThreadPool* thread_pool { nullptr };
+};
+
+
+struct Bvh {
+    std::vector<Node> nodes;
+    std::vector<std::uint32_t> primitives; // primitive indices referenced by the leaves
+    std::uint32_t depth { 0u };
+
+    // Expected cost of a random ray hitting the root, weighted by the surface area heuristic
+    float sah_cost(float traversalCost = 1.0f, float intersectionCost = 1.0f) const;
+};
+
+
+// Builds a BVH with a binned SAH over primitive bounds, the subtrees are built
+//   in parallel and flattened into a single depth-first node array.
+Bvh build(std::span<const Aabb> primitiveBounds, const BuildOptions& options = {});
+
+
+// Any vertex with a glm::vec3 `position` and any triangle with vertex indices t0, t1, t2,
+//   e.g. the Vertex/Triangle of 7_path_tracing
+template <typename VertexType, typename TriangleType>
+std::vector<Aabb> triangle_bounds(
+    const std::vector<VertexType>& vertices,
+    const std::vector<TriangleType>& triangles
+) {
+    std::vector<Aabb> bounds(triangles.size());
+    for (std::size_t i { 0uz }; i < triangles.size(); ++i) {
+        bounds[i].grow(vertices[triangles[i].t0].position);
+        bounds[i].grow(vertices[triangles[i].t1].position);
+        bounds[i].grow(vertices[triangles[i].t2].position);
+    }
+
+    return bounds;
+}
+
+// Spheres packed as (center, radius), e.g. HittableDump::dump of a sphere-only scene
+std::vector<Aabb> sphere_bounds(std::span<const glm::vec4> spheres);
+
+
+constexpr std::uint32_t WIDE_NODE_CHILDREN { 8u };
+// The meta byte of a child of a WideNode, 1 to WIDE_LEAF_MAX_COUNT for a leaf of that many primitives
+constexpr std::uint32_t WIDE_CHILD_EMPTY { 0x00u };
+constexpr std::uint32_t WIDE_CHILD_INTERIOR { 0x80u };
+constexpr std::uint32_t WIDE_LEAF_MAX_COUNT { 0x7fu };
+
+
+// Up to WIDE_NODE_CHILDREN children with their bounds quantized to 8 bits in the frame of
+//   the node: a child spans origin + q_lo * scale to origin + q_hi * scale, the scale a power
+//   of two per axis. Matches the std430 layout of WideBvhNode in the shaders (80 bytes), the
+//   bounds of 8 children take 48 bytes where a Node takes 24 for a single one.
+// The interior children are stored from child_base and the primitives of the leaf children
+//   from primitive_base, both in the order of the slots.
+struct WideNode {
+    glm::vec3 origin;
+    std::uint32_t exponents; // biased float exponents of the scales: x | y << 8 | z << 16
+    std::uint32_t child_base; // into WideBvh::nodes
+    std::uint32_t primitive_base; // into WideBvh::primitives
+    std::uint32_t meta[2]; // a byte per slot, slot i in byte i % 4 of meta[i / 4]
+    std::uint32_t bounds[12]; // a byte per slot: q_lo of x, y, z then q_hi of x, y, z, two words each
+
+    std::uint32_t child_meta(std::uint32_t slot) const { return (meta[slot >> 2u] >> ((slot & 3u) * 8u)) & 0xffu; }
+
+    glm::vec3 scale() const {
+        return glm::vec3(
+            std::bit_cast<float>((exponents & 0xffu) << 23u),
+            std::bit_cast<float>(((exponents >> 8u) & 0xffu) << 23u),
+            std::bit_cast<float>(((exponents >> 16u) & 0xffu) << 23u)
+        );
+    }
+
+    Aabb child_bounds(std::uint32_t slot) const {
+        const std::uint32_t shift = (slot & 3u) * 8u;
+        const std::uint32_t word = slot >> 2u;
+        const glm::vec3 s = scale();
+        Aabb child;
+        for (int axis { 0 }; axis < 3; ++axis) {
+            child.min[axis] = origin[axis] + static_cast<float>((bounds[2 * axis + word] >> shift) & 0xffu) * s[axis];
+            child.max[axis] = origin[axis] + static_cast<float>((bounds[6 + 2 * axis + word] >> shift) & 0xffu) * s[axis];
+        }
+
+        return child;
+    }
+};
+static_assert(sizeof(WideNode) == 80u, "bvh::WideNode must match the std430 layout");
+
+
+struct WideBvh {
+    std::vector<WideNode> nodes; // nodes[0] is the root
+    std::vector<std::uint32_t> primitives; // primitive indices referenced by the leaf children
+    std::uint32_t depth { 0u };
+};
+
+
+struct CollapseOptions {
+    std::uint32_t width { WIDE_NODE_CHILDREN }; // 2 to WIDE_NODE_CHILDREN
+    std::uint32_t max_leaf_size { 8u }; // subtrees of at most this many primitives become a single leaf child
+};
+
+
+// Collapses a binary BVH into nodes of up to options.width children: the interior child with
+//   the largest surface area is replaced by its two children until the node is full. Leaves
+//   of more than WIDE_LEAF_MAX_COUNT primitives are split up the same way.
+//   A binary BVH of a single leaf gives a root with a single leaf child.
+WideBvh collapse(const Bvh& binary, const CollapseOptions& options = {});
+
+} // namespace bvh end
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace bvh {
+
+// A fixed-size pool of worker threads consuming a FIFO task queue.
+// Tasks must not block on other tasks of the same pool.
+class ThreadPool {
+public:
+    explicit ThreadPool(std::uint32_t threadCount) {
+        workers.reserve(threadCount);
+        for (std::uint32_t i { 0u }; i < threadCount; ++i) {
+            workers.emplace_back([this] () { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            stopping = true;
+        }
+        condition.notify_all();
+    }
+
+    std::uint32_t size() const { return static_cast<std::uint32_t>(workers.size()); }
+
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> submit(Function&& function) {
+        using Result = std::invoke_result_t<Function>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        std::future<Result> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            tasks.emplace([task] () { (*task)(); });
+        }
+        condition.notify_one();
+
+        return future;
+    }
+
+private:
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock { mutex };
+                condition.wait(lock, [this] () { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) { return; }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping { false };
+    std::vector<std::jthread> workers; // declared last: joined before the members above are destroyed
+};
+
+} // namespace bvh end
@@ -0,0 +1,196 @@
+#include "bvh_builder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace bvh {
+
+namespace {
+
+// A child of a wide node before it is written: a node of the binary BVH, or a range of the
+//   primitives below it. build() partitions the primitives in place, so the leaves of a
+//   subtree cover a contiguous range of Bvh::primitives.
+struct Item {
+    std::uint32_t node;
+    std::uint32_t first { 0u }; // into Bvh::primitives
+    std::uint32_t count { 0u }; // 0 for an interior node
+};
+
+
+class Collapser {
+public:
+    Collapser(const Bvh& binaryBvh, const CollapseOptions& collapseOptions)
+        : binary { binaryBvh }
+        , width { std::clamp(collapseOptions.width, 2u, WIDE_NODE_CHILDREN) }
+        , max_leaf_size { std::clamp(collapseOptions.max_leaf_size, 1u, WIDE_LEAF_MAX_COUNT) }
+        , primitive_counts(binaryBvh.nodes.size(), 0u)
+    {
+        // The children follow their parent, so a reverse sweep sees them first
+        for (std::size_t i { binary.nodes.size() }; i-- > 0uz;) {
+            const Node& node = binary.nodes[i];
+            primitive_counts[i] = node.count > 0u ? node.count : primitive_counts[i + 1uz] + primitive_counts[node.offset];
+        }
+    }
+
+    WideBvh run() {
+        WideBvh wide;
+        if (binary.nodes.empty()) { return wide; }
+
+        wide.nodes.resize(1uz);
+        wide.depth = emit(wide, 0u, item(0u));
+
+        return wide;
+    }
+
+private:
+    // Small subtrees become a single leaf child, the first primitive is the one of their leftmost leaf
+    Item item(std::uint32_t node) const {
+        const Node& binary_node = binary.nodes[node];
+        if (binary_node.count > 0u) { return Item { .node = node, .first = binary_node.offset, .count = binary_node.count }; }
+        if (primitive_counts[node] > max_leaf_size) { return Item { .node = node }; }
+
+        std::uint32_t leftmost = node;
+        while (binary.nodes[leftmost].count == 0u) { ++leftmost; }
+
+        return Item { .node = node, .first = binary.nodes[leftmost].offset, .count = primitive_counts[node] };
+    }
+
+    // Interior nodes, and leaves too large for the meta byte
+    static bool expandable(const Item& child) { return child.count == 0u || child.count > WIDE_LEAF_MAX_COUNT; }
+
+    float surface_area(const Item& child) const { return bounds(child).surface_area(); }
+
+    // Ranges of a split leaf keep the bounds of the whole leaf, which is conservative
+    Aabb bounds(const Item& child) const {
+        const Node& node = binary.nodes[child.node];
+        return Aabb { .min = node.aabb_min, .max = node.aabb_max };
+    }
+
+    void expand(const Item& parent, std::vector<Item>& children) const {
+        if (parent.count == 0u) {
+            children.push_back(item(parent.node + 1u));
+            children.push_back(item(binary.nodes[parent.node].offset));
+        } else {
+            const std::uint32_t half = parent.count / 2u;
+            children.push_back(Item { .node = parent.node, .first = parent.first, .count = half });
+            children.push_back(Item { .node = parent.node, .first = parent.first + half, .count = parent.count - half });
+        }
+    }
+
+    // Fills wide.nodes[index] with the children of parent, then the nodes below. Returns the depth.
+    std::uint32_t emit(WideBvh& wide, std::uint32_t index, const Item& parent) const {
+        std::vector<Item> children;
+        if (expandable(parent)) {
+            expand(parent, children);
+        } else {
+            children.push_back(parent);
+        }
+        while (children.size() < width) {
+            auto largest = children.end();
+            for (auto child = children.begin(); child != children.end(); ++child) {
+                if (expandable(*child) && (largest == children.end() || surface_area(*child) > surface_area(*largest))) {
+                    largest = child;
+                }
+            }
+            if (largest == children.end()) { break; }
+
+            const Item expanded = *largest;
+            children.erase(largest);
+            expand(expanded, children);
+        }
+
+        Aabb frame;
+        for (const Item& child : children) { frame.grow(bounds(child)); }
+
+        WideNode node {};
+        node.origin = frame.min;
+        glm::vec3 scale;
+        for (int axis { 0 }; axis < 3; ++axis) {
+            const std::uint32_t exponent = quantization_exponent(frame.min[axis], frame.max[axis]);
+            node.exponents |= exponent << (8 * axis);
+            scale[axis] = std::bit_cast<float>(exponent << 23u);
+        }
+        node.child_base = static_cast<std::uint32_t>(wide.nodes.size());
+        node.primitive_base = static_cast<std::uint32_t>(wide.primitives.size());
+
+        std::vector<Item> interior_children;
+        for (std::uint32_t slot { 0u }; slot < static_cast<std::uint32_t>(children.size()); ++slot) {
+            const Item& child = children[slot];
+            const std::uint32_t shift = (slot & 3u) * 8u;
+            const std::uint32_t word = slot >> 2u;
+            if (expandable(child)) {
+                node.meta[word] |= WIDE_CHILD_INTERIOR << shift;
+                interior_children.push_back(child);
+            } else {
+                node.meta[word] |= child.count << shift;
+                wide.primitives.insert(
+                    wide.primitives.end(),
+                    binary.primitives.begin() + child.first,
+                    binary.primitives.begin() + child.first + child.count
+                );
+            }
+
+            const Aabb child_bounds = bounds(child);
+            for (int axis { 0 }; axis < 3; ++axis) {
+                const std::uint32_t q_lo = quantize_down(child_bounds.min[axis], node.origin[axis], scale[axis]);
+                const std::uint32_t q_hi = quantize_up(child_bounds.max[axis], node.origin[axis], scale[axis]);
+                node.bounds[2 * axis + word] |= q_lo << shift;
+                node.bounds[6 + 2 * axis + word] |= q_hi << shift;
+            }
+        }
+
+        // The interior children are allocated together, so they are found from child_base
+        wide.nodes[index] = node;
+        wide.nodes.resize(wide.nodes.size() + interior_children.size());
+        std::uint32_t depth { 0u };
+        for (std::uint32_t i { 0u }; i < static_cast<std::uint32_t>(interior_children.size()); ++i) {
+            depth = std::max(depth, emit(wide, node.child_base + i, interior_children[i]));
+        }
+
+        return depth + 1u;
+    }
+
+    // The biased float exponent of the smallest power of two scale with which 255 steps
+    //   from min reach max, after rounding
+    static std::uint32_t quantization_exponent(float min, float max) {
+        const float extent = max - min;
+        int exponent { -126 };
+        if (extent > 0.0f) {
+            std::frexp(extent / 255.0f, &exponent);
+            exponent = std::max(exponent, -126);
+        }
+        while (exponent < 127 && min + 255.0f * std::ldexp(1.0f, exponent) < max) { ++exponent; }
+
+        return static_cast<std::uint32_t>(exponent + 127);
+    }
+
+    // The steps are rounded outwards, and checked with the arithmetic of the traversal
+    static std::uint32_t quantize_down(float value, float origin, float scale) {
+        std::uint32_t q = static_cast<std::uint32_t>(std::clamp(std::floor((value - origin) / scale), 0.0f, 255.0f));
+        while (q > 0u && origin + static_cast<float>(q) * scale > value) { --q; }
+
+        return q;
+    }
+
+    static std::uint32_t quantize_up(float value, float origin, float scale) {
+        std::uint32_t q = static_cast<std::uint32_t>(std::clamp(std::ceil((value - origin) / scale), 0.0f, 255.0f));
+        while (q < 255u && origin + static_cast<float>(q) * scale < value) { ++q; }
+
+        return q;
+    }
+
+    const Bvh& binary;
+    std::uint32_t width;
+    std::uint32_t max_leaf_size;
+    std::vector<std::uint32_t> primitive_counts; // below each binary node
+};
+
+} // namespace end
+
+
+WideBvh collapse(const Bvh& binary, const CollapseOptions& options) {
+    return Collapser { binary, options }.run();
+}
+
+} // namespace bvh end
@@ -0,0 +1,385 @@
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include "gpu_profiler.hpp"
+
+#include <minilog.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+
+namespace profiler {
+
+namespace {
+
+// In the order of the bits of vk::QueryPipelineStatisticFlagBits, the order of the results
+constexpr std::array<std::string_view, 11uz> PIPELINE_STATISTIC_NAMES = {
+    "input_assembly_vertices",
+    "input_assembly_primitives",
+    "vertex_shader_invocations",
+    "geometry_shader_invocations",
+    "geometry_shader_primitives",
+    "clipping_invocations",
+    "clipping_primitives",
+    "fragment_shader_invocations",
+    "tessellation_control_shader_patches",
+    "tessellation_evaluation_shader_invocations",
+    "compute_shader_invocations"
+};
+
+std::string json_string(std::string_view text) {
+    std::string escaped { "\"" };
+    for (char c : text) {
+        if (c == '"' || c == '\\') { escaped += '\\'; }
+        escaped += c;
+    }
+    escaped += '"';
+
+    return escaped;
+}
+
+} // namespace
+
+
+GpuProfiler::GpuProfiler(
+    vk::PhysicalDevice physicalDevice,
+    vk::Device logicalDevice,
+    std::uint32_t queueFamilyIndex,
+    const ProfilerOptions& profilerOptions
+)
+    : device { logicalDevice }
+    , options { profilerOptions }
+    , slots(profilerOptions.frames_in_flight)
+{
+    const std::vector<vk::QueueFamilyProperties> queue_families = physicalDevice.getQueueFamilyProperties();
+    const std::uint32_t valid_bits = queueFamilyIndex < queue_families.size()
+        ? queue_families[queueFamilyIndex].timestampValidBits
+        : 0u;
+    if (valid_bits == 0u) {
+        minilog::log_warn("gpu profiler: queue family {} writes no timestamps, profiling is off", queueFamilyIndex);
+        return;
+    }
+    timestamp_mask = valid_bits >= 64u ? ~0ull : (1ull << valid_bits) - 1ull;
+    timestamp_period = physicalDevice.getProperties().limits.timestampPeriod;
+
+    if (options.pipeline_statistics && !physicalDevice.getFeatures().pipelineStatisticsQuery) {
+        minilog::log_warn("gpu profiler: pipelineStatisticsQuery is not supported, only timestamps are recorded");
+        options.pipeline_statistics = {};
+    }
+    const auto statistic_bits = static_cast<vk::QueryPipelineStatisticFlags::MaskType>(options.pipeline_statistics);
+    for (std::size_t bit { 0uz }; bit < PIPELINE_STATISTIC_NAMES.size(); ++bit) {
+        if ((statistic_bits >> bit) & 1u) { statistic_names.push_back(PIPELINE_STATISTIC_NAMES[bit]); }
+    }
+
+    vk::QueryPoolCreateInfo timestamp_pool_ci {
+        .pNext = nullptr,
+        .flags = {},
+        .queryType = vk::QueryType::eTimestamp,
+        .queryCount = options.frames_in_flight * options.max_zones * 2u,
+        .pipelineStatistics = {}
+    };
+    if (
+        vk::Result result = device.createQueryPool(&timestamp_pool_ci, nullptr, &timestamp_pool);
+        result != vk::Result::eSuccess
+    ) {
+        minilog::log_fatal("gpu profiler: failed to create the timestamp vk::QueryPool!");
+    }
+
+    if (!statistic_names.empty()) {
+        vk::QueryPoolCreateInfo statistics_pool_ci {
+            .pNext = nullptr,
+            .flags = {},
+            .queryType = vk::QueryType::ePipelineStatistics,
+            .queryCount = options.frames_in_flight * options.max_zones,
+            .pipelineStatistics = options.pipeline_statistics
+        };
+        if (
+            vk::Result result = device.createQueryPool(&statistics_pool_ci, nullptr, &statistics_pool);
+            result != vk::Result::eSuccess
+        ) {
+            minilog::log_fatal("gpu profiler: failed to create the pipeline statistics vk::QueryPool!");
+        }
+    }
+}
+
+GpuProfiler::~GpuProfiler() {
+    device.destroy(statistics_pool);
+    device.destroy(timestamp_pool);
+}
+
+void GpuProfiler::begin_frame(vk::CommandBuffer commandBuffer, std::uint32_t frameIndex) {
+    if (!enabled()) { return; }
+
+    current_slot = frameIndex % options.frames_in_flight;
+    if (slots[current_slot].pending) { read_back(current_slot); }
+
+    FrameSlot& slot = slots[current_slot];
+    slot.frame = frame_count++;
+    slot.zones.clear();
+    slot.pending = true;
+    open_zones = 0u;
+
+    commandBuffer.resetQueryPool(timestamp_pool, timestamp_query(current_slot, 0u), options.max_zones * 2u);
+    if (statistics_pool) {
+        commandBuffer.resetQueryPool(statistics_pool, statistics_query(current_slot, 0u), options.max_zones);
+    }
+}
+
+std::uint32_t GpuProfiler::begin_zone(vk::CommandBuffer commandBuffer, std::string_view name) {
+    if (!enabled()) { return NO_ZONE; }
+
+    FrameSlot& slot = slots[current_slot];
+    if (slot.zones.size() >= options.max_zones) {
+        if (!overflow_reported) {
+            minilog::log_warn("gpu profiler: more than {} zones in a frame, zone {} and later are dropped", options.max_zones, name);
+            overflow_reported = true;
+        }
+        return NO_ZONE;
+    }
+
+    const auto zone = static_cast<std::uint32_t>(slot.zones.size());
+    slot.zones.push_back(PendingZone {
+        .name = std::string { name },
+        .depth = open_zones,
+        .statistics = statistics_pool && open_zones == 0u
+    });
+    ++open_zones;
+
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestamp_pool, timestamp_query(current_slot, zone));
+    if (slot.zones.back().statistics) {
+        commandBuffer.beginQuery(statistics_pool, statistics_query(current_slot, zone), {});
+    }
+
+    return zone;
+}
+
+void GpuProfiler::end_zone(vk::CommandBuffer commandBuffer, std::uint32_t zone) {
+    if (!enabled() || zone == NO_ZONE) { return; }
+
+    if (slots[current_slot].zones[zone].statistics) {
+        commandBuffer.endQuery(statistics_pool, statistics_query(current_slot, zone));
+    }
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestamp_pool, timestamp_query(current_slot, zone) + 1u);
+    --open_zones;
+}
+
+// Without vk::QueryResultFlagBits::eWait: a query that is not available yet drops the frame
+void GpuProfiler::read_back(std::uint32_t slotIndex) {
+    FrameSlot& slot = slots[slotIndex];
+    slot.pending = false;
+    if (slot.zones.empty()) { return; }
+
+    std::vector<std::uint64_t> timestamps(slot.zones.size() * 2uz);
+    if (
+        vk::Result result = device.getQueryPoolResults(
+            timestamp_pool,
+            timestamp_query(slotIndex, 0u), static_cast<std::uint32_t>(timestamps.size()),
+            timestamps.size() * sizeof(std::uint64_t), timestamps.data(), sizeof(std::uint64_t),
+            vk::QueryResultFlagBits::e64
+        );
+        result != vk::Result::eSuccess
+    ) {
+        ++dropped_frames;
+        return;
+    }
+
+    FrameResult frame_result { .frame = slot.frame, .zones = {} };
+    frame_result.zones.reserve(slot.zones.size());
+    for (std::uint32_t zone { 0u }; zone < slot.zones.size(); ++zone) {
+        const std::uint64_t ticks = (timestamps[2u * zone + 1u] - timestamps[2u * zone]) & timestamp_mask;
+        ZoneResult zone_result {
+            .name = std::move(slot.zones[zone].name),
+            .depth = slot.zones[zone].depth,
+            .milliseconds = static_cast<double>(ticks) * timestamp_period * 1e-6,
+            .statistics = {}
+        };
+        if (slot.zones[zone].statistics) {
+            zone_result.statistics.resize(statistic_names.size());
+            if (
+                vk::Result result = device.getQueryPoolResults(
+                    statistics_pool,
+                    statistics_query(slotIndex, zone), 1u,
+                    zone_result.statistics.size() * sizeof(std::uint64_t), zone_result.statistics.data(),
+                    zone_result.statistics.size() * sizeof(std::uint64_t),
+                    vk::QueryResultFlagBits::e64
+                );
+                result != vk::Result::eSuccess
+            ) {
+                ++dropped_frames;
+                return;
+            }
+        }
+        frame_result.zones.push_back(std::move(zone_result));
+    }
+
+    record(std::move(frame_result));
+}
+
+void GpuProfiler::record(FrameResult&& frameResult) {
+    for (const ZoneResult& zone : frameResult.zones) {
+        auto summary_it = std::ranges::find(zone_summaries, zone.name, &ZoneSummary::name);
+        if (summary_it == zone_summaries.end()) {
+            zone_summaries.push_back(ZoneSummary { .name = zone.name });
+            summary_it = std::prev(zone_summaries.end());
+        }
+        ZoneSummary& summary = *summary_it;
+        ++summary.count;
+        summary.total_milliseconds += zone.milliseconds;
+        summary.min_milliseconds = std::min(summary.min_milliseconds, zone.milliseconds);
+        summary.max_milliseconds = std::max(summary.max_milliseconds, zone.milliseconds);
+        if (!zone.statistics.empty()) {
+            summary.statistics.resize(zone.statistics.size(), 0u);
+            for (std::size_t i { 0uz }; i < zone.statistics.size(); ++i) { summary.statistics[i] += zone.statistics[i]; }
+        }
+    }
+
+    history.push_back(std::move(frameResult));
+    while (history.size() > options.history_size) { history.pop_front(); }
+}
+
+void GpuProfiler::collect() {
+    if (!enabled()) { return; }
+
+    // Oldest first, so the history stays in frame order
+    std::vector<std::uint32_t> pending;
+    for (std::uint32_t i { 0u }; i < slots.size(); ++i) {
+        if (slots[i].pending) { pending.push_back(i); }
+    }
+    std::ranges::sort(pending, {}, [this] (std::uint32_t i) { return slots[i].frame; });
+    for (std::uint32_t i : pending) { read_back(i); }
+}
+
+void GpuProfiler::clear() {
+    collect();
+    history.clear();
+    zone_summaries.clear();
+    dropped_frames = 0u;
+}
+
+const ZoneSummary* GpuProfiler::summary(std::string_view name) const {
+    const auto summary_it = std::ranges::find(zone_summaries, name, &ZoneSummary::name);
+
+    return summary_it == zone_summaries.end() ? nullptr : &*summary_it;
+}
+
+void GpuProfiler::report(const std::filesystem::path& path) {
+    collect();
+    log_summary();
+    if (path.empty()) { return; }
+
+    if (path.extension() == ".json") {
+        write_json(path);
+    } else {
+        write_csv(path);
+    }
+}
+
+void GpuProfiler::log_summary() const {
+    if (!enabled()) { return; }
+
+    for (const ZoneSummary& summary : zone_summaries) {
+        std::string statistics;
+        for (std::size_t i { 0uz }; i < summary.statistics.size(); ++i) {
+            statistics += std::format(
+                ", {} {:.0f}", statistic_names[i],
+                static_cast<double>(summary.statistics[i]) / static_cast<double>(summary.count)
+            );
+        }
+        minilog::log_info(
+            "gpu: {}: {:.3f} ms mean, {:.3f} min, {:.3f} max over {} frames{}",
+            summary.name, summary.mean_milliseconds(), summary.min_milliseconds, summary.max_milliseconds,
+            summary.count, statistics
+        );
+    }
+    if (dropped_frames > 0u) {
+        minilog::log_warn("gpu: {} frames dropped, their queries were not available when read back", dropped_frames);
+    }
+}
+
+// frame,zone,depth,milliseconds then a column per pipeline statistic, empty for nested zones
+void GpuProfiler::write_csv(const std::filesystem::path& path) const {
+    std::ofstream file { path };
+    if (!file) {
+        minilog::log_error("gpu profiler: failed to open {}", path.string());
+        return;
+    }
+
+    file << "frame,zone,depth,milliseconds";
+    for (std::string_view name : statistic_names) { file << ',' << name; }
+    file << '\n';
+    for (const FrameResult& frame : history) {
+        for (const ZoneResult& zone : frame.zones) {
+            file << std::format("{},{},{},{:.6f}", frame.frame, zone.name, zone.depth, zone.milliseconds);
+            for (std::size_t i { 0uz }; i < statistic_names.size(); ++i) {
+                file << ',';
+                if (i < zone.statistics.size()) { file << zone.statistics[i]; }
+            }
+            file << '\n';
+        }
+    }
+    minilog::log_info("gpu profiler: {} frames written to {}", history.size(), path.string());
+}
+
+// {"timestamp_period_ns", "dropped_frames", "summaries": [...], "frames": [{"frame", "zones": [...]}]}
+void GpuProfiler::write_json(const std::filesystem::path& path) const {
+    std::ofstream file { path };
+    if (!file) {
+        minilog::log_error("gpu profiler: failed to open {}", path.string());
+        return;
+    }
+
+    auto write_statistics = [&] (const std::vector<std::uint64_t>& statistics, double divisor) {
+        file << ", \"statistics\": {";
+        for (std::size_t i { 0uz }; i < statistics.size(); ++i) {
+            file << std::format(
+                "{}{}: {}", i > 0uz ? ", " : "", json_string(statistic_names[i]),
+                static_cast<double>(statistics[i]) / divisor
+            );
+        }
+        file << '}';
+    };
+
+    file << std::format(
+        "{{\n  \"timestamp_period_ns\": {},\n  \"dropped_frames\": {},\n  \"summaries\": [",
+        timestamp_period, dropped_frames
+    );
+    for (std::size_t i { 0uz }; i < zone_summaries.size(); ++i) {
+        const ZoneSummary& summary = zone_summaries[i];
+        file << std::format(
+            "{}\n    {{\"zone\": {}, \"count\": {}, \"mean_ms\": {:.6f}, \"min_ms\": {:.6f}, \"max_ms\": {:.6f}",
+            i > 0uz ? "," : "", json_string(summary.name), summary.count,
+            summary.mean_milliseconds(), summary.min_milliseconds, summary.max_milliseconds
+        );
+        if (!summary.statistics.empty()) { write_statistics(summary.statistics, static_cast<double>(summary.count)); }
+        file << '}';
+    }
+    file << "\n  ],\n  \"frames\": [";
+    for (std::size_t f { 0uz }; f < history.size(); ++f) {
+        file << std::format("{}\n    {{\"frame\": {}, \"zones\": [", f > 0uz ? "," : "", history[f].frame);
+        for (std::size_t i { 0uz }; i < history[f].zones.size(); ++i) {
+            const ZoneResult& zone = history[f].zones[i];
+            file << std::format(
+                "{}{{\"zone\": {}, \"depth\": {}, \"ms\": {:.6f}",
+                i > 0uz ? ", " : "", json_string(zone.name), zone.depth, zone.milliseconds
+            );
+            if (!zone.statistics.empty()) { write_statistics(zone.statistics, 1.0); }
+            file << '}';
+        }
+        file << "]}";
+    }
+    file << "\n  ]\n}\n";
+    minilog::log_info("gpu profiler: {} frames written to {}", history.size(), path.string());
+}
+
+
+std::filesystem::path output_from_environment() {
+    if (const char* path = std::getenv("GPU_PROFILE_FILE")) { return path; }
+
+    return {};
+}
+
+} // namespace profiler end
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace profiler {
+
+// Returned by GpuProfiler::begin_zone() for a zone that did not fit, ending it does nothing
+constexpr std::uint32_t NO_ZONE { ~0u };
+
+
+struct ProfilerOptions {
+    std::uint32_t frames_in_flight { 2u }; // each frame in flight gets its own range of queries
+    std::uint32_t max_zones { 32u }; // per frame
+    // Counted by the outermost zones only, Vulkan allows a single active query of the type.
+    //   Needs the pipelineStatisticsQuery feature enabled on the device, and the graphics
+    //   counters a command buffer of a graphics queue family.
+    vk::QueryPipelineStatisticFlags pipeline_statistics {};
+    std::size_t history_size { 4096uz }; // frames kept for write_csv()/write_json()
+};
+
+
+struct ZoneResult {
+    std::string name;
+    std::uint32_t depth { 0u }; // 0 for the outermost zones
+    double milliseconds { 0.0 };
+    // One per bit of ProfilerOptions::pipeline_statistics from the lowest, empty for nested zones
+    std::vector<std::uint64_t> statistics;
+};
+
+
+struct FrameResult {
+    std::uint64_t frame { 0u }; // begin_frame() calls before this one
+    std::vector<ZoneResult> zones; // in the order they began
+};
+
+
+// The zones of the same name over every collected frame
+struct ZoneSummary {
+    std::string name;
+    std::uint64_t count { 0u };
+    double total_milliseconds { 0.0 };
+    double min_milliseconds { std::numeric_limits<double>::max() };
+    double max_milliseconds { 0.0 };
+    std::vector<std::uint64_t> statistics; // summed
+
+    double mean_milliseconds() const { return count > 0u ? total_milliseconds / static_cast<double>(count) : 0.0; }
+};
+
+
+// GPU time of named zones of a command buffer from timestamp queries, and the pipeline
+//   statistics of the outermost ones. Every frame in flight owns a range of the query pools:
+//   begin_frame() reads back what the range recorded frames_in_flight frames ago, without
+//   waiting, then resets it in the command buffer. The caller has waited for that submission
+//   (its fence or timeline value) before recording the command buffer again anyway, results
+//   that are still not available are dropped rather than stalling the frame.
+class GpuProfiler {
+public:
+    GpuProfiler(
+        vk::PhysicalDevice physicalDevice,
+        vk::Device logicalDevice,
+        std::uint32_t queueFamilyIndex, // of the queue the command buffers are submitted to
+        const ProfilerOptions& profilerOptions = {}
+    );
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    ~GpuProfiler();
+
+    // False when the queue family does not write timestamps, every call is then a no-op
+    bool enabled() const { return static_cast<bool>(timestamp_pool); }
+
+    // Right after vkBeginCommandBuffer, outside of a render pass. frameIndex: the frame in
+    //   flight the command buffer belongs to.
+    void begin_frame(vk::CommandBuffer commandBuffer, std::uint32_t frameIndex);
+    // Zones nest, the statistics queries of an outermost zone must begin and end both outside
+    //   of a render pass or both in the same subpass
+    std::uint32_t begin_zone(vk::CommandBuffer commandBuffer, std::string_view name);
+    void end_zone(vk::CommandBuffer commandBuffer, std::uint32_t zone);
+
+    // Reads back the frames still in flight, once the device is idle
+    void collect();
+    // Forgets the collected frames and the summaries
+    void clear();
+
+    const std::deque<FrameResult>& frames() const { return history; }
+    const std::vector<ZoneSummary>& summaries() const { return zone_summaries; }
+    const ZoneSummary* summary(std::string_view name) const; // nullptr: no such zone collected
+
+    // collect(), then the summaries through minilog and, when path is not empty, every frame
+    //   kept into path: *.json as JSON, anything else as CSV
+    void report(const std::filesystem::path& path = {});
+    void log_summary() const;
+    void write_csv(const std::filesystem::path& path) const;
+    void write_json(const std::filesystem::path& path) const;
+
+private:
+    struct PendingZone {
+        std::string name;
+        std::uint32_t depth { 0u };
+        bool statistics { false }; // has a pipeline statistics query
+    };
+
+    struct FrameSlot {
+        std::uint64_t frame { 0u };
+        std::vector<PendingZone> zones;
+        bool pending { false }; // recorded, not read back yet
+    };
+
+    std::uint32_t timestamp_query(std::uint32_t slot, std::uint32_t zone) const { return (slot * options.max_zones + zone) * 2u; }
+    std::uint32_t statistics_query(std::uint32_t slot, std::uint32_t zone) const { return slot * options.max_zones + zone; }
+
+    void read_back(std::uint32_t slot);
+    void record(FrameResult&& frameResult);
+
+    vk::Device device;
+    ProfilerOptions options;
+    double timestamp_period { 1.0 }; // nanoseconds per tick
+    std::uint64_t timestamp_mask { ~0ull }; // the valid bits of the queue family
+    std::vector<std::string_view> statistic_names; // one per bit of options.pipeline_statistics
+    vk::QueryPool timestamp_pool; // 2 queries per zone
+    vk::QueryPool statistics_pool; // 1 query per zone
+
+    std::vector<FrameSlot> slots;
+    std::uint32_t current_slot { 0u };
+    std::uint32_t open_zones { 0u }; // nesting depth of the next zone
+    std::uint64_t frame_count { 0u };
+    std::uint64_t dropped_frames { 0u };
+    bool overflow_reported { false };
+
+    std::deque<FrameResult> history;
+    std::vector<ZoneSummary> zone_summaries;
+};
+
+
+// Begins a zone on construction and ends it when it goes out of scope, before the command
+//   buffer ends
+class GpuZone {
+public:
+    GpuZone(GpuProfiler& profiler, vk::CommandBuffer commandBuffer, std::string_view name)
+        : gpu_profiler { profiler }
+        , command_buffer { commandBuffer }
+        , zone { profiler.begin_zone(commandBuffer, name) }
+    {}
+
+    GpuZone(const GpuZone&) = delete;
+    GpuZone& operator=(const GpuZone&) = delete;
+
+    ~GpuZone() { gpu_profiler.end_zone(command_buffer, zone); }
+
+private:
+    GpuProfiler& gpu_profiler;
+    vk::CommandBuffer command_buffer;
+    std::uint32_t zone;
+};
+
+
+// The GPU_PROFILE_FILE environment variable, like MINILOG_FILE of minilog: where the
+//   samples without command line options write their report, empty when unset
+std::filesystem::path output_from_environment();
+
+} // namespace profiler end